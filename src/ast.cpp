@@ -1,6 +1,10 @@
 #include "ast.hpp"
+#include "scan.hpp"
 #include "token.hpp"
+#include <algorithm>
+#include <cstdint>
 #include <iostream>
+#include <iterator>
 #include <string>
 #include <vector>
 
@@ -8,34 +12,6 @@
 // AST OPERATORS
 // =================================================================
 
-std::map<Token::Type, AST_Op> operators = {
-    {Token::Type::STAR_STAR, AST_Op::EXPONENT},
-    {Token::Type::STAR, AST_Op::MULTIPLY},
-    {Token::Type::SLASH, AST_Op::DIVIDE},
-    {Token::Type::MODULO, AST_Op::MODULUS},
-    {Token::Type::PLUS, AST_Op::ADD},
-    {Token::Type::MINUS, AST_Op::SUBTRACT},
-    {Token::Type::ARROW, AST_Op::ASSIGN},
-    {Token::Type::STAR_EQUAL, AST_Op::ASSIGN_MULTIPLY},
-    {Token::Type::SLASH_EQUAL, AST_Op::ASSIGN_DIVIDE},
-    {Token::Type::PLUS_EQUAL, AST_Op::ASSIGN_INCREMENT},
-    {Token::Type::MINUS_EQUAL, AST_Op::ASSIGN_DECREMENT},
-    {Token::Type::PLUS_PLUS, AST_Op::INCREMENT},
-    {Token::Type::MINUS_MINUS, AST_Op::DECREMENT},
-    {Token::Type::BAR_BAR, AST_Op::LOGICAL_OR},
-    {Token::Type::AMP_AMP, AST_Op::LOGICAL_AND},
-    {Token::Type::BAR, AST_Op::BITWISE_OR},
-    {Token::Type::AMP, AST_Op::BITWISE_AND},
-    {Token::Type::EQUAL_EQUAL, AST_Op::COMP_EQUAL},
-    {Token::Type::BANG_EQUAL, AST_Op::COMP_NOT_EQUAL},
-    {Token::Type::LESS, AST_Op::COMP_LESS},
-    {Token::Type::LESS_EQUAL, AST_Op::COMP_LESS_EQUAL},
-    {Token::Type::MORE, AST_Op::COMP_MORE},
-    {Token::Type::MORE_EQUAL, AST_Op::COMP_MORE_EQUAL},
-    {Token::Type::IS, AST_Op::COMP_IS},
-    {Token::Type::NOT, AST_Op::COMP_NOT},
-};
-
 std::ostream &operator<<(std::ostream &os, const AST_Op &ast_op) {
   static std::map<AST_Op, std::string> op_string = {
       {AST_Op::EXPONENT, "**"},
@@ -69,6 +45,36 @@ std::ostream &operator<<(std::ostream &os, const AST_Op &ast_op) {
   return os;
 }
 
+std::ostream &operator<<(std::ostream &os, const AST_Node::Type &type) {
+  static std::map<AST_Node::Type, std::string> types = {
+      {AST_Node::Type::Assignment, "Assignment"},
+      {AST_Node::Type::String, "String"},
+      {AST_Node::Type::Integer, "Integer"},
+      {AST_Node::Type::Float, "Float"},
+      {AST_Node::Type::Symbol, "Symbol"},
+      {AST_Node::Type::Binary, "Binary"},
+      {AST_Node::Type::Logical, "Logical"},
+      {AST_Node::Type::Unary, "Unary"},
+      {AST_Node::Type::Call, "Call"},
+      {AST_Node::Type::Parameter, "Parameter"},
+      {AST_Node::Type::Function, "Function"},
+      {AST_Node::Type::Grouping, "Grouping"},
+      {AST_Node::Type::Lookup, "Lookup"},
+      {AST_Node::Type::Block, "Block"},
+      {AST_Node::Type::Array_Literal, "Array_Literal"},
+      {AST_Node::Type::Matrix_Literal, "Matrix_Literal"},
+      {AST_Node::Type::Binding, "Binding"},
+      {AST_Node::Type::If_Stmt, "If_Stmt"},
+      {AST_Node::Type::Args, "Args"},
+      {AST_Node::Type::Kwargs, "Kwargs"},
+      {AST_Node::Type::Return, "Return"},
+      {AST_Node::Type::Enum_Decl, "Enum_Decl"},
+      {AST_Node::Type::Import, "Import"},
+  };
+  os << types[type];
+  return os;
+}
+
 // =================================================================
 // AST NODE CONSTRUCTORS
 // =================================================================
@@ -79,13 +85,14 @@ AST_Node::AST_Node(AST_Node::Type type, int line, int start, int stop)
 AST_Assignment::AST_Assignment(AST_Op op, int line, int start, int stop)
     : AST_Node(AST_Node::Type::Assignment, line, start, stop), op(op) {}
 
-AST_Assignment::~AST_Assignment() {
-  delete this->value;
-  delete this->assignee;
-}
+AST_String::AST_String(std::string_view text, bool escaped, int line,
+                       int start, int stop)
+    : AST_Node(AST_Node::Type::String, line, start, stop), text(text),
+      escaped(escaped) {}
 
-AST_String::AST_String(std::string value, int line, int start, int stop)
-    : AST_Node(AST_Node::Type::String, line, start, stop), value(value) {}
+std::string AST_String::value() const {
+  return this->escaped ? decode_escapes(this->text) : std::string(this->text);
+}
 
 AST_Integer::AST_Integer(long long int value, int base, int line, int start,
                          int stop)
@@ -95,380 +102,389 @@ AST_Integer::AST_Integer(long long int value, int base, int line, int start,
 AST_Float::AST_Float(double value, int line, int start, int stop)
     : AST_Node(AST_Node::Type::Float, line, start, stop), value(value) {}
 
-AST_Symbol::AST_Symbol(std::string name, int line, int start, int stop)
+AST_Symbol::AST_Symbol(Symbol_Id name, int line, int start, int stop)
     : AST_Node(AST_Node::Type::Symbol, line, start, stop), name(name) {}
 
 AST_Binary::AST_Binary(AST_Op op, int line, int start, int stop)
     : AST_Node(AST_Node::Type::Binary, line, start, stop), op(op) {}
 
-AST_Binary::~AST_Binary() {
-  delete this->left;
-  delete this->right;
-}
-
 AST_Logical::AST_Logical(AST_Op op, int line, int start, int stop)
     : AST_Node(AST_Node::Type::Logical, line, start, stop), op(op) {}
 
-AST_Logical::~AST_Logical() {
-  delete this->left;
-  delete this->right;
-}
-
 AST_Unary::AST_Unary(AST_Op op, int line, int start, int stop)
     : AST_Node(AST_Node::Type::Unary, line, start, stop), op(op) {}
 
-AST_Unary::~AST_Unary() { delete this->operand; }
-
 AST_Call::AST_Call(AST_Node *callee, int line, int start, int stop)
     : AST_Node(AST_Node::Type::Call, line, start, stop), callee(callee) {}
 
-AST_Call::~AST_Call() {
-  delete this->callee;
-  for (AST_Node *node : this->args)
-    delete node;
-}
-
 AST_Function::AST_Function(int line, int start, int stop)
     : AST_Node(AST_Node::Type::Function, line, start, stop) {}
 
-AST_Function::~AST_Function() {
-  if (this->return_type)
-    delete this->return_type.value();
-
-  for (AST_Node *node : this->params)
-    delete node;
-  this->params.clear();
-
-  delete this->body;
-}
-
-AST_Parameter::AST_Parameter(std::string name, int line, int start, int stop)
+AST_Parameter::AST_Parameter(Symbol_Id name, int line, int start, int stop)
     : AST_Node(AST_Node::Type::Parameter, line, start, stop), name(name) {}
 
-AST_Parameter::~AST_Parameter() {
-  if (this->initializer)
-    delete this->initializer.value();
-  delete this->type;
-}
+AST_Parameter::AST_Parameter(AST_Node::Type type, Symbol_Id name, int line,
+                             int start, int stop)
+    : AST_Node(type, line, start, stop), name(name) {}
 
 AST_Lookup::AST_Lookup(AST_Node *left, int line, int start, int stop)
     : AST_Node(AST_Node::Type::Lookup, line, start, stop), left(left) {}
 
-AST_Lookup::~AST_Lookup() {
-  delete this->left;
-  delete this->right;
-}
-
 AST_Block::AST_Block(int line, int start, int stop)
     : AST_Node(AST_Node::Type::Block, line, start, stop) {}
 
-AST_Block::~AST_Block() {
-  for (AST_Node *node : this->nodes)
-    delete node;
-  this->nodes.clear();
-}
-
 void AST_Block::append(AST_Node *node) { this->nodes.push_back(node); }
 
 AST_Array_Literal::AST_Array_Literal(int line, int start, int stop)
     : AST_Node(AST_Node::Type::Array_Literal, line, start, stop) {}
 
-AST_Array_Literal::~AST_Array_Literal() {
-  for (AST_Node *item : this->elems)
-    delete item;
-  this->elems.clear();
-}
-
-AST_Binding::AST_Binding(bool mut, std::string symbol, int line, int start,
+AST_Binding::AST_Binding(bool mut, Symbol_Id symbol, int line, int start,
                          int stop)
     : AST_Node(AST_Node::Type::Binding, line, start, stop), mut(mut),
       symbol(symbol) {}
 
-AST_Binding::~AST_Binding() {
-  if (this->initializer)
-    delete this->initializer.value();
-}
-
 AST_Grouping::AST_Grouping(AST_Node *inner, int line, int start, int stop)
     : AST_Node(AST_Node::Type::Grouping, line, start, stop), inner(inner) {}
 
-AST_Grouping::~AST_Grouping() { delete this->inner; }
-
 AST_If_Stmt::AST_If_Stmt(int line, int start, int stop)
     : AST_Node(AST_Node::Type::If_Stmt, line, start, stop) {}
 
-AST_If_Stmt::~AST_If_Stmt() {
-  delete this->condition;
-  delete this->branch_if;
-  if (this->branch_else)
-    delete this->branch_else.value();
-}
-
 AST_Args::AST_Args(int line, int start, int stop)
-    : AST_Parameter("args", line, start, stop) {}
+    : AST_Parameter(AST_Node::Type::Args, Symbol_Id::intern("args"), line,
+                    start, stop) {}
 
 AST_Kwargs::AST_Kwargs(int line, int start, int stop)
-    : AST_Parameter("kwargs", line, start, stop) {}
+    : AST_Parameter(AST_Node::Type::Kwargs, Symbol_Id::intern("kwargs"), line,
+                    start, stop) {}
 
 AST_Return::AST_Return(int line, int start, int stop)
     : AST_Node(AST_Node::Type::Return, line, start, stop) {
   this->value = std::nullopt;
 }
 
-AST_Return::~AST_Return() {
-  if (this->value)
-    delete this->value.value();
-}
-
-AST_Enum_Decl::AST_Enum_Decl(std::string symbol, int line, int start, int stop)
+AST_Enum_Decl::AST_Enum_Decl(Symbol_Id symbol, int line, int start, int stop)
     : AST_Node(AST_Node::Type::Enum_Decl, line, start, stop), symbol(symbol) {}
 
+AST_Import::AST_Import(Symbol_Id module, int line, int start, int stop)
+    : AST_Node(AST_Node::Type::Import, line, start, stop), module(module) {}
+
 // =================================================================
-// AST NODE PRINT OVERRIDES
+// AST PRINTER
 // =================================================================
 
-void AST_Assignment::print(int indent) const {
-  std::string spaces = std::string(indent, ' ');
+AST_Printer::AST_Printer(int indent) : indent(indent) {}
+
+// Children the parser never filled in (after a syntax error) are skipped
+void AST_Printer::child(AST_Node *node, int offset) {
+  if (node == nullptr)
+    return;
+  this->indent += offset;
+  this->visit(node);
+  this->indent -= offset;
+}
+
+void AST_Printer::visit_assignment(AST_Assignment *node) {
+  std::string spaces = std::string(this->indent, ' ');
   std::cout << spaces << "<Assignment>\n";
-  this->assignee->print(indent + 2);
-  std::cout << spaces << "  <Op> " << this->op << " </Op>\n";
-  this->value->print(indent + 2);
+  this->child(node->assignee, 2);
+  std::cout << spaces << "  <Op> " << node->op << " </Op>\n";
+  this->child(node->value, 2);
   std::cout << spaces << "</Assignment>" << std::endl;
 }
 
-void AST_String::print(int indent) const {
-  std::string spaces = std::string(indent, ' ');
-  std::cout << spaces << "<String> " << this->value << " </String>"
+void AST_Printer::visit_string(AST_String *node) {
+  std::string spaces = std::string(this->indent, ' ');
+  std::cout << spaces << "<String> \"" << node->text << "\" </String>"
             << std::endl;
 }
 
-void AST_Integer::print(int indent) const {
-  std::string spaces = std::string(indent, ' ');
-  if (this->base == 10)
-    std::cout << spaces << "<Integer> " << this->value << " </Integer>"
+void AST_Printer::visit_integer(AST_Integer *node) {
+  std::string spaces = std::string(this->indent, ' ');
+  if (node->base == 10)
+    std::cout << spaces << "<Integer> " << node->value << " </Integer>"
               << std::endl;
-  else if (this->base == 8)
-    std::cout << spaces << "<Octal> " << this->value << " </Octal>"
+  else if (node->base == 8)
+    std::cout << spaces << "<Octal> " << node->value << " </Octal>"
               << std::endl;
-  else if (this->base == 2)
-    std::cout << spaces << "<Binary> " << this->value << " </Binary>"
+  else if (node->base == 2)
+    std::cout << spaces << "<Binary> " << node->value << " </Binary>"
               << std::endl;
-  else if (this->base == 16)
-    std::cout << spaces << "<Hex> " << this->value << " </Hex>" << std::endl;
+  else if (node->base == 16)
+    std::cout << spaces << "<Hex> " << node->value << " </Hex>" << std::endl;
 }
 
-void AST_Float::print(int indent) const {
-  std::string spaces = std::string(indent, ' ');
-  std::cout << spaces << "<Float> " << this->value << " </Float>" << std::endl;
+void AST_Printer::visit_float(AST_Float *node) {
+  std::string spaces = std::string(this->indent, ' ');
+  std::cout << spaces << "<Float> " << node->value << " </Float>" << std::endl;
 }
 
-void AST_Symbol::print(int indent) const {
-  std::string spaces = std::string(indent, ' ');
-  std::cout << spaces << "<Symbol> " << this->name << " </Symbol>" << std::endl;
+void AST_Printer::visit_symbol(AST_Symbol *node) {
+  std::string spaces = std::string(this->indent, ' ');
+  std::cout << spaces << "<Symbol> " << node->name << " </Symbol>" << std::endl;
 }
 
-void AST_Binary::print(int indent) const {
-  std::string spaces = std::string(indent, ' ');
+void AST_Printer::visit_binary(AST_Binary *node) {
+  std::string spaces = std::string(this->indent, ' ');
   std::cout << spaces << "<Binary>\n";
-  this->left->print(indent + 2);
-  std::cout << spaces << "  <Op> " << this->op << " </Op>\n";
-  this->right->print(indent + 2);
+  this->child(node->left, 2);
+  std::cout << spaces << "  <Op> " << node->op << " </Op>\n";
+  this->child(node->right, 2);
   std::cout << spaces << "</Binary>" << std::endl;
 }
 
-void AST_Logical::print(int indent) const {
-  std::string spaces = std::string(indent, ' ');
+void AST_Printer::visit_logical(AST_Logical *node) {
+  std::string spaces = std::string(this->indent, ' ');
   std::cout << spaces << "<Logical>\n";
-  this->left->print(indent + 2);
-  std::cout << spaces << "  <Op> " << this->op << " </Op>\n";
-  this->right->print(indent + 2);
+  this->child(node->left, 2);
+  std::cout << spaces << "  <Op> " << node->op << " </Op>\n";
+  this->child(node->right, 2);
   std::cout << spaces << "</Logical>" << std::endl;
 }
 
-void AST_Lookup::print(int indent) const {
-  std::string spaces = std::string(indent, ' ');
+void AST_Printer::visit_lookup(AST_Lookup *node) {
+  std::string spaces = std::string(this->indent, ' ');
   std::cout << spaces << "<Lookup>\n";
-  this->left->print(indent + 2);
-  this->right->print(indent + 2);
+  this->child(node->left, 2);
+  this->child(node->right, 2);
   std::cout << spaces << "</Lookup>" << std::endl;
 }
 
-void AST_Unary::print(int indent) const {
-  std::string spaces = std::string(indent, ' ');
+void AST_Printer::visit_unary(AST_Unary *node) {
+  std::string spaces = std::string(this->indent, ' ');
   std::cout << spaces << "<Unary>\n";
-  this->operand->print(indent + 2);
-  std::cout << spaces << "  <Op> " << this->op << " </Op>\n";
+  this->child(node->operand, 2);
+  std::cout << spaces << "  <Op> " << node->op << " </Op>\n";
   std::cout << spaces << "</Unary>" << std::endl;
 }
 
-void AST_Call::print(int indent) const {
-  std::string spaces = std::string(indent, ' ');
+void AST_Printer::visit_call(AST_Call *node) {
+  std::string spaces = std::string(this->indent, ' ');
   std::cout << spaces << "<Call>\n";
-  this->callee->print(indent + 2);
+  this->child(node->callee, 2);
 
   std::cout << spaces << "  <Args>\n";
-  for (AST_Node *a : this->args) {
-    a->print(indent + 4);
+  for (AST_Node *a : node->args) {
+    this->child(a, 4);
   }
   std::cout << spaces << "  </Args>\n";
 
   std::cout << spaces << "</Call>" << std::endl;
 }
 
-void AST_Function::print(int indent) const {
-  std::string spaces = std::string(indent, ' ');
+void AST_Printer::visit_function(AST_Function *node) {
+  std::string spaces = std::string(this->indent, ' ');
   std::cout << spaces << "<Function>\n";
 
   std::cout << spaces << "  <Params>\n";
-  for (AST_Node *p : this->params) {
-    p->print(indent + 4);
+  for (AST_Node *p : node->params) {
+    this->child(p, 4);
   }
   std::cout << spaces << "  </Params>\n";
 
-  if (this->return_type) {
+  if (node->return_type) {
     std::cout << spaces << "  <Return Type>\n";
-    this->return_type.value()->print(indent + 4);
+    this->child(node->return_type.value(), 4);
     std::cout << spaces << "  </Return Type>\n";
   }
 
   std::cout << spaces << "  <Body>\n";
-  this->body->print(indent + 4);
+  this->child(node->body, 4);
   std::cout << spaces << "  </Body>" << std::endl;
 }
 
-void AST_Grouping::print(int indent) const {
-  std::string spaces = std::string(indent, ' ');
+void AST_Printer::visit_grouping(AST_Grouping *node) {
+  std::string spaces = std::string(this->indent, ' ');
   std::cout << spaces << "<Grouping>\n";
-  this->inner->print(indent + 2);
+  this->child(node->inner, 2);
   std::cout << spaces << "</Grouping>" << std::endl;
 }
 
-void AST_Parameter::print(int indent) const {
-  std::string spaces = std::string(indent, ' ');
+void AST_Printer::visit_parameter(AST_Parameter *node) {
+  std::string spaces = std::string(this->indent, ' ');
   std::cout << spaces << "<Parameter>\n";
-  std::cout << spaces << "  <Name> " << this->name << " </Name>\n";
-  this->type->print(indent + 2);
+  std::cout << spaces << "  <Name> " << node->name << " </Name>\n";
+  this->child(node->type, 2);
 
-  if (this->initializer) {
+  if (node->initializer) {
     std::cout << spaces << "  <Initializer>\n";
-    this->initializer.value()->print(indent + 4);
+    this->child(node->initializer.value(), 4);
     std::cout << spaces << "  </Initializer>";
   }
 
   std::cout << spaces << "</Parameter>" << std::endl;
 }
 
-void AST_Block::print(int indent) const {
-  std::string spaces = std::string(indent, ' ');
+void AST_Printer::visit_block(AST_Block *node) {
+  std::string spaces = std::string(this->indent, ' ');
   std::cout << spaces << "<Block>\n";
 
-  for (AST_Node *n : this->nodes)
-    n->print(indent + 2);
+  for (AST_Node *n : node->nodes)
+    this->child(n, 2);
 
   std::cout << spaces << "</Block>" << std::endl;
 }
 
-void AST_Array_Literal::print(int indent) const {
-  std::string spaces = std::string(indent, ' ');
+void AST_Printer::visit_array_literal(AST_Array_Literal *node) {
+  std::string spaces = std::string(this->indent, ' ');
   std::cout << spaces << "<Array>\n";
 
-  for (AST_Node *i : this->elems)
-    i->print(indent + 2);
+  for (AST_Node *i : node->elems)
+    this->child(i, 2);
 
   std::cout << spaces << "</Array>" << std::endl;
 }
 
-template <size_t n_cols, size_t n_rows>
-void AST_Matrix_Literal<n_cols, n_rows>::print(int indent) const {
-  std::string spaces = std::string(indent, ' ');
-  std::cout << spaces << "<Matrix>\n";
-
-  for (AST_Matrix_Literal::Row row : this->rows) {
-    std::cout << spaces << "  <Row>\n";
-    for (AST_Node *n : row)
-      n->print(indent + 4);
-    std::cout << spaces << "  </Row>\n";
-  }
-
-  std::cout << spaces << "</Matrix>" << std::endl;
-}
-
-void AST_Binding::print(int indent) const {
-  std::string spaces = std::string(indent, ' ');
+void AST_Printer::visit_binding(AST_Binding *node) {
+  std::string spaces = std::string(this->indent, ' ');
 
   std::cout << spaces << "<Binding>\n";
-  std::cout << spaces << "  <Name> " << this->symbol << " </Name>\n";
-  std::cout << spaces << "  <Mutable?> " << this->mut << " </Mutable?>\n";
-  if (this->initializer) {
+  std::cout << spaces << "  <Name> " << node->symbol << " </Name>\n";
+  std::cout << spaces << "  <Mutable?> " << node->mut << " </Mutable?>\n";
+  if (node->initializer) {
     std::cout << spaces << "  <Initializer>\n";
-    this->initializer.value()->print(indent + 4);
+    this->child(node->initializer.value(), 4);
     std::cout << spaces << "  </Initializer>\n";
   }
   std::cout << spaces << "</Binding>" << std::endl;
 }
 
-void AST_If_Stmt::print(int indent) const {
-  std::string spaces = std::string(indent, ' ');
+void AST_Printer::visit_if_stmt(AST_If_Stmt *node) {
+  std::string spaces = std::string(this->indent, ' ');
   std::cout << spaces << "<If>\n";
   std::cout << spaces << "  <Condition>\n";
-  this->condition->print(indent + 4);
+  this->child(node->condition, 4);
   std::cout << spaces << "  </Condition>\n";
 
   std::cout << spaces << "  <True Branch>\n";
-  this->branch_if->print(indent + 4);
+  this->child(node->branch_if, 4);
   std::cout << spaces << "  </True Branch>\n";
 
-  if (this->branch_else) {
+  if (node->branch_else) {
     std::cout << spaces << "  <Else Branch>\n";
-    this->branch_else.value()->print(indent + 4);
+    this->child(node->branch_else.value(), 4);
     std::cout << spaces << "  </Else Branch>\n";
   }
   std::cout << spaces << "</If>\n";
 }
 
-void AST_Args::print(int indent) const {
-  std::string spaces = std::string(indent, ' ');
+void AST_Printer::visit_args(AST_Args *) {
+  std::string spaces = std::string(this->indent, ' ');
   std::cout << spaces << "<*Args/>" << std::endl;
 }
 
-void AST_Kwargs::print(int indent) const {
-  std::string spaces = std::string(indent, ' ');
+void AST_Printer::visit_kwargs(AST_Kwargs *) {
+  std::string spaces = std::string(this->indent, ' ');
   std::cout << spaces << "<**Kwargs/>" << std::endl;
 }
 
-void AST_Return::print(int indent) const {
-  std::string spaces = std::string(indent, ' ');
+void AST_Printer::visit_return(AST_Return *node) {
+  std::string spaces = std::string(this->indent, ' ');
   std::cout << spaces << "<Return>\n";
-  if (this->value)
-    this->value.value()->print(indent + 2);
+  if (node->value)
+    this->child(node->value.value(), 2);
   std::cout << spaces << "</Return>" << std::endl;
 }
 
-void AST_Enum_Decl::print(int indent) const {
-  std::string spaces = std::string(indent, ' ');
+void AST_Printer::visit_enum_decl(AST_Enum_Decl *node) {
+  std::string spaces = std::string(this->indent, ' ');
   std::cout << spaces << "<Enum>\n";
 
-  for (std::string s : this->variants)
+  for (Symbol_Id s : node->variants)
     std::cout << spaces << "  <Variant> " << s << "</Variant>";
   std::cout << spaces << "</Enum>" << std::endl;
 }
 
+void AST_Printer::visit_import(AST_Import *node) {
+  std::string spaces = std::string(this->indent, ' ');
+  std::cout << spaces << "<Import>\n";
+  std::cout << spaces << "  <Module> " << node->module << " </Module>\n";
+  if (node->alias)
+    std::cout << spaces << "  <As> " << node->alias.value() << " </As>\n";
+  for (Symbol_Id item : node->items)
+    std::cout << spaces << "  <Item> " << item << " </Item>\n";
+  std::cout << spaces << "</Import>" << std::endl;
+}
+
 // =================================================================
 // PARSE TREE
 // =================================================================
 
 Parse_Tree::Parse_Tree() {}
 
-Parse_Tree::~Parse_Tree() {
-  for (AST_Node *n : this->nodes)
-    delete n;
-}
-
 void Parse_Tree::allocate(AST_Node *node) { this->nodes.push_back(node); }
 
 void Parse_Tree::print() {
+  AST_Printer printer = AST_Printer(0);
   for (AST_Node *node : this->nodes)
-    node->print(0);
+    printer.child(node, 0);
 }
 
-std::vector<AST_Node *> &Parse_Tree::unpack() { return this->nodes; }
\ No newline at end of file
+void Parse_Tree::print_stats() const { this->arena.print_stats(); }
+
+std::vector<AST_Node *> &Parse_Tree::unpack() { return this->nodes; }
+
+// =================================================================
+// AST ARENA
+// =================================================================
+
+AST_Arena::AST_Arena(AST_Arena &&other)
+    : chunks(std::move(other.chunks)), cursor(other.cursor),
+      limit(other.limit), cleanups(std::move(other.cleanups)),
+      bytes(other.bytes) {
+  std::copy(std::begin(other.counts), std::end(other.counts), this->counts);
+  other.chunks.clear();
+  other.cleanups.clear();
+  other.cursor = other.limit = nullptr;
+  other.bytes = 0;
+  std::fill(std::begin(other.counts), std::end(other.counts), 0);
+}
+
+AST_Arena::~AST_Arena() {
+  for (auto it = this->cleanups.rbegin(); it != this->cleanups.rend(); it++)
+    it->destroy(it->node);
+  for (char *chunk : this->chunks)
+    ::operator delete(chunk);
+}
+
+void *AST_Arena::allocate(size_t size, size_t align) {
+  uintptr_t at = reinterpret_cast<uintptr_t>(this->cursor);
+  uintptr_t aligned = (at + align - 1) & ~(uintptr_t)(align - 1);
+
+  if (this->cursor == nullptr ||
+      aligned + size > reinterpret_cast<uintptr_t>(this->limit)) {
+    // Oversized requests get a chunk of their own
+    size_t chunk_size = size + align > CHUNK_SIZE ? size + align : CHUNK_SIZE;
+    char *chunk = static_cast<char *>(::operator new(chunk_size));
+    this->chunks.push_back(chunk);
+    this->cursor = chunk;
+    this->limit = chunk + chunk_size;
+
+    at = reinterpret_cast<uintptr_t>(this->cursor);
+    aligned = (at + align - 1) & ~(uintptr_t)(align - 1);
+  }
+
+  this->cursor = reinterpret_cast<char *>(aligned + size);
+  this->bytes += size;
+  return reinterpret_cast<void *>(aligned);
+}
+
+size_t AST_Arena::bytes_allocated() const { return this->bytes; }
+
+size_t AST_Arena::node_count(AST_Node::Type type) const {
+  return this->counts[static_cast<size_t>(type)];
+}
+
+void AST_Arena::print_stats() const {
+  size_t total = 0;
+  for (size_t n : this->counts)
+    total += n;
+
+  std::cout << "[arena] " << total << " nodes, " << this->bytes
+            << " bytes in " << this->chunks.size() << " chunk(s), "
+            << this->cleanups.size() << " cleanup(s)" << std::endl;
+  for (size_t i = 0; i < N_NODE_TYPES; i++) {
+    if (this->counts[i] != 0)
+      std::cout << "[arena]   " << static_cast<AST_Node::Type>(i) << ": "
+                << this->counts[i] << std::endl;
+  }
+}
@@ -1,11 +1,16 @@
 #ifndef AST_H
 #define AST_H
 
+#include "symbol.hpp"
 #include "token.hpp"
 #include <array>
+#include <cstdint>
 #include <iostream>
+#include <map>
 #include <optional>
 #include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 enum AST_Op {
@@ -41,12 +46,56 @@ enum AST_Op {
   INITIALIZER,
 };
 
+// Every token that stands for an operator, and the operator it stands for
+constexpr std::pair<Token::Type, AST_Op> operator_list[] = {
+    {Token::Type::STAR_STAR, AST_Op::EXPONENT},
+    {Token::Type::STAR, AST_Op::MULTIPLY},
+    {Token::Type::SLASH, AST_Op::DIVIDE},
+    {Token::Type::MODULO, AST_Op::MODULUS},
+    {Token::Type::PLUS, AST_Op::ADD},
+    {Token::Type::MINUS, AST_Op::SUBTRACT},
+    {Token::Type::ARROW, AST_Op::ASSIGN},
+    {Token::Type::STAR_EQUAL, AST_Op::ASSIGN_MULTIPLY},
+    {Token::Type::SLASH_EQUAL, AST_Op::ASSIGN_DIVIDE},
+    {Token::Type::PLUS_EQUAL, AST_Op::ASSIGN_INCREMENT},
+    {Token::Type::MINUS_EQUAL, AST_Op::ASSIGN_DECREMENT},
+    {Token::Type::PLUS_PLUS, AST_Op::INCREMENT},
+    {Token::Type::MINUS_MINUS, AST_Op::DECREMENT},
+    {Token::Type::BAR_BAR, AST_Op::LOGICAL_OR},
+    {Token::Type::AMP_AMP, AST_Op::LOGICAL_AND},
+    {Token::Type::BAR, AST_Op::BITWISE_OR},
+    {Token::Type::AMP, AST_Op::BITWISE_AND},
+    {Token::Type::EQUAL_EQUAL, AST_Op::COMP_EQUAL},
+    {Token::Type::BANG_EQUAL, AST_Op::COMP_NOT_EQUAL},
+    {Token::Type::LESS, AST_Op::COMP_LESS},
+    {Token::Type::LESS_EQUAL, AST_Op::COMP_LESS_EQUAL},
+    {Token::Type::MORE, AST_Op::COMP_MORE},
+    {Token::Type::MORE_EQUAL, AST_Op::COMP_MORE_EQUAL},
+    {Token::Type::IS, AST_Op::COMP_IS},
+    {Token::Type::NOT, AST_Op::COMP_NOT},
+};
+
+struct Token_Operator {
+  bool valid = false;
+  AST_Op op = AST_Op::EXPONENT;
+};
+
+constexpr std::array<Token_Operator, N_TOKEN_TYPES> make_operator_table() {
+  std::array<Token_Operator, N_TOKEN_TYPES> table{};
+  for (const auto &entry : operator_list)
+    table[entry.first] = Token_Operator{true, entry.second};
+  return table;
+}
+
+// `operator_list` flattened into an array indexed by `Token::Type`
+inline constexpr std::array<Token_Operator, N_TOKEN_TYPES> operators =
+    make_operator_table();
+
 // Utility functions for AST_Op
-extern std::map<Token::Type, AST_Op> operators;
 std::ostream &operator<<(std::ostream &os, const AST_Op &ast_op);
 
 struct AST_Node {
-  enum Type {
+  enum Type : uint8_t {
     Assignment,
     String,
     Integer,
@@ -69,6 +118,7 @@ struct AST_Node {
     Kwargs,
     Return,
     Enum_Decl,
+    Import,
   };
 
   int line;
@@ -77,216 +127,255 @@ struct AST_Node {
   AST_Node::Type type;
 
   AST_Node(AST_Node::Type type, int line, int start, int stop);
-  virtual ~AST_Node() = default;
-  virtual void print(int indent) const = 0;
+
+protected:
+  // Nodes live in an `AST_Arena` and are never deleted through a base pointer.
+  // Keeping this non-virtual lets nodes without strings or vectors be
+  // trivially destructible, so the arena can drop them without a cleanup
+  ~AST_Node() = default;
 };
 
+std::ostream &operator<<(std::ostream &os, const AST_Node::Type &type);
+
 // Represents the assignment of one thing to a new value
 // `ID | PATH` `->` `EXPR`
 struct AST_Assignment : public AST_Node {
-  AST_Node *assignee;
+  static constexpr AST_Node::Type TYPE = AST_Node::Type::Assignment;
+
+  AST_Node *assignee = nullptr;
   AST_Op op;
-  AST_Node *value;
+  AST_Node *value = nullptr;
 
   AST_Assignment(AST_Op op, int line, int start, int stop);
-  ~AST_Assignment();
-  void print(int indent) const override;
 };
 
 // Represents a basic string literal
 // `STRING LITERAL`
+//
+// `text` is the body between the quotes, pointing into the source, so the
+// source has to outlive the tree. Escapes are left as written until the value
+// is needed, and most literals don't have any
 struct AST_String : public AST_Node {
-  std::string value;
+  static constexpr AST_Node::Type TYPE = AST_Node::Type::String;
+
+  std::string_view text;
+  bool escaped; // `text` has at least one '\\' in it
+
+  AST_String(std::string_view text, bool escaped, int line, int start,
+             int stop);
 
-  AST_String(std::string value, int line, int start, int stop);
-  void print(int indent) const override;
+  // The string the literal stands for
+  std::string value() const;
 };
 
 // Represents an integer literal
 // `NUMBER LITERAL` where `lexeme` contains no dot chars
 struct AST_Integer : public AST_Node {
+  static constexpr AST_Node::Type TYPE = AST_Node::Type::Integer;
+
   long long int value;
   int base;
   AST_Integer(long long int value, int base, int line, int start, int stop);
-  void print(int indent) const override;
 };
 
 struct AST_Float : public AST_Node {
+  static constexpr AST_Node::Type TYPE = AST_Node::Type::Float;
+
   double value;
   AST_Float(double value, int line, int start, int stop);
-  void print(int indent) const override;
 };
 
 // Represents any symbol literal
 // `SYMBOL LITERAL`
 struct AST_Symbol : public AST_Node {
-  std::string name;
-  AST_Symbol(std::string name, int line, int start, int stop);
-  void print(int indent) const override;
+  static constexpr AST_Node::Type TYPE = AST_Node::Type::Symbol;
+
+  Symbol_Id name;
+  AST_Symbol(Symbol_Id name, int line, int start, int stop);
 };
 
 // Represents a binary expression with an infix operator
 // `EXPR` `+ | - | * | / | ** | %` `EXPR`
 struct AST_Binary : public AST_Node {
-  AST_Node *left;
-  AST_Node *right;
+  static constexpr AST_Node::Type TYPE = AST_Node::Type::Binary;
+
+  AST_Node *left = nullptr;
+  AST_Node *right = nullptr;
   AST_Op op;
 
   // AST_Binary should have members `left` and `right` assigned after creation
   // Thusly, `left` and `right` are both `nullptr`
   AST_Binary(AST_Op op, int line, int start, int stop);
-  ~AST_Binary();
-  void print(int indent) const override;
 };
 
 // Represents a logical expression with an infix logical operator
 // `EXPR` `|| | && | IS | IS NOT` `EXPR`
 struct AST_Logical : public AST_Node {
-  AST_Node *left;
-  AST_Node *right;
+  static constexpr AST_Node::Type TYPE = AST_Node::Type::Logical;
+
+  AST_Node *left = nullptr;
+  AST_Node *right = nullptr;
   AST_Op op;
 
   // AST_Logical should have members `left` and `right` assigned after creation
   // Thusly, `left` and `right` are both `nullptr`
   AST_Logical(AST_Op op, int line, int start, int stop);
-  ~AST_Logical();
-  void print(int indent) const override;
 };
 
 struct AST_Unary : public AST_Node {
-  AST_Node *operand;
+  static constexpr AST_Node::Type TYPE = AST_Node::Type::Unary;
+
+  AST_Node *operand = nullptr;
   AST_Op op;
 
   AST_Unary(AST_Op op, int line, int start, int stop);
-  ~AST_Unary();
-  void print(int indent) const override;
 };
 
 struct AST_Call : public AST_Node {
+  static constexpr AST_Node::Type TYPE = AST_Node::Type::Call;
+
   AST_Node *callee;
   std::vector<AST_Node *> args;
 
   // `args` is an empty vector upon creation
   AST_Call(AST_Node *callee, int line, int start, int stop);
-  ~AST_Call();
-  void print(int indent) const override;
 };
 
 struct AST_Parameter : public AST_Node {
-  std::string name;
-  AST_Node *type;
+  static constexpr AST_Node::Type TYPE = AST_Node::Type::Parameter;
+
+  Symbol_Id name;
+  AST_Node *type = nullptr;
   std::optional<AST_Node *> initializer;
 
-  AST_Parameter(std::string name, int line, int start, int stop);
-  ~AST_Parameter();
-  void print(int indent) const override;
+  AST_Parameter(Symbol_Id name, int line, int start, int stop);
+
+protected:
+  // Lets `AST_Args` and `AST_Kwargs` keep their own node type
+  AST_Parameter(AST_Node::Type type, Symbol_Id name, int line, int start,
+                int stop);
 };
 
 // Represents a function declaration
 struct AST_Function : public AST_Node {
+  static constexpr AST_Node::Type TYPE = AST_Node::Type::Function;
+
   std::vector<AST_Parameter *> params;
   std::optional<AST_Node *> return_type;
-  AST_Node *body;
+  AST_Node *body = nullptr;
 
   // Members `params`, `body`, and `return_type` are `nullptr` or empty upon
   // creation
   AST_Function(int line, int start, int stop);
-  ~AST_Function();
-  void print(int indent) const override;
 };
 
 // Represents any basic type of grouping expression
 // `LPAR` `EXPR` `RPAR`
 struct AST_Grouping : public AST_Node {
+  static constexpr AST_Node::Type TYPE = AST_Node::Type::Grouping;
+
   AST_Node *inner;
 
   AST_Grouping(AST_Node *inner, int line, int start, int stop);
-  ~AST_Grouping();
-  void print(int indent) const override;
 };
 
 struct AST_Lookup : public AST_Node {
+  static constexpr AST_Node::Type TYPE = AST_Node::Type::Lookup;
+
   AST_Node *left;
-  AST_Node *right;
+  AST_Node *right = nullptr;
 
   AST_Lookup(AST_Node *left, int line, int start, int stop);
-  ~AST_Lookup();
-  void print(int indent) const override;
 };
 
 struct AST_Block : public AST_Node {
+  static constexpr AST_Node::Type TYPE = AST_Node::Type::Block;
+
   std::vector<AST_Node *> nodes;
 
   AST_Block(int line, int start, int stop);
-  ~AST_Block();
   void append(AST_Node *node);
-  void print(int indent) const override;
 };
 
 struct AST_Array_Literal : public AST_Node {
+  static constexpr AST_Node::Type TYPE = AST_Node::Type::Array_Literal;
+
   std::vector<AST_Node *> elems;
 
   AST_Array_Literal(int line, int start, int stop);
-  ~AST_Array_Literal();
   // void freeze(std::vector<AST_Node *> vec);
-  void print(int indent) const override;
 };
 
 template <size_t n_cols, size_t n_rows>
 struct AST_Matrix_Literal : public AST_Node {
+  static constexpr AST_Node::Type TYPE = AST_Node::Type::Matrix_Literal;
+
   typedef std::array<AST_Node *, n_rows> Row;
 
   std::array<Row, n_cols> rows;
 
   AST_Matrix_Literal(int line, int start, int stop);
-  ~AST_Matrix_Literal();
-  void print(int indent) const override;
 };
 
 struct AST_Binding : public AST_Node {
+  static constexpr AST_Node::Type TYPE = AST_Node::Type::Binding;
+
   bool mut;
-  std::string symbol;
+  Symbol_Id symbol;
   std::optional<AST_Node *> initializer;
 
-  AST_Binding(bool mut, std::string symbol, int line, int start, int stop);
-  ~AST_Binding();
-  void print(int indent) const override;
+  AST_Binding(bool mut, Symbol_Id symbol, int line, int start, int stop);
 };
 
 struct AST_If_Stmt : public AST_Node {
-  AST_Node *condition;
-  AST_Node *branch_if;
+  static constexpr AST_Node::Type TYPE = AST_Node::Type::If_Stmt;
+
+  AST_Node *condition = nullptr;
+  AST_Node *branch_if = nullptr;
   std::optional<AST_Node *> branch_else;
 
   AST_If_Stmt(int line, int start, int stop);
-  ~AST_If_Stmt();
-  void print(int indent) const override;
 };
 
 struct AST_Args : public AST_Parameter {
+  static constexpr AST_Node::Type TYPE = AST_Node::Type::Args;
+
   AST_Args(int line, int start, int stop);
-  void print(int indent) const override;
 };
 
 struct AST_Kwargs : public AST_Parameter {
+  static constexpr AST_Node::Type TYPE = AST_Node::Type::Kwargs;
+
   AST_Kwargs(int line, int start, int stop);
-  void print(int indent) const override;
 };
 
 struct AST_Return : public AST_Node {
+  static constexpr AST_Node::Type TYPE = AST_Node::Type::Return;
+
   std::optional<AST_Node *> value;
 
   AST_Return(int line, int start, int stop);
-  ~AST_Return();
-  void print(int indent) const override;
 };
 
 struct AST_Enum_Decl : public AST_Node {
-  std::string symbol;
-  std::vector<std::string> variants;
+  static constexpr AST_Node::Type TYPE = AST_Node::Type::Enum_Decl;
+
+  Symbol_Id symbol;
+  std::vector<Symbol_Id> variants;
 
-  AST_Enum_Decl(std::string symbol, int line, int start, int stop);
-  void print(int indent) const override;
+  AST_Enum_Decl(Symbol_Id symbol, int line, int start, int stop);
+};
+
+// `import module [as alias]`, or `from module import a, b` with the names in
+// `items`. `from module import *` has the one item "*"
+struct AST_Import : public AST_Node {
+  static constexpr AST_Node::Type TYPE = AST_Node::Type::Import;
+
+  Symbol_Id module;
+  std::optional<Symbol_Id> alias;
+  std::vector<Symbol_Id> items;
+
+  AST_Import(Symbol_Id module, int line, int start, int stop);
 };
 
 // struct AST_While_Loop : public AST_Node {
@@ -298,17 +387,212 @@ struct AST_Enum_Decl : public AST_Node {
 //   void print() const override;
 // };
 
+// Checked downcast on the node's type tag, `nullptr` if `node` is `nullptr` or
+// some other kind of node. Matches the exact type only, so an `AST_Args` is not
+// an `AST_Parameter` here
+template <typename T> T *node_cast(AST_Node *node) {
+  if (node == nullptr || node->type != T::TYPE)
+    return nullptr;
+  return static_cast<T *>(node);
+}
+
+// Static visitor over the AST. `Derived` defines `visit_*` for the node types
+// it cares about and everything else falls through to `visit_node`. Dispatch
+// is a switch over `AST_Node::type` and a `static_cast`, so there are no
+// virtual calls and no RTTI
+//
+//   struct Counter : public AST_Visitor<Counter> {
+//     int n = 0;
+//     void visit_binary(AST_Binary *node) { this->n++; }
+//   };
+template <typename Derived, typename R = void> class AST_Visitor {
+public:
+  R visit(AST_Node *node) {
+    Derived *self = static_cast<Derived *>(this);
+    switch (node->type) {
+    case AST_Node::Type::Assignment:
+      return self->visit_assignment(static_cast<AST_Assignment *>(node));
+    case AST_Node::Type::String:
+      return self->visit_string(static_cast<AST_String *>(node));
+    case AST_Node::Type::Integer:
+      return self->visit_integer(static_cast<AST_Integer *>(node));
+    case AST_Node::Type::Float:
+      return self->visit_float(static_cast<AST_Float *>(node));
+    case AST_Node::Type::Symbol:
+      return self->visit_symbol(static_cast<AST_Symbol *>(node));
+    case AST_Node::Type::Binary:
+      return self->visit_binary(static_cast<AST_Binary *>(node));
+    case AST_Node::Type::Logical:
+      return self->visit_logical(static_cast<AST_Logical *>(node));
+    case AST_Node::Type::Unary:
+      return self->visit_unary(static_cast<AST_Unary *>(node));
+    case AST_Node::Type::Call:
+      return self->visit_call(static_cast<AST_Call *>(node));
+    case AST_Node::Type::Parameter:
+      return self->visit_parameter(static_cast<AST_Parameter *>(node));
+    case AST_Node::Type::Function:
+      return self->visit_function(static_cast<AST_Function *>(node));
+    case AST_Node::Type::Grouping:
+      return self->visit_grouping(static_cast<AST_Grouping *>(node));
+    case AST_Node::Type::Lookup:
+      return self->visit_lookup(static_cast<AST_Lookup *>(node));
+    case AST_Node::Type::Block:
+      return self->visit_block(static_cast<AST_Block *>(node));
+    case AST_Node::Type::Array_Literal:
+      return self->visit_array_literal(static_cast<AST_Array_Literal *>(node));
+    case AST_Node::Type::Binding:
+      return self->visit_binding(static_cast<AST_Binding *>(node));
+    case AST_Node::Type::If_Stmt:
+      return self->visit_if_stmt(static_cast<AST_If_Stmt *>(node));
+    case AST_Node::Type::Args:
+      return self->visit_args(static_cast<AST_Args *>(node));
+    case AST_Node::Type::Kwargs:
+      return self->visit_kwargs(static_cast<AST_Kwargs *>(node));
+    case AST_Node::Type::Return:
+      return self->visit_return(static_cast<AST_Return *>(node));
+    case AST_Node::Type::Enum_Decl:
+      return self->visit_enum_decl(static_cast<AST_Enum_Decl *>(node));
+    case AST_Node::Type::Import:
+      return self->visit_import(static_cast<AST_Import *>(node));
+    case AST_Node::Type::Matrix_Literal:
+      break;
+    }
+    return self->visit_node(node);
+  }
+
+  R visit_node(AST_Node *) { return R(); }
+
+  R visit_assignment(AST_Assignment *node) { return this->fallback(node); }
+  R visit_string(AST_String *node) { return this->fallback(node); }
+  R visit_integer(AST_Integer *node) { return this->fallback(node); }
+  R visit_float(AST_Float *node) { return this->fallback(node); }
+  R visit_symbol(AST_Symbol *node) { return this->fallback(node); }
+  R visit_binary(AST_Binary *node) { return this->fallback(node); }
+  R visit_logical(AST_Logical *node) { return this->fallback(node); }
+  R visit_unary(AST_Unary *node) { return this->fallback(node); }
+  R visit_call(AST_Call *node) { return this->fallback(node); }
+  R visit_parameter(AST_Parameter *node) { return this->fallback(node); }
+  R visit_function(AST_Function *node) { return this->fallback(node); }
+  R visit_grouping(AST_Grouping *node) { return this->fallback(node); }
+  R visit_lookup(AST_Lookup *node) { return this->fallback(node); }
+  R visit_block(AST_Block *node) { return this->fallback(node); }
+  R visit_array_literal(AST_Array_Literal *node) {
+    return this->fallback(node);
+  }
+  R visit_binding(AST_Binding *node) { return this->fallback(node); }
+  R visit_if_stmt(AST_If_Stmt *node) { return this->fallback(node); }
+  R visit_args(AST_Args *node) { return this->fallback(node); }
+  R visit_kwargs(AST_Kwargs *node) { return this->fallback(node); }
+  R visit_return(AST_Return *node) { return this->fallback(node); }
+  R visit_enum_decl(AST_Enum_Decl *node) { return this->fallback(node); }
+  R visit_import(AST_Import *node) { return this->fallback(node); }
+
+private:
+  R fallback(AST_Node *node) {
+    return static_cast<Derived *>(this)->visit_node(node);
+  }
+};
+
+// Prints the tree as indented pseudo-XML
+class AST_Printer : public AST_Visitor<AST_Printer> {
+  int indent;
+
+public:
+  AST_Printer(int indent);
+
+  // Prints `node` indented `offset` more than the current node
+  void child(AST_Node *node, int offset);
+
+  void visit_assignment(AST_Assignment *node);
+  void visit_string(AST_String *node);
+  void visit_integer(AST_Integer *node);
+  void visit_float(AST_Float *node);
+  void visit_symbol(AST_Symbol *node);
+  void visit_binary(AST_Binary *node);
+  void visit_logical(AST_Logical *node);
+  void visit_unary(AST_Unary *node);
+  void visit_call(AST_Call *node);
+  void visit_parameter(AST_Parameter *node);
+  void visit_function(AST_Function *node);
+  void visit_grouping(AST_Grouping *node);
+  void visit_lookup(AST_Lookup *node);
+  void visit_block(AST_Block *node);
+  void visit_array_literal(AST_Array_Literal *node);
+  void visit_binding(AST_Binding *node);
+  void visit_if_stmt(AST_If_Stmt *node);
+  void visit_args(AST_Args *node);
+  void visit_kwargs(AST_Kwargs *node);
+  void visit_return(AST_Return *node);
+  void visit_enum_decl(AST_Enum_Decl *node);
+  void visit_import(AST_Import *node);
+};
+
+// Bump-pointer allocator for AST nodes. Nodes are carved out of large chunks
+// and are never freed one at a time; dropping the arena releases the whole
+// tree at once. Only node types that own a string or vector register a
+// cleanup so their destructors still run
+class AST_Arena {
+  static constexpr size_t CHUNK_SIZE = 64 * 1024;
+  static constexpr size_t N_NODE_TYPES =
+      static_cast<size_t>(AST_Node::Type::Import) + 1;
+
+  struct Cleanup {
+    void *node;
+    void (*destroy)(void *node);
+  };
+
+  std::vector<char *> chunks;
+  char *cursor = nullptr;
+  char *limit = nullptr;
+  std::vector<Cleanup> cleanups;
+
+  size_t bytes = 0;
+  size_t counts[N_NODE_TYPES] = {};
+
+public:
+  AST_Arena() = default;
+  AST_Arena(AST_Arena &&other);
+  AST_Arena(const AST_Arena &) = delete;
+  AST_Arena &operator=(const AST_Arena &) = delete;
+  ~AST_Arena();
+
+  template <typename T, typename... Args> T *make(Args &&...args) {
+    void *memory = this->allocate(sizeof(T), alignof(T));
+    T *node = new (memory) T(std::forward<Args>(args)...);
+    if constexpr (!std::is_trivially_destructible_v<T>)
+      this->cleanups.push_back(
+          Cleanup{node, [](void *n) { static_cast<T *>(n)->~T(); }});
+    this->counts[static_cast<size_t>(node->AST_Node::type)]++;
+    return node;
+  }
+
+  void *allocate(size_t size, size_t align);
+
+  size_t bytes_allocated() const;
+  size_t node_count(AST_Node::Type type) const;
+  void print_stats() const;
+};
+
 class Parse_Tree {
+  AST_Arena arena;
   std::vector<AST_Node *> nodes;
 
 public:
+  // Allocate a new node owned by this tree
+  template <typename T, typename... Args> T *make(Args &&...args) {
+    return this->arena.make<T>(std::forward<Args>(args)...);
+  }
+
   void allocate(AST_Node *node);
   void print();
+  void print_stats() const;
 
   std::vector<AST_Node *> &unpack();
 
   Parse_Tree();
-  ~Parse_Tree();
+  Parse_Tree(Parse_Tree &&other) = default;
+  Parse_Tree(const Parse_Tree &) = delete;
+  Parse_Tree &operator=(const Parse_Tree &) = delete;
 };
 
 #endif
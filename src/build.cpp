@@ -0,0 +1,385 @@
+#include "build.hpp"
+#include "errors.hpp"
+#include "lexer.hpp"
+#include "token.hpp"
+#include "work_pool.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <streambuf>
+#include <thread>
+#include <utility>
+
+std::vector<Module_Import> scan_imports(std::string_view source) {
+  // Lexer errors are reported again when the module is parsed
+  Source_Map map = Source_Map(source);
+  Reporter reporter = Reporter("", "", map, false);
+  Lexer lexer = Lexer(source, &reporter);
+  lexer.scan();
+  const std::vector<Token> &tokens = lexer.output;
+
+  auto is = [&](size_t i, Token::Type type) {
+    return i < tokens.size() && tokens[i].type == type;
+  };
+  auto lexeme = [&](size_t i) { return std::string(map.lexeme(tokens[i])); };
+
+  std::vector<Module_Import> imports;
+  bool statement = true; // at the start of one
+  for (size_t i = 0; i < tokens.size(); i++) {
+    bool start = statement;
+    statement = is(i, Token::Type::NEWLINE) || is(i, Token::Type::SEMICOLON);
+    if (!start)
+      continue;
+
+    if (is(i, Token::Type::IMPORT) && is(i + 1, Token::Type::SYMBOL)) {
+      imports.push_back({lexeme(i + 1), {}});
+    } else if (is(i, Token::Type::FROM) && is(i + 1, Token::Type::SYMBOL) &&
+               is(i + 2, Token::Type::IMPORT)) {
+      Module_Import import = {lexeme(i + 1), {}};
+      size_t j = i + 3;
+      if (is(j, Token::Type::STAR))
+        import.items.push_back("*");
+      for (; is(j, Token::Type::SYMBOL); j += 2) {
+        import.items.push_back(lexeme(j));
+        if (!is(j + 1, Token::Type::COMMA))
+          break;
+      }
+      imports.push_back(std::move(import));
+    }
+  }
+  return imports;
+}
+
+Module_Build::Module_Build(std::string entry, int level,
+                           std::optional<std::string> cache_dir)
+    : entry_path(std::move(entry)), level(level),
+      cache_dir(std::move(cache_dir)) {}
+
+Module &Module_Build::entry() { return this->modules.back(); }
+
+std::string Module_Build::artifact(const Module &module) const {
+  std::ostringstream name;
+  name << std::hex << std::setw(16) << std::setfill('0') << module.key
+       << ".cbc";
+  return (std::filesystem::path(*this->cache_dir) / name.str()).string();
+}
+
+// ---------------------------------------------------------------------
+// DISCOVERY
+// ---------------------------------------------------------------------
+
+bool Module_Build::discover() {
+  this->load_manifest();
+  std::string name = std::filesystem::path(this->entry_path).stem().string();
+  if (!this->visit(this->entry_path, name, ""))
+    return false;
+
+  // Keys are only final once it's known which modules are imported from
+  for (Module &module : this->modules) {
+    std::string bytes;
+    auto put = [&](uint64_t value) {
+      bytes.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    };
+    put(CHAO_COMPILER_VERSION);
+    put(this->level);
+    put(module.exported);
+    put(module.content_hash);
+    for (size_t d : module.dependencies)
+      put(this->modules[d].key);
+    module.key = cbc_source_hash(bytes);
+  }
+  return true;
+}
+
+std::optional<size_t> Module_Build::visit(const std::string &path,
+                                          const std::string &name,
+                                          const std::string &importer) {
+  std::error_code error;
+  std::string canonical =
+      std::filesystem::weakly_canonical(path, error).string();
+  if (error)
+    canonical = path;
+
+  auto found = this->index.find(canonical);
+  if (found != this->index.end())
+    return found->second;
+
+  auto cycle =
+      std::find(this->visiting.begin(), this->visiting.end(), canonical);
+  if (cycle != this->visiting.end()) {
+    std::cerr << "Import cycle:";
+    for (; cycle != this->visiting.end(); cycle++)
+      std::cerr << " " << std::filesystem::path(*cycle).stem().string()
+                << " ->";
+    std::cerr << " " << name << std::endl;
+    return std::nullopt;
+  }
+
+  if (!std::filesystem::is_regular_file(path, error)) {
+    if (importer.empty())
+      std::cerr << "File path '" << path << "' does not exist!" << std::endl;
+    else
+      std::cerr << "Module '" << name << "' imported by " << importer
+                << " not found at " << path << std::endl;
+    return std::nullopt;
+  }
+
+  Module module;
+  module.name = name;
+  module.path = path;
+  module.source = Source_Buffer::open(path.c_str());
+  if (!module.source)
+    return std::nullopt;
+  module.content_hash = cbc_source_hash(module.source->view());
+
+  auto known = this->manifest.find(module.content_hash);
+  if (known != this->manifest.end()) {
+    module.imports = known->second;
+  } else {
+    module.imports = scan_imports(module.source->view());
+    this->manifest[module.content_hash] = module.imports;
+    this->manifest_changed = true;
+  }
+
+  this->visiting.push_back(canonical);
+  std::filesystem::path dir = std::filesystem::path(path).parent_path();
+  for (const Module_Import &import : module.imports) {
+    std::string dependency = (dir / (import.module + ".chao")).string();
+    std::optional<size_t> d = this->visit(dependency, import.module, path);
+    if (!d)
+      return std::nullopt;
+    module.dependencies.push_back(*d);
+    if (!import.items.empty())
+      this->modules[*d].exported = true;
+  }
+  this->visiting.pop_back();
+
+  this->modules.push_back(std::move(module));
+  this->index[canonical] = this->modules.size() - 1;
+  return this->modules.size() - 1;
+}
+
+// ---------------------------------------------------------------------
+// MANIFEST
+// ---------------------------------------------------------------------
+
+// One line per content hash, followed by what that source imports:
+//
+//   <hash> <module> <module>:<item>,<item> <module>:*
+//
+// A line that doesn't read is skipped, and the module it was for is lexed
+// again
+void Module_Build::load_manifest() {
+  if (!this->cache_dir)
+    return;
+  std::ifstream in(std::filesystem::path(*this->cache_dir) / "manifest");
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream words(line);
+    uint64_t hash;
+    if (!(words >> std::hex >> hash))
+      continue;
+
+    std::vector<Module_Import> imports;
+    std::string word;
+    while (words >> word) {
+      size_t colon = word.find(':');
+      Module_Import import = {word.substr(0, colon), {}};
+      if (colon != std::string::npos) {
+        std::istringstream items(word.substr(colon + 1));
+        std::string item;
+        while (std::getline(items, item, ','))
+          import.items.push_back(item);
+      }
+      imports.push_back(std::move(import));
+    }
+    this->manifest[hash] = std::move(imports);
+  }
+}
+
+void Module_Build::save_manifest() const {
+  std::filesystem::path path =
+      std::filesystem::path(*this->cache_dir) / "manifest";
+  std::ofstream out(path, std::ios::trunc);
+  for (const auto &[hash, imports] : this->manifest) {
+    out << std::hex << hash;
+    for (const Module_Import &import : imports) {
+      out << " " << import.module;
+      for (size_t i = 0; i < import.items.size(); i++)
+        out << (i == 0 ? ":" : ",") << import.items[i];
+    }
+    out << "\n";
+  }
+  if (!out)
+    std::cerr << "Could not write " << path.string() << std::endl;
+}
+
+// ---------------------------------------------------------------------
+// BUILDING
+// ---------------------------------------------------------------------
+
+namespace {
+
+// Everything one module printed while it was built, as runs of text for
+// stdout (0) or stderr (1) in the order they were printed
+struct Module_Output {
+  std::vector<std::pair<int, std::string>> runs;
+
+  void write(int stream, const char *s, std::streamsize n) {
+    if (this->runs.empty() || this->runs.back().first != stream)
+      this->runs.push_back({stream, ""});
+    this->runs.back().second.append(s, n);
+  }
+};
+
+thread_local Module_Output *capturing = nullptr;
+
+// Stands in for the buffer of `std::cout` or `std::cerr` for as long as it
+// lives. Whatever a thread prints while `capturing` is set goes there
+// instead, anything else goes through as usual
+class Capture_Buffer : public std::streambuf {
+  std::ostream &stream;
+  int index;
+  std::streambuf *original;
+
+public:
+  Capture_Buffer(std::ostream &stream, int index)
+      : stream(stream), index(index), original(stream.rdbuf(this)) {}
+  ~Capture_Buffer() { this->stream.rdbuf(this->original); }
+
+protected:
+  std::streamsize xsputn(const char *s, std::streamsize n) override {
+    if (!capturing)
+      return this->original->sputn(s, n);
+    capturing->write(this->index, s, n);
+    return n;
+  }
+
+  int overflow(int c) override {
+    if (c == traits_type::eof())
+      return 0;
+    char ch = traits_type::to_char_type(c);
+    return this->xsputn(&ch, 1) == 1 ? c : traits_type::eof();
+  }
+
+  int sync() override { return capturing ? 0 : this->original->pubsync(); }
+};
+
+} // namespace
+
+bool Module_Build::build(const Compiler &compile, size_t jobs) {
+  if (this->cache_dir) {
+    std::error_code error;
+    std::filesystem::create_directories(*this->cache_dir, error);
+  }
+
+  if (jobs == 0)
+    jobs = std::thread::hardware_concurrency();
+  jobs = std::clamp<size_t>(jobs, 1, this->modules.size());
+
+  std::vector<Module_Output> output(this->modules.size());
+  std::vector<char> built(this->modules.size(), false);
+  {
+    Capture_Buffer out = Capture_Buffer(std::cout, 0);
+    Capture_Buffer err = Capture_Buffer(std::cerr, 1);
+    Work_Pool pool = Work_Pool(jobs);
+    for (size_t i = 0; i < this->modules.size(); i++)
+      pool.submit([&, i] {
+        capturing = &output[i];
+        built[i] = this->build_one(this->modules[i], compile);
+        capturing = nullptr;
+      });
+    pool.wait();
+  }
+
+  for (const Module_Output &o : output)
+    for (const auto &[stream, text] : o.runs)
+      (stream == 0 ? std::cout : std::cerr) << text << std::flush;
+
+  if (this->cache_dir && this->manifest_changed)
+    this->save_manifest();
+  return std::find(built.begin(), built.end(), false) == built.end();
+}
+
+bool Module_Build::build_one(Module &module, const Compiler &compile) {
+  if (this->cache_dir) {
+    module.program = CBC_Program::load(this->artifact(module).c_str(),
+                                       module.key, this->level);
+    module.cached = module.program.has_value();
+  }
+
+  if (!module.program) {
+    module.program = compile(module);
+    if (!module.program)
+      return false;
+
+    // Modules with errors aren't cached so the errors show up every time
+    if (this->cache_dir && module.cacheable)
+      module.program->save(this->artifact(module).c_str(), module.key,
+                           this->level);
+  }
+
+  // Compiled programs copy everything they need out of the source
+  module.source.reset();
+  return true;
+}
+
+// ---------------------------------------------------------------------
+// RUNNING
+// ---------------------------------------------------------------------
+
+int Module_Build::run(CBC_Profile *profile) {
+  this->vms.clear();
+  for (const Module &module : this->modules) {
+    this->vms.push_back(std::make_unique<CBC_VM>(*module.program));
+    CBC_VM &vm = *this->vms.back();
+
+    for (size_t i = 0; i < module.imports.size(); i++) {
+      const Module_Import &import = module.imports[i];
+      const Module &from = this->modules[module.dependencies[i]];
+      const CBC_VM &exporter = *this->vms[module.dependencies[i]];
+
+      for (const std::string &item : import.items) {
+        if (item == "*") {
+          for (Symbol_Id name : from.program->pool.slots)
+            if (std::optional<CBC_Value> value = exporter.global(name))
+              vm.define(name, *value);
+          continue;
+        }
+
+        Symbol_Id name = Symbol_Id::intern(item);
+        std::optional<CBC_Value> value = exporter.global(name);
+        if (!value) {
+          std::cerr << "Module '" << import.module << "' has no global '"
+                    << item << "' for " << module.path << " to import"
+                    << std::endl;
+          return -1;
+        }
+        vm.define(name, *value);
+      }
+    }
+
+    int status = profile ? vm.run_profiled(*profile) : vm.run();
+    if (status != 0)
+      return status;
+  }
+  return 0;
+}
+
+// The globals of the entry, or of whichever module stopped the run
+void Module_Build::print_globals() const {
+  if (!this->vms.empty())
+    this->vms.back()->print_globals();
+}
+
+void Module_Build::print_stats() const {
+  size_t cached = 0;
+  for (const Module &module : this->modules)
+    cached += module.cached;
+  std::cout << "[build] " << this->modules.size() << " module(s), " << cached
+            << " loaded from cache, " << this->modules.size() - cached
+            << " compiled" << std::endl;
+}
@@ -0,0 +1,123 @@
+#ifndef BUILD_H
+#define BUILD_H
+
+#include "cbc.hpp"
+#include "source.hpp"
+#include "vm.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Bump whenever the compiler can turn the same source into different code,
+// so that nothing it built before is picked up again
+constexpr uint32_t CHAO_COMPILER_VERSION = 1;
+
+// One `import` or `from ... import` statement
+struct Module_Import {
+  std::string module;
+  // The names `from ... import` binds, "*" for all of them, empty for a
+  // plain `import`
+  std::vector<std::string> items;
+};
+
+// Finds the import statements of a source file by lexing it, without
+// parsing. Imports are all the build needs to know about a module before
+// deciding whether to compile it
+std::vector<Module_Import> scan_imports(std::string_view source);
+
+struct Module {
+  std::string name; // as imported, or the file name for the entry
+  std::string path;
+  std::optional<Source_Buffer> source; // dropped once the module is built
+  uint64_t content_hash = 0;
+
+  // Content hash, compiler version, level and the keys of every import. A
+  // change anywhere below a module changes its key too, which is how an edit
+  // invalidates everything that imports it, directly or not
+  uint64_t key = 0;
+
+  std::vector<Module_Import> imports;
+  std::vector<size_t> dependencies; // index in `modules` of each import
+
+  // Something imports from it, which changes what the optimizer may drop
+  bool exported = false;
+
+  std::optional<CBC_Program> program;
+  bool cached = false;    // loaded instead of compiled
+  bool cacheable = true;  // compiled without errors
+};
+
+// Builds a program and every module it imports, then runs them.
+//
+// Modules are found from the entry by following imports, each one resolved
+// to `<name>.chao` next to the module importing it. With a cache directory,
+// every module compiled is saved there as `<key>.cbc` and one whose key
+// already has a file is loaded instead, so nothing about an unchanged module
+// is lexed, parsed or compiled. The imports found for each content hash are
+// kept in the cache's `manifest`, so unchanged modules aren't even lexed to
+// find out what they import
+//
+// Running goes through the modules dependencies first, each in its own VM.
+// `from module import a, b` copies the globals `a` and `b` of `module` into
+// the importer before it starts
+class Module_Build {
+public:
+  using Compiler = std::function<std::optional<CBC_Program>(Module &module)>;
+
+  // Imports always come before the modules that import them, so the entry
+  // is last
+  std::vector<Module> modules;
+
+  Module_Build(std::string entry, int level,
+               std::optional<std::string> cache_dir);
+
+  // Reads every module and works out their keys. Missing modules and import
+  // cycles are printed to stderr and return false
+  bool discover();
+
+  // Loads every module the cache has and hands the rest to `compile`, which
+  // prints its own errors and returns `std::nullopt` if there were any it
+  // can't go on from
+  //
+  // Modules are built on `jobs` threads, one per hardware thread if 0.
+  // Nothing a module compiles to depends on how its imports compiled, so
+  // every module can be built at once. Whatever each one prints is held back
+  // and printed afterwards in the order of `modules`, so the output is the
+  // same however many threads there are
+  bool build(const Compiler &compile, size_t jobs = 0);
+
+  // Returns the exit code of the first module to fail, or of the entry
+  int run(CBC_Profile *profile = nullptr);
+
+  Module &entry();
+  void print_globals() const;
+  void print_stats() const;
+
+private:
+  std::string entry_path;
+  int level;
+  std::optional<std::string> cache_dir;
+  std::vector<std::unique_ptr<CBC_VM>> vms;
+
+  // Imports of every content hash seen, and whether that changed
+  std::unordered_map<uint64_t, std::vector<Module_Import>> manifest;
+  bool manifest_changed = false;
+
+  std::unordered_map<std::string, size_t> index;  // canonical path -> module
+  std::vector<std::string> visiting;               // for reporting cycles
+
+  bool build_one(Module &module, const Compiler &compile);
+  std::optional<size_t> visit(const std::string &path, const std::string &name,
+                              const std::string &importer);
+  std::string artifact(const Module &module) const;
+  void load_manifest();
+  void save_manifest() const;
+};
+
+#endif
@@ -1,71 +1,641 @@
 #include "cbc.hpp"
 #include "ast.hpp"
+#include "peephole.hpp"
+#include "regalloc.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
-template <typename T> T *cast_node(AST_Node *node) {
-  return dynamic_cast<T *>(node);
+// ---------------------------------------------------------------------
+// VALUES
+// ---------------------------------------------------------------------
+
+CBC_Value::Type CBC_Value::type() const {
+  if (this->is_float())
+    return Type::FLOAT;
+  switch (this->tag() & 7) {
+  case 1:
+    return Type::NIL;
+  case 2:
+    return Type::BOOLEAN;
+  case 3:
+  case 4:
+    return Type::INTEGER;
+  case 5:
+    return Type::STRING;
+  case 6:
+    return Type::ARRAY;
+  default:
+    return Type::FUNCTION;
+  }
+}
+
+bool CBC_Value::truthy() const {
+  switch (this->type()) {
+  case Type::NIL:
+    return false;
+  case Type::BOOLEAN:
+    return this->as_boolean();
+  case Type::INTEGER:
+    return this->as_integer() != 0;
+  case Type::FLOAT:
+    return this->as_float_bits() != 0.0;
+  default:
+    return true;
+  }
+}
+
+std::ostream &operator<<(std::ostream &os, const CBC_Value &value) {
+  switch (value.type()) {
+  case CBC_Value::Type::NIL:
+    os << "nil";
+    break;
+  case CBC_Value::Type::BOOLEAN:
+    os << (value.as_boolean() ? "true" : "false");
+    break;
+  case CBC_Value::Type::INTEGER:
+    os << value.as_integer();
+    break;
+  case CBC_Value::Type::FLOAT:
+    os << value.as_float_bits();
+    break;
+  case CBC_Value::Type::STRING:
+    os << *value.as_string();
+    break;
+  case CBC_Value::Type::ARRAY: {
+    const std::vector<CBC_Value> &items = value.as_array()->items;
+    os << "[";
+    for (size_t i = 0; i < items.size(); i++)
+      os << (i == 0 ? "" : ", ") << items[i];
+    os << "]";
+    break;
+  }
+  case CBC_Value::Type::FUNCTION:
+    os << "<fn " << value.as_function()->name << ">";
+    break;
+  }
+  return os;
+}
+
+// ---------------------------------------------------------------------
+// HEAP
+// ---------------------------------------------------------------------
+
+CBC_Value CBC_Heap::box(long long int i) {
+  return CBC_Value::boxed_integer(&this->integers.emplace_back(i));
+}
+
+CBC_Value CBC_Heap::string(std::string_view s) {
+  return CBC_Value::string(&this->strings.emplace_back(s));
+}
+
+CBC_Value CBC_Heap::array(std::vector<CBC_Value> items) {
+  CBC_Array &array = this->arrays.emplace_back(CBC_Array{std::move(items)});
+  return CBC_Value::array(&array);
+}
+
+CBC_Value CBC_Heap::function(std::string name, uint32_t entry,
+                             uint8_t arity) {
+  CBC_Function &function =
+      this->functions.emplace_back(CBC_Function{std::move(name), entry, arity});
+  return CBC_Value::function(&function);
+}
+
+size_t CBC_Heap::bytes() const {
+  size_t n = this->integers.size() * sizeof(long long int);
+  for (const std::string &s : this->strings)
+    n += s.size();
+  for (const CBC_Array &a : this->arrays)
+    n += a.items.size() * sizeof(CBC_Value);
+  for (const CBC_Function &f : this->functions)
+    n += sizeof(CBC_Function) + f.name.size();
+  return n;
 }
 
+// ---------------------------------------------------------------------
+// INSTRUCTIONS
+// ---------------------------------------------------------------------
+
 CBC_Instruction::CBC_Instruction(CBC_Opcode code, int o1)
     : code(code), o1(o1) {}
 CBC_Instruction::CBC_Instruction(CBC_Opcode code, int o1, long long int o2)
     : code(code), o1(o1), o2(o2) {}
-CBC_Instruction::CBC_Instruction(CBC_Opcode code, double of)
-    : code(code), of(of) {}
-CBC_Instruction::CBC_Instruction(CBC_Opcode code, int o1, std::string symbol)
-    : code(code), o1(o1), symbol(symbol) {}
+CBC_Instruction::CBC_Instruction(CBC_Opcode code, int o1, int o2, int o3)
+    : code(code), o1(o1), o2(o2), o3(o3) {}
 
-void CBC_Instruction::print() const {
-  switch (this->code) {
+static const char *opcode_names[N_CBC_OPCODES] = {
+    "QUIT",
+    "STORE_CONST",
+    "STORE_VAR",
+    "LOAD_CONST",
+    "CALL",
+    "MOVE",
+    "LOAD_GLOBAL",
+    "ADD",
+    "SUBTRACT",
+    "MULTIPLY",
+    "DIVIDE",
+    "MODULUS",
+    "LESS",
+    "LESS_EQUAL",
+    "EQUAL",
+    "NOT_EQUAL",
+    "JUMP",
+    "JUMP_IF_FALSE",
+    "SPILL",
+    "RELOAD",
+#define CBC_SUPER2(name, first, second) #name,
+#define CBC_SUPER3(name, first, second, third) #name,
+#include "cbc_super.def"
+#undef CBC_SUPER2
+#undef CBC_SUPER3
+};
 
-  case CBC_Opcode::QUIT: {
-    std::cout << "QUIT, " << this->o1 << std::endl;
+std::ostream &operator<<(std::ostream &os, const CBC_Opcode &code) {
+  // Code loaded from a file can hold anything until it's verified
+  size_t i = static_cast<size_t>(code);
+  if (i < N_CBC_OPCODES)
+    os << opcode_names[i];
+  else
+    os << "<opcode " << i << ">";
+  return os;
+}
+
+std::optional<CBC_Opcode> cbc_opcode(std::string_view name) {
+  for (size_t i = 0; i < N_CBC_OPCODES; i++)
+    if (name == opcode_names[i])
+      return static_cast<CBC_Opcode>(i);
+  return std::nullopt;
+}
+
+CBC_Instruction::Registers CBC_Instruction::registers() const {
+  Registers r;
+  switch (cbc_base(this->code)) {
+  case CBC_Opcode::QUIT:
+  case CBC_Opcode::JUMP:
     break;
-  }
-  case CBC_Opcode::LOAD_CONST: {
-    std::cout << "LOAD_CONST, " << this->o1 << ", " << this->o2 << std::endl;
+  case CBC_Opcode::STORE_CONST:
+  case CBC_Opcode::STORE_VAR:
+  case CBC_Opcode::CALL:
+  case CBC_Opcode::JUMP_IF_FALSE:
+  case CBC_Opcode::SPILL:
+    r.uses[0] = 1;
+    break;
+  case CBC_Opcode::LOAD_CONST:
+  case CBC_Opcode::LOAD_GLOBAL:
+  case CBC_Opcode::RELOAD:
+    r.def = 1;
+    break;
+  case CBC_Opcode::MOVE:
+    r.def = 1;
+    r.uses[0] = 2;
+    break;
+  default:
+    r.def = 1;
+    r.uses[0] = 2;
+    r.uses[1] = 3;
     break;
   }
-  case CBC_Opcode::STORE_CONST: {
-    std::cout << "STORE_CONST, " << this->o1 << std::endl;
+  return r;
+}
+
+long long int CBC_Instruction::operand(int n) const {
+  return n == 1 ? this->o1 : n == 2 ? this->o2 : this->o3;
+}
+
+void CBC_Instruction::set_operand(int n, long long int value) {
+  if (n == 1)
+    this->o1 = value;
+  else if (n == 2)
+    this->o2 = value;
+  else
+    this->o3 = value;
+}
+
+void CBC_Instruction::print(const CBC_Pool &pool) const {
+  std::cout << this->code;
+  switch (cbc_base(this->code)) {
+  case CBC_Opcode::QUIT:
+    std::cout << ", " << this->o1;
+    break;
+  case CBC_Opcode::LOAD_CONST:
+    std::cout << ", " << this->o1 << ", " << pool.constants[this->o2];
+    break;
+  case CBC_Opcode::MOVE:
+  case CBC_Opcode::JUMP_IF_FALSE:
+  case CBC_Opcode::SPILL:
+  case CBC_Opcode::RELOAD:
+    std::cout << ", " << this->o1 << ", " << this->o2;
+    break;
+  case CBC_Opcode::STORE_CONST:
+  case CBC_Opcode::STORE_VAR:
+  case CBC_Opcode::LOAD_GLOBAL:
+  case CBC_Opcode::CALL:
+    std::cout << ", " << this->o1 << ", " << pool.slots[this->o2];
+    break;
+  case CBC_Opcode::JUMP:
+    std::cout << ", " << this->o2;
+    break;
+  default:
+    std::cout << ", " << this->o1 << ", " << this->o2 << ", " << this->o3;
     break;
   }
+  std::cout << std::endl;
+}
+
+// ---------------------------------------------------------------------
+// CONSTANT POOL
+// ---------------------------------------------------------------------
+
+uint32_t CBC_Pool::add(CBC_Value value) {
+  this->constants.push_back(value);
+  return this->constants.size() - 1;
+}
+
+uint32_t CBC_Pool::integer(long long int i) {
+  auto [it, added] = this->integer_index.try_emplace(i, 0);
+  if (added)
+    it->second = this->add(this->heap.integer(i));
+  return it->second;
+}
+
+uint32_t CBC_Pool::floating(double f) {
+  uint64_t bits;
+  std::memcpy(&bits, &f, sizeof(bits));
+  auto [it, added] = this->float_index.try_emplace(bits, 0);
+  // Any NaN would do, but only the one arithmetic makes is sure to stay clear
+  // of the tags
+  if (added)
+    it->second = this->add(
+        f != f ? CBC_Value::floating(std::numeric_limits<double>::quiet_NaN())
+               : CBC_Value::floating(f));
+  return it->second;
+}
+
+uint32_t CBC_Pool::string(std::string_view s) {
+  auto found = this->string_index.find(s);
+  if (found != this->string_index.end())
+    return found->second;
+
+  // The key has to view the pooled copy, not the caller's string
+  CBC_Value owned = this->heap.string(s);
+  uint32_t index = this->add(owned);
+  this->string_index.emplace(*owned.as_string(), index);
+  return index;
+}
+
+uint32_t CBC_Pool::nil() {
+  if (!this->nil_index)
+    this->nil_index = this->add(CBC_Value());
+  return *this->nil_index;
+}
+
+uint32_t CBC_Pool::slot(Symbol_Id name) {
+  auto [it, added] = this->slot_index.try_emplace(name, 0);
+  if (added) {
+    this->slots.push_back(name);
+    it->second = this->slots.size() - 1;
   }
+  return it->second;
 }
 
-CBC_Compiler::CBC_Compiler(std::vector<AST_Node *> &ast) : ast(ast) {}
+std::optional<uint32_t> CBC_Pool::find_slot(Symbol_Id name) const {
+  auto found = this->slot_index.find(name);
+  if (found == this->slot_index.end())
+    return std::nullopt;
+  return found->second;
+}
 
-void CBC_Compiler::add(CBC_Instruction &&i) { this->program.push_back(i); }
+size_t CBC_Pool::bytes() const {
+  return this->constants.size() * sizeof(CBC_Value) + this->heap.bytes() +
+         this->slots.size() * sizeof(Symbol_Id);
+}
 
-void CBC_Compiler::load_integer(AST_Integer *node) {
-  this->add(CBC_Instruction(CBC_Opcode::LOAD_CONST, 0, node->value));
-};
+// ---------------------------------------------------------------------
+// ENCODED PROGRAMS
+// ---------------------------------------------------------------------
+
+std::optional<CBC_Program>
+CBC_Program::assemble(const std::vector<CBC_Instruction> &instructions,
+                      CBC_Pool pool) {
+  CBC_Program program;
+  program.pool = std::move(pool);
+  program.assembled_code.reserve(instructions.size());
+
+  for (size_t pc = 0; pc < instructions.size(); pc++) {
+    const CBC_Instruction &i = instructions[pc];
+    CBC_Code code = CBC_Code{i.code, 0, 0, 0, 0};
 
-void CBC_Compiler::binding_const(AST_Binding *node) {
-  if (node->initializer) {
-    this->compile_node(node->initializer.value());
+    auto reg = [&](long long int r, uint8_t &field) {
+      if (r < 0 || r >= (long long int)CBC_REGISTERS)
+        return false;
+      field = static_cast<uint8_t>(r);
+      return true;
+    };
+    auto wide = [&](long long int v) {
+      if (v < INT32_MIN || v > INT32_MAX)
+        return false;
+      code.k = static_cast<int32_t>(v);
+      return true;
+    };
+    auto index = [&](long long int i, size_t size) {
+      return i >= 0 && (size_t)i < size && wide(i);
+    };
+
+    bool ok = true;
+    switch (cbc_base(i.code)) {
+    case CBC_Opcode::QUIT:
+      ok = wide(i.o1);
+      break;
+    case CBC_Opcode::STORE_CONST:
+    case CBC_Opcode::STORE_VAR:
+    case CBC_Opcode::CALL:
+    case CBC_Opcode::LOAD_GLOBAL:
+      ok = reg(i.o1, code.a) && index(i.o2, program.pool.slots.size());
+      break;
+    case CBC_Opcode::LOAD_CONST:
+      ok = reg(i.o1, code.a) && index(i.o2, program.pool.constants.size());
+      break;
+    case CBC_Opcode::MOVE:
+      ok = reg(i.o1, code.a) && reg(i.o2, code.b);
+      break;
+    case CBC_Opcode::JUMP:
+      ok = wide(i.o2);
+      break;
+    case CBC_Opcode::JUMP_IF_FALSE:
+      ok = reg(i.o1, code.a) && wide(i.o2);
+      break;
+    case CBC_Opcode::SPILL:
+    case CBC_Opcode::RELOAD:
+      ok = reg(i.o1, code.a) && i.o2 >= 0 && wide(i.o2);
+      if (ok && (uint32_t)i.o2 >= program.spill_slots)
+        program.spill_slots = i.o2 + 1;
+      break;
+    default:
+      ok = reg(i.o1, code.a) && reg(i.o2, code.b) && reg(i.o3, code.c);
+      break;
+    }
+
+    if (!ok) {
+      std::cerr << "Can't encode CBC instruction " << pc << ": ";
+      std::cerr << i.code << ", " << i.o1 << ", " << i.o2 << ", " << i.o3
+                << std::endl;
+      return std::nullopt;
+    }
+    program.assembled_code.push_back(code);
+
+    std::vector<CBC_Line> &lines = program.assembled_lines;
+    if (i.line > 0 && (lines.empty() || lines.back().line != (uint32_t)i.line))
+      lines.push_back(CBC_Line{(uint32_t)pc, (uint32_t)i.line});
+  }
+
+  program.code = CBC_Span<CBC_Code>(program.assembled_code);
+  program.lines = CBC_Span<CBC_Line>(program.assembled_lines);
+  return program;
+}
+
+CBC_Instruction CBC_Program::decode(size_t pc) const {
+  const CBC_Code &c = this->code[pc];
+  switch (cbc_base(c.op)) {
+  case CBC_Opcode::QUIT:
+    return CBC_Instruction(c.op, c.k);
+  case CBC_Opcode::STORE_CONST:
+  case CBC_Opcode::STORE_VAR:
+  case CBC_Opcode::CALL:
+  case CBC_Opcode::LOAD_GLOBAL:
+  case CBC_Opcode::LOAD_CONST:
+    return CBC_Instruction(c.op, c.a, (long long int)c.k);
+  case CBC_Opcode::MOVE:
+    return CBC_Instruction(c.op, c.a, (long long int)c.b);
+  case CBC_Opcode::JUMP:
+  case CBC_Opcode::JUMP_IF_FALSE:
+  case CBC_Opcode::SPILL:
+  case CBC_Opcode::RELOAD:
+    return CBC_Instruction(c.op, c.a, (long long int)c.k);
+  default:
+    return CBC_Instruction(c.op, c.a, c.b, c.c);
   }
-  this->add(CBC_Instruction(CBC_Opcode::STORE_CONST, 0, node->symbol));
 }
 
-void CBC_Compiler::compile_node(AST_Node *n) {
-  switch (n->type) {
+uint32_t CBC_Program::line(size_t pc) const {
+  const CBC_Line *after =
+      std::upper_bound(this->lines.begin(), this->lines.end(), pc,
+                       [](size_t pc, const CBC_Line &l) { return pc < l.pc; });
+  return after == this->lines.begin() ? 0 : (after - 1)->line;
+}
+
+void CBC_Program::print() const {
+  for (size_t pc = 0; pc < this->code.size(); pc++)
+    this->decode(pc).print(this->pool);
+}
+
+void CBC_Program::print_stats() const {
+  std::cout << "[cbc] " << this->code.size() << " instructions, "
+            << this->code.size() * sizeof(CBC_Code) << " bytes, "
+            << this->pool.constants.size() << " constant(s), "
+            << this->pool.slots.size() << " global slot(s), "
+            << this->pool.bytes() << " pool bytes" << std::endl;
+}
+
+// ---------------------------------------------------------------------
+// SUPERINSTRUCTIONS
+// ---------------------------------------------------------------------
+
+size_t cbc_fuse(std::vector<CBC_Instruction> &program) {
+  size_t fused = 0;
+  size_t pc = 0;
+  while (pc < program.size()) {
+    const CBC_Super *match = nullptr;
+    for (const CBC_Super &super : cbc_supers) {
+      if (pc + super.length > program.size())
+        continue;
+      if (match && match->length >= super.length)
+        continue;
 
-  // STORE_VAR and STORE_CONST
-  case AST_Node::Type::Binding: {
-    AST_Binding *binding = dynamic_cast<AST_Binding *>(n);
-    if (!binding->mut) {
-      this->binding_const(binding);
+      bool same = true;
+      for (size_t i = 0; i < super.length; i++)
+        same = same && program[pc + i].code == super.parts[i];
+      if (same)
+        match = &super;
     }
-    break;
+
+    if (!match) {
+      pc++;
+      continue;
+    }
+    program[pc].code = match->op;
+    pc += match->length;
+    fused++;
   }
+  return fused;
+}
+
+// ---------------------------------------------------------------------
+// COMPILER
+// ---------------------------------------------------------------------
+
+CBC_Compiler::CBC_Compiler(std::vector<AST_Node *> &ast, int level)
+    : ast(ast), level(level) {}
 
-  // LOAD_CONST
-  case AST_Node::Type::Integer: {
-    this->load_integer(dynamic_cast<AST_Integer *>(n));
+// Out of line so `CBC_Peephole` is complete here
+CBC_Compiler::~CBC_Compiler() = default;
+
+void CBC_Compiler::add(CBC_Instruction &&i) {
+  i.line = this->line;
+  this->program.push_back(i);
+}
+
+int CBC_Compiler::new_register() { return this->virtual_registers++; }
+
+// LOAD_CONST
+int CBC_Compiler::load_constant(uint32_t k) {
+  int r = this->new_register();
+  this->add(CBC_Instruction(CBC_Opcode::LOAD_CONST, r, (long long int)k));
+  return r;
+}
+
+int CBC_Compiler::visit_node(AST_Node *) { return CBC_NO_REGISTER; }
+
+int CBC_Compiler::visit_integer(AST_Integer *node) {
+  return this->load_constant(this->pool.integer(node->value));
+}
+
+int CBC_Compiler::visit_float(AST_Float *node) {
+  return this->load_constant(this->pool.floating(node->value));
+}
+
+// This is the one place escapes get decoded, and only for literals that
+// have any
+int CBC_Compiler::visit_string(AST_String *node) {
+  if (node->escaped)
+    return this->load_constant(this->pool.string(node->value()));
+  return this->load_constant(this->pool.string(node->text));
+}
+
+// LOAD_GLOBAL
+int CBC_Compiler::visit_symbol(AST_Symbol *node) {
+  int r = this->new_register();
+  uint32_t slot = this->pool.slot(node->name);
+  this->add(
+      CBC_Instruction(CBC_Opcode::LOAD_GLOBAL, r, (long long int)slot));
+  return r;
+}
+
+// Arithmetic and comparisons. `>` and `>=` are `<` and `<=` with the operands
+// swapped
+int CBC_Compiler::visit_binary(AST_Binary *node) {
+  CBC_Opcode op;
+  bool swap = false;
+  switch (node->op) {
+  case AST_Op::ADD:
+    op = CBC_Opcode::ADD;
     break;
+  case AST_Op::SUBTRACT:
+    op = CBC_Opcode::SUBTRACT;
+    break;
+  case AST_Op::MULTIPLY:
+    op = CBC_Opcode::MULTIPLY;
+    break;
+  case AST_Op::DIVIDE:
+    op = CBC_Opcode::DIVIDE;
+    break;
+  case AST_Op::MODULUS:
+    op = CBC_Opcode::MODULUS;
+    break;
+  case AST_Op::COMP_LESS:
+    op = CBC_Opcode::LESS;
+    break;
+  case AST_Op::COMP_LESS_EQUAL:
+    op = CBC_Opcode::LESS_EQUAL;
+    break;
+  case AST_Op::COMP_MORE:
+    op = CBC_Opcode::LESS;
+    swap = true;
+    break;
+  case AST_Op::COMP_MORE_EQUAL:
+    op = CBC_Opcode::LESS_EQUAL;
+    swap = true;
+    break;
+  case AST_Op::COMP_EQUAL:
+    op = CBC_Opcode::EQUAL;
+    break;
+  case AST_Op::COMP_NOT_EQUAL:
+    op = CBC_Opcode::NOT_EQUAL;
+    break;
+  default:
+    return CBC_NO_REGISTER;
   }
-  }
+
+  int left = this->compile_node(node->left);
+  int right = this->compile_node(node->right);
+  if (left == CBC_NO_REGISTER || right == CBC_NO_REGISTER)
+    return CBC_NO_REGISTER;
+  if (swap)
+    std::swap(left, right);
+
+  int r = this->new_register();
+  this->add(CBC_Instruction(op, r, left, right));
+  return r;
+}
+
+// Only negation so far, as `0 - operand`
+int CBC_Compiler::visit_unary(AST_Unary *node) {
+  if (node->op != AST_Op::SUBTRACT)
+    return CBC_NO_REGISTER;
+
+  int operand = this->compile_node(node->operand);
+  if (operand == CBC_NO_REGISTER)
+    return CBC_NO_REGISTER;
+  int zero = this->load_constant(this->pool.integer(0));
+  int r = this->new_register();
+  this->add(CBC_Instruction(CBC_Opcode::SUBTRACT, r, zero, operand));
+  return r;
+}
+
+// Parentheses only change how the tree is built, the value is the same
+int CBC_Compiler::visit_grouping(AST_Grouping *node) {
+  return this->compile_node(node->inner);
+}
+
+// STORE_VAR and STORE_CONST
+int CBC_Compiler::visit_binding(AST_Binding *node) {
+  if (!node->mut)
+    return this->binding_const(node);
+  return CBC_NO_REGISTER;
+}
+
+// A binding with no initializer, or one that doesn't compile yet, is nil
+int CBC_Compiler::binding_const(AST_Binding *node) {
+  int r = CBC_NO_REGISTER;
+  if (node->initializer)
+    r = this->compile_node(node->initializer.value());
+  if (r == CBC_NO_REGISTER)
+    r = this->load_constant(this->pool.nil());
+
+  uint32_t slot = this->pool.slot(node->symbol);
+  this->add(
+      CBC_Instruction(CBC_Opcode::STORE_CONST, r, (long long int)slot));
+  return CBC_NO_REGISTER;
+}
+
+int CBC_Compiler::compile_node(AST_Node *n) {
+  if (n == nullptr)
+    return CBC_NO_REGISTER;
+
+  // Children are compiled before the instruction that uses them, so the line
+  // has to go back to this node's once they're done
+  int outer = this->line;
+  this->line = n->line;
+  int r = this->visit(n);
+  this->line = outer;
+  return r;
 }
 
 int CBC_Compiler::compile() {
@@ -73,11 +643,44 @@ int CBC_Compiler::compile() {
     this->compile_node(node);
 
   this->add(CBC_Instruction(CBC_Opcode::QUIT, 0));
+
+  if (this->level >= 1) {
+    this->peephole =
+        std::make_unique<CBC_Peephole>(this->program, this->exported);
+    this->peephole->run();
+  }
+
+  CBC_Register_Allocator allocator =
+      CBC_Register_Allocator(this->program, this->virtual_registers);
+  this->register_stats = allocator.run();
+
+  if (this->level >= 2)
+    this->fused = cbc_fuse(this->program);
   return 0;
 }
 
+const std::vector<CBC_Instruction> &CBC_Compiler::output() const {
+  return this->program;
+}
+
 void CBC_Compiler::print_program() const {
   std::cout << "\n\n[PROGRAM]:\n" << std::endl;
-  for (CBC_Instruction i : this->program)
-    i.print();
-}
\ No newline at end of file
+  for (const CBC_Instruction &i : this->program)
+    i.print(this->pool);
+}
+
+void CBC_Compiler::print_stats() const {
+  if (this->peephole)
+    this->peephole->print_stats();
+  this->register_stats.print();
+  if (this->level >= 2)
+    std::cout << "[super] " << this->fused << " run(s) fused out of "
+              << N_CBC_SUPERS << " superinstruction(s)" << std::endl;
+}
+
+void CBC_Register_Stats::print() const {
+  std::cout << "[regalloc] " << this->virtual_registers
+            << " virtual register(s) onto " << this->physical_registers
+            << " physical, " << this->spilled << " spilled, "
+            << this->spill_code << " spill instruction(s)" << std::endl;
+}
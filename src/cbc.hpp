@@ -4,69 +4,579 @@
 // CBC stands for "Chao Bytecode"
 
 #include "ast.hpp"
+#include "source.hpp"
+#include "symbol.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
-enum CBC_Opcode {
+enum class CBC_Opcode : uint8_t {
   // Ends the program immediately
   // `o1`: exit code
   QUIT = 0,
 
   // Create a binding to a symbol in this scope
   // `o1`: register to get value from
-  // `symbol`: symbol to use in table
+  // `o2`: global slot of the symbol
   STORE_CONST,
 
   // Create a mutable binding to a symbol in this scope
   // `o1`: register to get value from
-  // `symbol`: symbol to use in table
+  // `o2`: global slot of the symbol
   STORE_VAR,
 
   // Load a constant value into memory
   // `o1`: register to store value in
-  // `o2`: value to store in register
+  // `o2`: index of the value in the constant pool
   LOAD_CONST,
 
   // Call a function
   // e.g. `print(...)`
   CALL,
+
+  // Copy one register into another
+  // `o1`: register to store value in
+  // `o2`: register to copy
+  MOVE,
+
+  // Read the value bound to a symbol
+  // `o1`: register to store value in
+  // `o2`: global slot of the symbol
+  LOAD_GLOBAL,
+
+  // Arithmetic and comparisons, `o1 = o2 <op> o3`
+  // `o1`: register to store result in
+  // `o2`: register holding left operand
+  // `o3`: register holding right operand
+  ADD,
+  SUBTRACT,
+  MULTIPLY,
+  DIVIDE,
+  MODULUS,
+  LESS,
+  LESS_EQUAL,
+  EQUAL,
+  NOT_EQUAL,
+
+  // Continue at another instruction
+  // `o2`: index of the instruction to jump to
+  JUMP,
+
+  // Jump if a register holds a false value (false, nil, or zero)
+  // `o1`: register to test
+  // `o2`: index of the instruction to jump to
+  JUMP_IF_FALSE,
+
+  // Save a register to a spill slot, for values the register allocator
+  // couldn't keep in a register
+  // `o1`: register to save
+  // `o2`: spill slot
+  SPILL,
+
+  // Load a value back from a spill slot
+  // `o1`: register to store value in
+  // `o2`: spill slot
+  RELOAD,
+
+  // Superinstructions, listed in `cbc_super.def`. Each runs two or three of
+  // the opcodes above back to back. The fused opcode replaces the first
+  // instruction of the run and takes its operands, while the rest of the run
+  // stays where it is to hold theirs. A jump into the middle of a run lands
+  // on a plain instruction and works as before
+#define CBC_SUPER2(name, first, second) name,
+#define CBC_SUPER3(name, first, second, third) name,
+#include "cbc_super.def"
+#undef CBC_SUPER2
+#undef CBC_SUPER3
 };
 
+constexpr size_t N_CBC_BASE_OPCODES =
+    static_cast<size_t>(CBC_Opcode::RELOAD) + 1;
+
+constexpr size_t N_CBC_SUPERS = 0
+#define CBC_SUPER2(name, first, second) +1
+#define CBC_SUPER3(name, first, second, third) +1
+#include "cbc_super.def"
+#undef CBC_SUPER2
+#undef CBC_SUPER3
+    ;
+
+constexpr size_t N_CBC_OPCODES = N_CBC_BASE_OPCODES + N_CBC_SUPERS;
+static_assert(N_CBC_OPCODES <= 256, "CBC opcodes have to fit in a byte");
+
+// The opcodes one superinstruction runs, in order
+struct CBC_Super {
+  CBC_Opcode op;
+  uint8_t length;
+  CBC_Opcode parts[3];
+};
+
+inline constexpr std::array<CBC_Super, N_CBC_SUPERS> cbc_supers = {{
+#define CBC_SUPER2(name, first, second)                                        \
+  {CBC_Opcode::name, 2, {CBC_Opcode::first, CBC_Opcode::second}},
+#define CBC_SUPER3(name, first, second, third)                                 \
+  {CBC_Opcode::name,                                                           \
+   3,                                                                          \
+   {CBC_Opcode::first, CBC_Opcode::second, CBC_Opcode::third}},
+#include "cbc_super.def"
+#undef CBC_SUPER2
+#undef CBC_SUPER3
+}};
+
+// The superinstruction `op` stands for, or `nullptr` for a plain opcode
+inline const CBC_Super *cbc_super(CBC_Opcode op) {
+  size_t i = static_cast<size_t>(op);
+  return i >= N_CBC_BASE_OPCODES && i < N_CBC_OPCODES
+             ? &cbc_supers[i - N_CBC_BASE_OPCODES]
+             : nullptr;
+}
+
+// The opcode whose operands `op` takes, which is itself unless it's a
+// superinstruction
+inline CBC_Opcode cbc_base(CBC_Opcode op) {
+  const CBC_Super *super = cbc_super(op);
+  return super ? super->parts[0] : op;
+}
+
+// Looks up an opcode by the name `operator<<` prints for it
+std::optional<CBC_Opcode> cbc_opcode(std::string_view name);
+
+std::ostream &operator<<(std::ostream &os, const CBC_Opcode &code);
+
+class CBC_Pool;
+
 struct CBC_Instruction {
   CBC_Opcode code;
-  int o1 = -1;             // used for registers
-  long long int o2 = -1;   // used for values
-  double of = 0.0f;        // used for values
-  std::string symbol = ""; // used for symbols assigned to bindings or call
+  int o1 = -1;           // used for registers
+  long long int o2 = -1; // used for pool indices, slots and jump targets
+  int o3 = -1;           // used for a second source register
+  int line = 0;          // source line it was compiled from, 0 if unknown
 
   CBC_Instruction(CBC_Opcode code, int o1);
   CBC_Instruction(CBC_Opcode code, int o1, long long int o2);
-  CBC_Instruction(CBC_Opcode code, double of);
-  CBC_Instruction(CBC_Opcode code, int o1, std::string symbol);
+  CBC_Instruction(CBC_Opcode code, int o1, int o2, int o3);
+
+  // The operands that name registers, as 1 for `o1` up to 3 for `o3` and 0
+  // for none: the one written and up to two that are read. Passes that rename
+  // registers go through this instead of switching on the opcode themselves
+  struct Registers {
+    int def = 0;
+    int uses[2] = {0, 0};
+  };
+  Registers registers() const;
+  long long int operand(int n) const;
+  void set_operand(int n, long long int value);
+
+  // Constants and slots are printed as the value or name they refer to
+  void print(const CBC_Pool &pool) const;
+};
+
+// Registers are addressed with one byte
+constexpr size_t CBC_REGISTERS = 256;
+
+struct CBC_Array;
+struct CBC_Function;
+
+// Every value is a single 64-bit word. Doubles are stored as themselves and
+// everything else goes in the payload of a negative quiet NaN, with a 3-bit
+// tag saying what it is:
+//
+//   sign  exponent     quiet  tag  payload
+//   1     11111111111  1      ttt  48 bits
+//
+//   tag 0  a double, the NaN every hardware operation returns
+//   tag 1  nil
+//   tag 2  boolean, payload 0 or 1
+//   tag 3  integer that fits in 48 bits, two's complement
+//   tag 4  integer that doesn't, pointing at the boxed `long long`
+//   tag 5  pointer to a `std::string`
+//   tag 6  pointer to a `CBC_Array`
+//   tag 7  pointer to a `CBC_Function`
+//
+// NaNs that arithmetic creates have an empty payload and arithmetic on them
+// keeps it, so no double ever lands on a tag. That makes telling doubles
+// apart one unsigned compare and lets float arithmetic work on the word
+// directly. User-space pointers fit in 48 bits on every 64-bit target we run
+// on. Whatever a value points to is owned by a `CBC_Heap`
+class CBC_Value {
+  uint64_t bits;
+
+  static constexpr int TAG_SHIFT = 48;
+  static constexpr uint64_t PAYLOAD = (1ULL << TAG_SHIFT) - 1;
+  static constexpr uint64_t TAGGED = 0xFFF8ULL;
+  static constexpr uint64_t tag_bits(uint64_t tag) {
+    return (TAGGED | tag) << TAG_SHIFT;
+  }
+  uint64_t tag() const { return this->bits >> TAG_SHIFT; }
+  template <typename T> T *pointer() const {
+    return reinterpret_cast<T *>(this->bits & PAYLOAD);
+  }
+
+public:
+  enum Type : uint8_t {
+    NIL,
+    BOOLEAN,
+    INTEGER,
+    FLOAT,
+    STRING,
+    ARRAY,
+    FUNCTION,
+  };
+
+  CBC_Value() : bits(tag_bits(1)) {}
+  static CBC_Value boolean(bool b) { return raw(tag_bits(2) | b); }
+  static CBC_Value floating(double f) {
+    uint64_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    return raw(bits);
+  }
+  // Only for integers where `fits_small()`. Anything else goes through
+  // `CBC_Heap::integer()`
+  static CBC_Value small_integer(long long int i) {
+    return raw(tag_bits(3) | ((uint64_t)i & PAYLOAD));
+  }
+  static CBC_Value boxed_integer(const long long int *i) {
+    return raw(tag_bits(4) | (uint64_t)i);
+  }
+  static CBC_Value string(const std::string *s) {
+    return raw(tag_bits(5) | (uint64_t)s);
+  }
+  static CBC_Value array(CBC_Array *a) {
+    return raw(tag_bits(6) | (uint64_t)a);
+  }
+  static CBC_Value function(const CBC_Function *f) {
+    return raw(tag_bits(7) | (uint64_t)f);
+  }
+  static CBC_Value raw(uint64_t bits) {
+    CBC_Value v;
+    v.bits = bits;
+    return v;
+  }
+
+  uint64_t word() const { return this->bits; }
+  Type type() const;
+
+  bool is_float() const { return this->bits < tag_bits(1); }
+  bool is_small() const { return this->tag() == (TAGGED | 3); }
+  // One branch for the common case of arithmetic on two small integers
+  static bool both_small(CBC_Value a, CBC_Value b) {
+    return ((a.bits ^ tag_bits(3)) | (b.bits ^ tag_bits(3))) >> TAG_SHIFT == 0;
+  }
+  static bool fits_small(long long int i) {
+    return (long long int)((uint64_t)i << (64 - TAG_SHIFT)) >>
+               (64 - TAG_SHIFT) ==
+           i;
+  }
+  bool is_integer() const {
+    return this->is_small() || this->tag() == (TAGGED | 4);
+  }
+  bool is_number() const { return this->is_float() || this->is_integer(); }
+
+  double as_float_bits() const {
+    double f;
+    std::memcpy(&f, &this->bits, sizeof(f));
+    return f;
+  }
+  long long int as_small() const {
+    return (long long int)(this->bits << (64 - TAG_SHIFT)) >>
+           (64 - TAG_SHIFT);
+  }
+  long long int as_integer() const {
+    return this->is_small() ? this->as_small() : *this->pointer<long long>();
+  }
+  // Integers convert, for arithmetic mixing the two
+  double as_float() const {
+    return this->is_float() ? this->as_float_bits()
+                            : (double)this->as_integer();
+  }
+  bool as_boolean() const { return this->bits & 1; }
+  const std::string *as_string() const { return this->pointer<std::string>(); }
+  CBC_Array *as_array() const { return this->pointer<CBC_Array>(); }
+  const CBC_Function *as_function() const {
+    return this->pointer<CBC_Function>();
+  }
+
+  // false, nil and zero are false, everything else is true
+  bool truthy() const;
+};
+
+static_assert(sizeof(CBC_Value) == 8, "CBC values are one word");
+
+struct CBC_Array {
+  std::vector<CBC_Value> items;
+};
+
+struct CBC_Function {
+  std::string name;
+  uint32_t entry; // first instruction
+  uint8_t arity;
+};
+
+// Owns everything values point to. Nothing is freed before the heap itself,
+// and nothing moves once allocated, so a heap can be moved but not copied
+class CBC_Heap {
+  std::deque<long long int> integers;
+  std::deque<std::string> strings;
+  std::deque<CBC_Array> arrays;
+  std::deque<CBC_Function> functions;
+
+  // Out of line so the VM's arithmetic stays small
+  CBC_Value box(long long int i);
+
+public:
+  CBC_Heap() = default;
+  CBC_Heap(const CBC_Heap &) = delete;
+  CBC_Heap &operator=(const CBC_Heap &) = delete;
+  CBC_Heap(CBC_Heap &&) = default;
+  CBC_Heap &operator=(CBC_Heap &&) = default;
+
+  // Boxes `i` only if it's too wide to be stored inline
+  CBC_Value integer(long long int i) {
+    if (CBC_Value::fits_small(i))
+      return CBC_Value::small_integer(i);
+    return this->box(i);
+  }
+  CBC_Value string(std::string_view s);
+  CBC_Value array(std::vector<CBC_Value> items);
+  CBC_Value function(std::string name, uint32_t entry, uint8_t arity);
+
+  size_t bytes() const;
+};
+
+std::ostream &operator<<(std::ostream &os, const CBC_Value &value);
+
+// Integer arithmetic wraps around instead of being undefined on overflow. The
+// VM and anything evaluating ahead of it both go through these
+inline long long int wrap_add(long long int a, long long int b) {
+  return (long long int)((unsigned long long)a + (unsigned long long)b);
+}
+inline long long int wrap_sub(long long int a, long long int b) {
+  return (long long int)((unsigned long long)a - (unsigned long long)b);
+}
+inline long long int wrap_mul(long long int a, long long int b) {
+  return (long long int)((unsigned long long)a * (unsigned long long)b);
+}
+
+// Literals and global names of one program. Equal literals share a single
+// constant and every global name gets a dense slot, so the VM keeps globals in
+// an array indexed by slot instead of hashing names while it runs.
+//
+// Strings and integers too wide to store inline live in `heap`, which is why
+// a pool can be moved but not copied
+class CBC_Pool {
+public:
+  std::vector<CBC_Value> constants;
+  std::vector<Symbol_Id> slots; // name of each global slot
+  CBC_Heap heap;
+
+  CBC_Pool() = default;
+  CBC_Pool(const CBC_Pool &) = delete;
+  CBC_Pool &operator=(const CBC_Pool &) = delete;
+  CBC_Pool(CBC_Pool &&) = default;
+  CBC_Pool &operator=(CBC_Pool &&) = default;
+
+  // These return the index of the constant, adding it if there isn't an equal
+  // one already. Floats are compared bit for bit, so `0.0` and `-0.0` differ
+  uint32_t integer(long long int i);
+  uint32_t floating(double f);
+  uint32_t string(std::string_view s);
+  uint32_t nil();
+
+  // Returns the slot of a global, adding one the first time a name is seen
+  uint32_t slot(Symbol_Id name);
+
+  // Returns the slot of a global without adding one
+  std::optional<uint32_t> find_slot(Symbol_Id name) const;
+
+  size_t bytes() const;
+
+private:
+  std::unordered_map<long long int, uint32_t> integer_index;
+  std::unordered_map<uint64_t, uint32_t> float_index;
+  std::unordered_map<std::string_view, uint32_t> string_index;
+  std::unordered_map<Symbol_Id, uint32_t> slot_index;
+  std::optional<uint32_t> nil_index;
+
+  uint32_t add(CBC_Value value);
+};
+
+// One encoded instruction. Registers are single bytes and anything wider
+// (constants, slots, jump targets, exit codes) goes in `k`
+//
+//   QUIT                        k = exit code
+//   STORE_CONST, STORE_VAR      a = source, k = slot
+//   LOAD_CONST                  a = destination, k = constant
+//   CALL, LOAD_GLOBAL           a = register, k = slot
+//   MOVE                        a = destination, b = source
+//   ADD ... NOT_EQUAL           a = destination, b = left, c = right
+//   JUMP                        k = target
+//   JUMP_IF_FALSE               a = condition, k = target
+//   SPILL, RELOAD               a = register, k = spill slot
+//   superinstructions           same as the first opcode they run
+struct CBC_Code {
+  CBC_Opcode op;
+  uint8_t a;
+  uint8_t b;
+  uint8_t c;
+  int32_t k;
+};
+
+static_assert(sizeof(CBC_Code) == 8, "CBC_Code should stay 8 bytes");
+
+// Read-only view of an array owned by something else, for code that may
+// live in a vector or straight in a mapped file
+template <typename T> class CBC_Span {
+  const T *first = nullptr;
+  size_t count = 0;
+
+public:
+  CBC_Span() = default;
+  CBC_Span(const T *first, size_t count) : first(first), count(count) {}
+  CBC_Span(const std::vector<T> &v) : first(v.data()), count(v.size()) {}
+
+  const T *data() const { return this->first; }
+  size_t size() const { return this->count; }
+  bool empty() const { return this->count == 0; }
+  const T *begin() const { return this->first; }
+  const T *end() const { return this->first + this->count; }
+  const T &back() const { return this->first[this->count - 1]; }
+  const T &operator[](size_t i) const { return this->first[i]; }
+};
+
+// One entry of a program's line table: the instructions from `pc` up to the
+// next entry were compiled from source line `line`
+struct CBC_Line {
+  uint32_t pc;
+  uint32_t line;
+};
+
+// A CBC program ready to run: flat encoded instructions plus the pool they
+// index into. Nothing in here owns heap memory per instruction. The code and
+// line table are either assembled in memory or used in place from a mapped
+// `.cbc` file, and moving a program keeps them where they are
+class CBC_Program {
+  std::vector<CBC_Code> assembled_code;
+  std::vector<CBC_Line> assembled_lines;
+  std::optional<Source_Buffer> file;
+
+public:
+  CBC_Span<CBC_Code> code;
+  CBC_Span<CBC_Line> lines;
+  CBC_Pool pool;
+  uint32_t spill_slots = 0;
+
+  // Encodes builder instructions against the pool they were built with.
+  // Prints the reason to stderr and returns `std::nullopt` if an operand
+  // doesn't fit its field or refers past the end of the pool
+  static std::optional<CBC_Program>
+  assemble(const std::vector<CBC_Instruction> &instructions, CBC_Pool pool);
+
+  // Writes the program to a `.cbc` file for `load()` to pick up next time.
+  // Prints the reason to stderr and returns false if it can't
+  bool save(const char *path, uint64_t source_hash, int level) const;
+
+  // Maps a `.cbc` file written by `save()` and runs its code from the
+  // mapping. Returns `std::nullopt` if there's no file, or if it was written
+  // from a different source, at a different level or for a different opcode
+  // set, in which case the program has to be compiled again. A file that's
+  // there but malformed also prints why to stderr
+  static std::optional<CBC_Program> load(const char *path, uint64_t source_hash,
+                                         int level);
+
+  // Expands one instruction back into its builder form, for printing
+  CBC_Instruction decode(size_t pc) const;
+
+  // Source line of an instruction, or 0 if the line table doesn't say
+  uint32_t line(size_t pc) const;
 
   void print() const;
+  void print_stats() const;
 };
 
-class CBC_Compiler {
+// What `.cbc` files remember the source by, so a stale one is never run
+uint64_t cbc_source_hash(std::string_view source);
+
+// What register allocation did to a compiled program
+struct CBC_Register_Stats {
+  size_t virtual_registers = 0;
+  size_t physical_registers = 0; // highest register used, plus one
+  size_t spilled = 0;            // virtual registers that got a spill slot
+  size_t spill_code = 0;         // SPILL and RELOAD instructions added
+
+  void print() const;
+};
+
+// No register is -1, for nodes that don't produce a value
+constexpr int CBC_NO_REGISTER = -1;
+
+class CBC_Peephole;
+
+// Fuses every run of instructions that matches a superinstruction, longest
+// first, and returns how many runs it fused
+size_t cbc_fuse(std::vector<CBC_Instruction> &program);
+
+// Compiles each value into a fresh virtual register, then hands the program
+// to `CBC_Register_Allocator` to map those onto physical ones. At `level` 1
+// `CBC_Peephole` cleans it up first, and at `level` 2 the allocated program
+// also gets superinstructions
+class CBC_Compiler : public AST_Visitor<CBC_Compiler, int> {
   std::vector<AST_Node *> &ast;
   std::vector<CBC_Instruction> program;
+  int level;
+  int virtual_registers = 0;
+  CBC_Register_Stats register_stats;
+  std::unique_ptr<CBC_Peephole> peephole;
+  size_t fused = 0;
+  int line = 0; // of the node being compiled, for the line table
 
   // The compiler won't take a reporter pointer because these are runtime errors
   // not compiler errors
 
 public:
-  CBC_Compiler(std::vector<AST_Node *> &ast);
-  // ~CBC_Compiler();
+  // Literals and globals referenced by `output()`
+  CBC_Pool pool;
+
+  // Set for modules something imports from, so that no store to a global is
+  // optimized away just because this program never reads it back
+  bool exported = false;
+
+  CBC_Compiler(std::vector<AST_Node *> &ast, int level = 0);
+  ~CBC_Compiler();
 
   void print_program() const;
+  void print_stats() const;
+  const std::vector<CBC_Instruction> &output() const;
 
-  void compile_node(AST_Node *n);
+  // Returns the register holding the value of `n`, or `CBC_NO_REGISTER`
+  int compile_node(AST_Node *n);
   int compile();
 
+  // Node types without a case here compile to nothing for now
+  int visit_node(AST_Node *node);
+  int visit_integer(AST_Integer *node);
+  int visit_float(AST_Float *node);
+  int visit_string(AST_String *node);
+  int visit_symbol(AST_Symbol *node);
+  int visit_binary(AST_Binary *node);
+  int visit_unary(AST_Unary *node);
+  int visit_grouping(AST_Grouping *node);
+  int visit_binding(AST_Binding *node);
+
 private:
   void add(CBC_Instruction &&i);
+  int new_register();
+  int load_constant(uint32_t k);
 
-  void binding_const(AST_Binding *node);
-  void load_integer(AST_Integer *node);
+  int binding_const(AST_Binding *node);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,314 @@
+#include "cbc.hpp"
+#include "source.hpp"
+#include "vm.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A `.cbc` file is one compiled program, laid out so that loading it is
+// mapping it, checking the header and pointing the program at its code:
+//
+//   header      `File_Header`, where every section starts and how long it is
+//   constants   one `File_Constant` per pool constant, in pool order
+//   symbols     one `File_String` per global slot, in slot order
+//   strings     the bytes of every string constant and global name
+//   code        the `CBC_Code` array, run straight from the mapping
+//   lines       the `CBC_Line` table, empty if the program has none
+//
+// Sections start on 8-byte boundaries. Everything is in the byte order of
+// the machine that wrote it, and a machine with the other order reads the
+// magic number wrong and treats the file as stale
+//
+// Whenever the layout changes, bump `CBC_FILE_VERSION`
+
+static constexpr uint32_t CBC_FILE_MAGIC = 0x1a434243; // "CBC\x1a"
+static constexpr uint16_t CBC_FILE_VERSION = 1;
+
+namespace {
+
+struct File_Section {
+  uint32_t offset; // from the start of the file
+  uint32_t count;  // entries, or bytes for `strings`
+};
+
+struct File_Header {
+  uint32_t magic;
+  uint16_t version;
+  uint8_t level; // `-O` level it was compiled at
+  uint8_t unused;
+  uint64_t source_hash;
+  uint64_t opcode_hash; // changes whenever superinstructions do
+  uint32_t spill_slots;
+  File_Section constants;
+  File_Section symbols;
+  File_Section strings;
+  File_Section code;
+  File_Section lines;
+};
+
+// Where a string is in the strings section
+struct File_String {
+  uint32_t offset;
+  uint32_t length;
+};
+
+// `value` holds an integer, the bits of a float or the offset of a string
+// with `length` bytes. Nil has neither
+struct File_Constant {
+  uint8_t type; // `CBC_Value::Type`
+  uint8_t unused[3];
+  uint32_t length;
+  uint64_t value;
+};
+
+} // namespace
+
+// FNV-1a
+static uint64_t fnv1a(uint64_t h, std::string_view bytes) {
+  for (char c : bytes) {
+    h ^= (uint8_t)c;
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+uint64_t cbc_source_hash(std::string_view source) {
+  return fnv1a(0xcbf29ce484222325ULL, source);
+}
+
+// Opcode numbers shift whenever `cbc_super.def` changes, so files remember
+// the whole list of names they were written against
+static uint64_t opcode_hash() {
+  std::ostringstream names;
+  for (size_t op = 0; op < N_CBC_OPCODES; op++)
+    names << (CBC_Opcode)op << ' ';
+  return cbc_source_hash(names.str());
+}
+
+// ---------------------------------------------------------------------
+// WRITING
+// ---------------------------------------------------------------------
+
+namespace {
+
+// Appends to the file in memory, keeping track of section offsets
+struct File_Writer {
+  std::string bytes;
+
+  template <typename T> void put(const T &value) {
+    this->bytes.append(reinterpret_cast<const char *>(&value), sizeof(T));
+  }
+
+  uint32_t align() {
+    this->bytes.resize((this->bytes.size() + 7) & ~(size_t)7, '\0');
+    return this->bytes.size();
+  }
+};
+
+} // namespace
+
+bool CBC_Program::save(const char *path, uint64_t source_hash,
+                       int level) const {
+  File_Header header = {};
+  header.magic = CBC_FILE_MAGIC;
+  header.version = CBC_FILE_VERSION;
+  header.level = level;
+  header.source_hash = source_hash;
+  header.opcode_hash = opcode_hash();
+  header.spill_slots = this->spill_slots;
+
+  std::string strings;
+  auto intern = [&](std::string_view s) {
+    File_String at = {(uint32_t)strings.size(), (uint32_t)s.size()};
+    strings.append(s);
+    return at;
+  };
+
+  File_Writer out;
+  out.put(header);
+
+  header.constants = {out.align(), (uint32_t)this->pool.constants.size()};
+  for (const CBC_Value &value : this->pool.constants) {
+    File_Constant c = {};
+    c.type = value.type();
+    switch (value.type()) {
+    case CBC_Value::Type::NIL:
+      break;
+    case CBC_Value::Type::INTEGER:
+      c.value = (uint64_t)value.as_integer();
+      break;
+    case CBC_Value::Type::FLOAT:
+      c.value = value.word();
+      break;
+    case CBC_Value::Type::STRING: {
+      File_String at = intern(*value.as_string());
+      c.value = at.offset;
+      c.length = at.length;
+      break;
+    }
+    default:
+      std::cerr << "Can't save a " << value << " constant to " << path
+                << std::endl;
+      return false;
+    }
+    out.put(c);
+  }
+
+  header.symbols = {out.align(), (uint32_t)this->pool.slots.size()};
+  for (Symbol_Id name : this->pool.slots)
+    out.put(intern(name.name()));
+
+  header.strings = {out.align(), (uint32_t)strings.size()};
+  out.bytes.append(strings);
+
+  header.code = {out.align(), (uint32_t)this->code.size()};
+  for (const CBC_Code &c : this->code)
+    out.put(c);
+
+  header.lines = {out.align(), (uint32_t)this->lines.size()};
+  for (const CBC_Line &l : this->lines)
+    out.put(l);
+
+  std::memcpy(out.bytes.data(), &header, sizeof(header));
+
+  // Written next to the real file and renamed over it, so a run that stops
+  // halfway never leaves a truncated file behind for the next one to map
+  std::string temporary = std::string(path) + ".tmp";
+  std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+  if (!file.write(out.bytes.data(), out.bytes.size()) || !file.flush()) {
+    std::cerr << "Could not write " << temporary << std::endl;
+    return false;
+  }
+  file.close();
+  if (std::rename(temporary.c_str(), path) != 0) {
+    std::cerr << "Could not replace " << path << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// ---------------------------------------------------------------------
+// LOADING
+// ---------------------------------------------------------------------
+
+std::optional<CBC_Program> CBC_Program::load(const char *path,
+                                             uint64_t source_hash, int level) {
+  std::error_code error;
+  if (!std::filesystem::is_regular_file(path, error))
+    return std::nullopt;
+  std::optional<Source_Buffer> file = Source_Buffer::open(path);
+  if (!file)
+    return std::nullopt;
+
+  const char *base = file->data();
+  size_t size = file->length();
+  File_Header header;
+  if (size < sizeof(header))
+    return std::nullopt;
+  std::memcpy(&header, base, sizeof(header));
+
+  if (header.magic != CBC_FILE_MAGIC || header.version != CBC_FILE_VERSION ||
+      header.source_hash != source_hash || header.level != level ||
+      header.opcode_hash != opcode_hash())
+    return std::nullopt;
+
+  auto malformed = [&](const char *why) {
+    std::cerr << "Ignoring malformed CBC file " << path << ": " << why
+              << std::endl;
+    return std::nullopt;
+  };
+
+  // Every section has to be aligned for its entries and fit in the file. The
+  // mapping itself starts on a page boundary, so offsets are all that matter
+  auto section = [&](const File_Section &s, size_t entry) -> const char * {
+    if (s.offset % 8 != 0 || s.offset > size ||
+        s.count > (size - s.offset) / entry)
+      return nullptr;
+    return base + s.offset;
+  };
+  const char *constants = section(header.constants, sizeof(File_Constant));
+  const char *symbols = section(header.symbols, sizeof(File_String));
+  const char *strings = section(header.strings, 1);
+  const char *code = section(header.code, sizeof(CBC_Code));
+  const char *lines = section(header.lines, sizeof(CBC_Line));
+  if (!constants || !symbols || !strings || !code || !lines)
+    return malformed("section out of bounds");
+
+  auto string = [&](uint64_t offset, uint32_t length)
+      -> std::optional<std::string_view> {
+    if (offset > header.strings.count ||
+        length > header.strings.count - offset)
+      return std::nullopt;
+    return std::string_view(strings + offset, length);
+  };
+
+  // Pools never hold two equal constants or two slots with the same name, so
+  // adding them back in order gives every one the index it was saved at
+  CBC_Program program;
+  for (uint32_t i = 0; i < header.symbols.count; i++) {
+    File_String s;
+    std::memcpy(&s, symbols + i * sizeof(s), sizeof(s));
+    std::optional<std::string_view> name = string(s.offset, s.length);
+    if (!name || program.pool.slot(Symbol_Id::intern(*name)) != i)
+      return malformed("bad symbol table");
+  }
+
+  for (uint32_t i = 0; i < header.constants.count; i++) {
+    File_Constant c;
+    std::memcpy(&c, constants + i * sizeof(c), sizeof(c));
+    CBC_Pool &pool = program.pool;
+    std::optional<uint32_t> index;
+    switch (c.type) {
+    case CBC_Value::Type::NIL:
+      index = pool.nil();
+      break;
+    case CBC_Value::Type::INTEGER:
+      index = pool.integer((long long int)c.value);
+      break;
+    case CBC_Value::Type::FLOAT: {
+      double f;
+      std::memcpy(&f, &c.value, sizeof(f));
+      index = pool.floating(f);
+      break;
+    }
+    case CBC_Value::Type::STRING:
+      if (std::optional<std::string_view> s = string(c.value, c.length))
+        index = pool.string(*s);
+      break;
+    default:
+      break;
+    }
+    if (index != i)
+      return malformed("bad constant pool");
+  }
+
+  program.code = CBC_Span<CBC_Code>(reinterpret_cast<const CBC_Code *>(code),
+                                    header.code.count);
+  program.lines = CBC_Span<CBC_Line>(reinterpret_cast<const CBC_Line *>(lines),
+                                     header.lines.count);
+  for (size_t i = 0; i < program.lines.size(); i++)
+    if (program.lines[i].pc >= program.code.size() ||
+        (i > 0 && program.lines[i].pc <= program.lines[i - 1].pc))
+      return malformed("bad line table");
+
+  // Every spill slot is used by at least one SPILL
+  if (header.spill_slots > program.code.size())
+    return malformed("too many spill slots");
+  program.spill_slots = header.spill_slots;
+
+  // The code is checked where it's mapped, the same way as a program that was
+  // just compiled. Catching it here means the file gets replaced
+  if (!CBC_VM(program).verify())
+    return malformed("bad code");
+
+  program.file = std::move(file);
+  return program;
+}
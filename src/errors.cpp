@@ -7,28 +7,52 @@
 #include <vector>
 
 Reporter::Reporter(const std::string file_name, const std::string path,
-                   const std::string &source)
-    : file_name(file_name), path(path), source(source) {}
+                   const Source_Map &source, bool echo)
+    : file_name(file_name), path(path), source(source), echo(echo) {}
 
 void Reporter::new_error(Error::Type type, size_t line, size_t start,
                          size_t end, Error::Flag flag, std::string message) {
-  std::cout << "Pushing a new error: " << type << std::endl;
+  this->push(new Error(type, line, start, end, flag, message));
+};
 
-  Error *error = new Error(type, line, start, end, flag, message);
-  std::cout << error->message << std::endl;
+void Reporter::push(Error *error) {
+  if (this->echo) {
+    std::cout << "Pushing a new error: " << error->type << std::endl;
+    std::cout << error->message << std::endl;
+  }
   this->errors.push_back(error);
-};
+}
+
+void Reporter::take_errors(Reporter &other) {
+  for (Error *error : other.errors)
+    this->push(error);
+  other.errors.clear();
+}
+
+void Reporter::new_error(Error::Type type, size_t start, size_t end,
+                         Error::Flag flag, std::string message) {
+  this->new_error(type, this->source.line(start), start, end, flag,
+                  std::move(message));
+}
+
+void Reporter::new_error(Error::Type type, const Token &tk, Error::Flag flag,
+                         std::string message) {
+  this->new_error(type, tk.offset, tk.end(), flag, std::move(message));
+}
 
 Error::Error(Type t, size_t line, size_t x0, size_t x1, Flag flag,
              std::string message)
     : type(t), line(line), x0(x0), x1(x1), flag(flag),
       message(std::move(message)) {}
 
+bool Reporter::has_errors() const { return !this->errors.empty(); }
+
 void Reporter::print_errors() const {
+  std::string_view source = this->source.source();
   int n_errors = 1;
   for (Error *e : this->errors) {
     // Do some bounds checking
-    if (e->x1 > this->source.length()) {
+    if (e->x1 > source.length()) {
       std::cerr << "ERROR End of error reporter substring is longer than "
                    "source code!"
                 << std::endl;
@@ -37,19 +61,19 @@ void Reporter::print_errors() const {
 
     // Getting the start and end of this line+
     size_t ln_start = 0;
-    size_t ln_end = this->source.length();
+    size_t ln_end = source.length();
 
     // Decrement backwards to find the beginning of this line
     for (size_t i = e->x0; i > 0; i--) {
-      if (this->source[i - 1] == '\n') {
+      if (source[i - 1] == '\n') {
         ln_start = i;
         break;
       }
     }
 
     // Increment to find the end of this line
-    for (size_t i = e->x1; i < this->source.length(); i++) {
-      if (this->source[i] == '\n')
+    for (size_t i = e->x1; i < source.length(); i++) {
+      if (source[i] == '\n')
         break;
       ln_end = i + 1;
     }
@@ -62,7 +86,7 @@ void Reporter::print_errors() const {
     }
 
     // Get the entire contents of the file
-    std::string buffer = this->source.substr(ln_start, ln_end - ln_start);
+    std::string_view buffer = source.substr(ln_start, ln_end - ln_start);
 
     // Get the whitespace for the underline output
     size_t ws_n = e->x0 - ln_start; // Difference from the start of the line to
@@ -90,6 +114,8 @@ std::ostream &operator<<(std::ostream &os, const Error::Type &t) {
       {Error::Type::SYNTAX_ERROR, "Syntax Error"},
       {Error::Type::NONTERMINATING_STRLITERAL,
        "Non-terminating String Literal"},
+      {Error::Type::INVALID_ESCAPE, "Invalid Escape Sequence"},
+      {Error::Type::NUMBER_OUT_OF_RANGE, "Number Out of Range"},
       {Error::Type::TOO_MANY_ARGS, "Too Many Arguments"},
       {Error::Type::TOO_MANY_PARAMS, "Too Many Parameters"},
       {Error::Type::TOO_MANY_MEMBERS, "Too Many Members"},
@@ -1,6 +1,7 @@
 #ifndef ERRORS_H
 #define ERRORS_H
 
+#include "token.hpp"
 #include <cstddef>
 #include <iostream>
 #include <map>
@@ -20,6 +21,8 @@ struct Error {
   enum Type {
     ILLEGAL_CHAR,
     NONTERMINATING_STRLITERAL,
+    INVALID_ESCAPE,
+    NUMBER_OUT_OF_RANGE,
     EXPECTED_EXPRESSION,
     SYNTAX_ERROR,
     TOO_MANY_PARAMS,
@@ -47,15 +50,35 @@ std::ostream &operator<<(std::ostream &os, const Error::Type &t);
 
 class Reporter {
   const std::string file_name, path;
-  const std::string &source;
+  const Source_Map &source;
   std::vector<Error *> errors;
+  bool echo; // print each error as it's pushed
 
 public:
+  // Without `echo`, errors are only collected, for reporters another one
+  // takes the errors of
   Reporter(const std::string file_name, const std::string path,
-           const std::string &source);
+           const Source_Map &source, bool echo = true);
   void new_error(Error::Type type, size_t line, size_t start, size_t end,
                  Error::Flag flag, std::string message);
+
+  // Underlines `[start, end]`, both offsets into the source, looking the line
+  // up through the source map
+  void new_error(Error::Type type, size_t start, size_t end, Error::Flag flag,
+                 std::string message);
+
+  // Underlines the whole of `tk`, looking the line up through the source map
+  void new_error(Error::Type type, const Token &tk, Error::Flag flag,
+                 std::string message);
   void print_errors() const;
+  bool has_errors() const;
+
+  // Moves every error of `other` over here, as if they had been pushed here in
+  // the first place. Both have to be reporting on the same source
+  void take_errors(Reporter &other);
+
+private:
+  void push(Error *error);
 };
 
 #endif
\ No newline at end of file
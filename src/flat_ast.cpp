@@ -0,0 +1,450 @@
+#include "flat_ast.hpp"
+#include "ast.hpp"
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// =================================================================
+// CONVERSION
+// =================================================================
+
+Flat_AST Flat_AST::from(Parse_Tree &tree) {
+  Flat_AST flat;
+  std::vector<AST_Node *> &nodes = tree.unpack();
+  flat.roots.reserve(nodes.size());
+
+  for (AST_Node *node : nodes)
+    flat.roots.push_back(flat.add(node));
+
+  return flat;
+}
+
+uint32_t Flat_AST::add_string(std::string_view s) {
+  this->strings.push_back(
+      Text{(uint32_t)this->text.size(), (uint32_t)s.size()});
+  this->text += s;
+  return this->strings.size() - 1;
+}
+
+uint32_t Flat_AST::add_list(const std::vector<uint32_t> &items) {
+  uint32_t offset = this->extra.size();
+  this->extra.push_back(items.size());
+  this->extra.insert(this->extra.end(), items.begin(), items.end());
+  return offset;
+}
+
+Node_Id Flat_AST::add_optional(const std::optional<AST_Node *> &node) {
+  if (!node)
+    return NO_NODE;
+  return this->add(node.value());
+}
+
+Node_Id Flat_AST::add(const AST_Node *node) {
+  // The parser leaves holes behind after a syntax error
+  if (node == nullptr)
+    return NO_NODE;
+
+  // Claim the id first so parents come before their children
+  Node_Id id = this->kinds.size();
+  this->kinds.push_back(node->type);
+  this->ops.push_back(0);
+  this->spans.push_back(Span{node->line, node->start, node->stop});
+  this->a.push_back(NO_NODE);
+  this->b.push_back(NO_NODE);
+  this->c.push_back(NO_NODE);
+
+  // Children are added into locals before being stored, since adding them
+  // grows the arrays underneath `this->a[id]` and friends
+  uint32_t a = NO_NODE, b = NO_NODE, c = NO_NODE;
+  uint8_t op = 0;
+
+  switch (node->type) {
+  case AST_Node::Type::Assignment: {
+    auto n = static_cast<const AST_Assignment *>(node);
+    op = n->op;
+    a = this->add(n->assignee);
+    b = this->add(n->value);
+    break;
+  }
+  case AST_Node::Type::String: {
+    a = this->add_string(static_cast<const AST_String *>(node)->text);
+    break;
+  }
+  case AST_Node::Type::Integer: {
+    auto n = static_cast<const AST_Integer *>(node);
+    op = n->base;
+    this->integers.push_back(n->value);
+    a = this->integers.size() - 1;
+    break;
+  }
+  case AST_Node::Type::Float: {
+    this->floats.push_back(static_cast<const AST_Float *>(node)->value);
+    a = this->floats.size() - 1;
+    break;
+  }
+  case AST_Node::Type::Symbol: {
+    a = static_cast<const AST_Symbol *>(node)->name.id();
+    break;
+  }
+  case AST_Node::Type::Binary: {
+    auto n = static_cast<const AST_Binary *>(node);
+    op = n->op;
+    a = this->add(n->left);
+    b = this->add(n->right);
+    break;
+  }
+  case AST_Node::Type::Logical: {
+    auto n = static_cast<const AST_Logical *>(node);
+    op = n->op;
+    a = this->add(n->left);
+    b = this->add(n->right);
+    break;
+  }
+  case AST_Node::Type::Unary: {
+    auto n = static_cast<const AST_Unary *>(node);
+    op = n->op;
+    a = this->add(n->operand);
+    break;
+  }
+  case AST_Node::Type::Call: {
+    auto n = static_cast<const AST_Call *>(node);
+    a = this->add(n->callee);
+    std::vector<uint32_t> args;
+    for (AST_Node *arg : n->args)
+      args.push_back(this->add(arg));
+    b = this->add_list(args);
+    break;
+  }
+  case AST_Node::Type::Parameter: {
+    auto n = static_cast<const AST_Parameter *>(node);
+    a = n->name.id();
+    b = this->add(n->type);
+    c = this->add_optional(n->initializer);
+    break;
+  }
+  case AST_Node::Type::Args:
+  case AST_Node::Type::Kwargs:
+    break;
+  case AST_Node::Type::Function: {
+    auto n = static_cast<const AST_Function *>(node);
+    std::vector<uint32_t> params;
+    for (AST_Parameter *p : n->params)
+      params.push_back(this->add(p));
+    a = this->add_list(params);
+    b = this->add_optional(n->return_type);
+    c = this->add(n->body);
+    break;
+  }
+  case AST_Node::Type::Grouping: {
+    a = this->add(static_cast<const AST_Grouping *>(node)->inner);
+    break;
+  }
+  case AST_Node::Type::Lookup: {
+    auto n = static_cast<const AST_Lookup *>(node);
+    a = this->add(n->left);
+    b = this->add(n->right);
+    break;
+  }
+  case AST_Node::Type::Block: {
+    std::vector<uint32_t> nodes;
+    for (AST_Node *n : static_cast<const AST_Block *>(node)->nodes)
+      nodes.push_back(this->add(n));
+    a = this->add_list(nodes);
+    break;
+  }
+  case AST_Node::Type::Array_Literal: {
+    std::vector<uint32_t> elems;
+    for (AST_Node *n : static_cast<const AST_Array_Literal *>(node)->elems)
+      elems.push_back(this->add(n));
+    a = this->add_list(elems);
+    break;
+  }
+  case AST_Node::Type::Matrix_Literal:
+    // The parser doesn't produce these yet
+    break;
+  case AST_Node::Type::Binding: {
+    auto n = static_cast<const AST_Binding *>(node);
+    op = n->mut;
+    a = n->symbol.id();
+    b = this->add_optional(n->initializer);
+    break;
+  }
+  case AST_Node::Type::If_Stmt: {
+    auto n = static_cast<const AST_If_Stmt *>(node);
+    a = this->add(n->condition);
+    b = this->add(n->branch_if);
+    c = this->add_optional(n->branch_else);
+    break;
+  }
+  case AST_Node::Type::Return: {
+    a = this->add_optional(static_cast<const AST_Return *>(node)->value);
+    break;
+  }
+  case AST_Node::Type::Enum_Decl: {
+    auto n = static_cast<const AST_Enum_Decl *>(node);
+    a = n->symbol.id();
+    std::vector<uint32_t> variants;
+    for (Symbol_Id v : n->variants)
+      variants.push_back(v.id());
+    b = this->add_list(variants);
+    break;
+  }
+  case AST_Node::Type::Import: {
+    auto n = static_cast<const AST_Import *>(node);
+    a = n->module.id();
+    if (n->alias)
+      b = n->alias->id();
+    std::vector<uint32_t> items;
+    for (Symbol_Id item : n->items)
+      items.push_back(item.id());
+    c = this->add_list(items);
+    break;
+  }
+  }
+
+  this->ops[id] = op;
+  this->a[id] = a;
+  this->b[id] = b;
+  this->c[id] = c;
+  return id;
+}
+
+// =================================================================
+// ACCESS
+// =================================================================
+
+size_t Flat_AST::size() const { return this->kinds.size(); }
+
+Flat_AST::List Flat_AST::list(uint32_t offset) const {
+  return List{&this->extra[offset + 1], this->extra[offset]};
+}
+
+std::string_view Flat_AST::string(uint32_t index) const {
+  Text t = this->strings[index];
+  return std::string_view(this->text).substr(t.offset, t.length);
+}
+
+std::string_view Flat_AST::name(uint32_t id) const {
+  return Symbol_Id::from_id(id).name();
+}
+
+size_t Flat_AST::bytes() const {
+  return this->kinds.size() * sizeof(AST_Node::Type) +
+         this->ops.size() * sizeof(uint8_t) +
+         this->spans.size() * sizeof(Span) +
+         (this->a.size() + this->b.size() + this->c.size() +
+          this->extra.size() + this->roots.size()) *
+             sizeof(uint32_t) +
+         this->integers.size() * sizeof(long long int) +
+         this->floats.size() * sizeof(double) +
+         this->strings.size() * sizeof(Text) + this->text.size();
+}
+
+// =================================================================
+// PRINTING
+// =================================================================
+
+// Prints the same markup as `Parse_Tree::print()` so the two can be diffed
+
+void Flat_AST::print() const {
+  for (Node_Id root : this->roots)
+    this->print_node(root, 0);
+}
+
+void Flat_AST::print_stats() const {
+  std::cout << "[flat] " << this->size() << " nodes, " << this->bytes()
+            << " bytes" << std::endl;
+}
+
+void Flat_AST::print_node(Node_Id id, int indent) const {
+  if (id == NO_NODE)
+    return;
+
+  std::string spaces = std::string(indent, ' ');
+  uint32_t a = this->a[id], b = this->b[id], c = this->c[id];
+  AST_Op op = static_cast<AST_Op>(this->ops[id]);
+
+  switch (this->kinds[id]) {
+  case AST_Node::Type::Assignment: {
+    std::cout << spaces << "<Assignment>\n";
+    this->print_node(a, indent + 2);
+    std::cout << spaces << "  <Op> " << op << " </Op>\n";
+    this->print_node(b, indent + 2);
+    std::cout << spaces << "</Assignment>" << std::endl;
+    break;
+  }
+  case AST_Node::Type::String: {
+    std::cout << spaces << "<String> \"" << this->string(a) << "\" </String>"
+              << std::endl;
+    break;
+  }
+  case AST_Node::Type::Integer: {
+    const char *tag = "Integer";
+    if (this->ops[id] == 8)
+      tag = "Octal";
+    else if (this->ops[id] == 2)
+      tag = "Binary";
+    else if (this->ops[id] == 16)
+      tag = "Hex";
+    std::cout << spaces << "<" << tag << "> " << this->integers[a] << " </"
+              << tag << ">" << std::endl;
+    break;
+  }
+  case AST_Node::Type::Float: {
+    std::cout << spaces << "<Float> " << this->floats[a] << " </Float>"
+              << std::endl;
+    break;
+  }
+  case AST_Node::Type::Symbol: {
+    std::cout << spaces << "<Symbol> " << this->name(a) << " </Symbol>"
+              << std::endl;
+    break;
+  }
+  case AST_Node::Type::Binary:
+  case AST_Node::Type::Logical: {
+    const char *tag =
+        this->kinds[id] == AST_Node::Type::Binary ? "Binary" : "Logical";
+    std::cout << spaces << "<" << tag << ">\n";
+    this->print_node(a, indent + 2);
+    std::cout << spaces << "  <Op> " << op << " </Op>\n";
+    this->print_node(b, indent + 2);
+    std::cout << spaces << "</" << tag << ">" << std::endl;
+    break;
+  }
+  case AST_Node::Type::Unary: {
+    std::cout << spaces << "<Unary>\n";
+    this->print_node(a, indent + 2);
+    std::cout << spaces << "  <Op> " << op << " </Op>\n";
+    std::cout << spaces << "</Unary>" << std::endl;
+    break;
+  }
+  case AST_Node::Type::Call: {
+    std::cout << spaces << "<Call>\n";
+    this->print_node(a, indent + 2);
+    std::cout << spaces << "  <Args>\n";
+    for (Node_Id arg : this->list(b))
+      this->print_node(arg, indent + 4);
+    std::cout << spaces << "  </Args>\n";
+    std::cout << spaces << "</Call>" << std::endl;
+    break;
+  }
+  case AST_Node::Type::Parameter: {
+    std::cout << spaces << "<Parameter>\n";
+    std::cout << spaces << "  <Name> " << this->name(a) << " </Name>\n";
+    this->print_node(b, indent + 2);
+    if (c != NO_NODE) {
+      std::cout << spaces << "  <Initializer>\n";
+      this->print_node(c, indent + 4);
+      std::cout << spaces << "  </Initializer>";
+    }
+    std::cout << spaces << "</Parameter>" << std::endl;
+    break;
+  }
+  case AST_Node::Type::Args: {
+    std::cout << spaces << "<*Args/>" << std::endl;
+    break;
+  }
+  case AST_Node::Type::Kwargs: {
+    std::cout << spaces << "<**Kwargs/>" << std::endl;
+    break;
+  }
+  case AST_Node::Type::Function: {
+    std::cout << spaces << "<Function>\n";
+    std::cout << spaces << "  <Params>\n";
+    for (Node_Id p : this->list(a))
+      this->print_node(p, indent + 4);
+    std::cout << spaces << "  </Params>\n";
+    if (b != NO_NODE) {
+      std::cout << spaces << "  <Return Type>\n";
+      this->print_node(b, indent + 4);
+      std::cout << spaces << "  </Return Type>\n";
+    }
+    std::cout << spaces << "  <Body>\n";
+    this->print_node(c, indent + 4);
+    std::cout << spaces << "  </Body>" << std::endl;
+    break;
+  }
+  case AST_Node::Type::Grouping: {
+    std::cout << spaces << "<Grouping>\n";
+    this->print_node(a, indent + 2);
+    std::cout << spaces << "</Grouping>" << std::endl;
+    break;
+  }
+  case AST_Node::Type::Lookup: {
+    std::cout << spaces << "<Lookup>\n";
+    this->print_node(a, indent + 2);
+    this->print_node(b, indent + 2);
+    std::cout << spaces << "</Lookup>" << std::endl;
+    break;
+  }
+  case AST_Node::Type::Block: {
+    std::cout << spaces << "<Block>\n";
+    for (Node_Id n : this->list(a))
+      this->print_node(n, indent + 2);
+    std::cout << spaces << "</Block>" << std::endl;
+    break;
+  }
+  case AST_Node::Type::Array_Literal: {
+    std::cout << spaces << "<Array>\n";
+    for (Node_Id n : this->list(a))
+      this->print_node(n, indent + 2);
+    std::cout << spaces << "</Array>" << std::endl;
+    break;
+  }
+  case AST_Node::Type::Matrix_Literal:
+    break;
+  case AST_Node::Type::Binding: {
+    std::cout << spaces << "<Binding>\n";
+    std::cout << spaces << "  <Name> " << this->name(a) << " </Name>\n";
+    std::cout << spaces << "  <Mutable?> " << (this->ops[id] != 0)
+              << " </Mutable?>\n";
+    if (b != NO_NODE) {
+      std::cout << spaces << "  <Initializer>\n";
+      this->print_node(b, indent + 4);
+      std::cout << spaces << "  </Initializer>\n";
+    }
+    std::cout << spaces << "</Binding>" << std::endl;
+    break;
+  }
+  case AST_Node::Type::If_Stmt: {
+    std::cout << spaces << "<If>\n";
+    std::cout << spaces << "  <Condition>\n";
+    this->print_node(a, indent + 4);
+    std::cout << spaces << "  </Condition>\n";
+    std::cout << spaces << "  <True Branch>\n";
+    this->print_node(b, indent + 4);
+    std::cout << spaces << "  </True Branch>\n";
+    if (c != NO_NODE) {
+      std::cout << spaces << "  <Else Branch>\n";
+      this->print_node(c, indent + 4);
+      std::cout << spaces << "  </Else Branch>\n";
+    }
+    std::cout << spaces << "</If>\n";
+    break;
+  }
+  case AST_Node::Type::Return: {
+    std::cout << spaces << "<Return>\n";
+    this->print_node(a, indent + 2);
+    std::cout << spaces << "</Return>" << std::endl;
+    break;
+  }
+  case AST_Node::Type::Enum_Decl: {
+    std::cout << spaces << "<Enum>\n";
+    for (uint32_t v : this->list(b))
+      std::cout << spaces << "  <Variant> " << this->name(v) << "</Variant>";
+    std::cout << spaces << "</Enum>" << std::endl;
+    break;
+  }
+  case AST_Node::Type::Import: {
+    std::cout << spaces << "<Import>\n";
+    std::cout << spaces << "  <Module> " << this->name(a) << " </Module>\n";
+    if (b != NO_NODE)
+      std::cout << spaces << "  <As> " << this->name(b) << " </As>\n";
+    for (uint32_t item : this->list(c))
+      std::cout << spaces << "  <Item> " << this->name(item) << " </Item>\n";
+    std::cout << spaces << "</Import>" << std::endl;
+    break;
+  }
+  }
+}
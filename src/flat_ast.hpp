@@ -0,0 +1,110 @@
+#ifndef FLAT_AST_H
+#define FLAT_AST_H
+
+#include "ast.hpp"
+#include "symbol.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Index of a node in a `Flat_AST`. Nodes refer to their children by id rather
+// than by pointer, so the whole tree is a handful of plain arrays
+typedef uint32_t Node_Id;
+constexpr Node_Id NO_NODE = UINT32_MAX;
+
+// Struct-of-arrays copy of a `Parse_Tree`. Node `i` is `kinds[i]`, `ops[i]`,
+// `spans[i]` and up to three operands `a[i]`, `b[i]`, `c[i]`, whose meaning
+// depends on the kind:
+//
+//   Assignment       op, a = assignee, b = value
+//   String           a = string index
+//   Symbol           a = name
+//   Integer          op = base, a = index into `integers`
+//   Float            a = index into `floats`
+//   Binary, Logical  op, a = left, b = right
+//   Unary            op, a = operand
+//   Call             a = callee, b = list of arguments
+//   Parameter        a = name, b = type, c = initializer
+//   Args, Kwargs     nothing
+//   Function         a = list of parameters, b = return type, c = body
+//   Grouping         a = inner
+//   Lookup           a = left, b = right
+//   Block            a = list of statements
+//   Array_Literal    a = list of elements
+//   Binding          op = mutable?, a = name, b = initializer
+//   If_Stmt          a = condition, b = true branch, c = else branch
+//   Return           a = value
+//   Enum_Decl        a = name, b = list of variant names
+//   Import           a = module name, b = alias name, c = list of item names
+//
+// A list operand is an offset into `extra`, where the list is stored as its
+// length followed by its elements. A string index picks an entry of `strings`,
+// which is a slice of the shared `text` buffer. A name is the id of its
+// `Symbol_Id`. Missing children are `NO_NODE`.
+//
+// Ids are handed out in pre-order, so a parent always comes before its
+// children and the top-level statements are walked in source order
+class Flat_AST {
+public:
+  struct Span {
+    int32_t line;
+    int32_t start;
+    int32_t stop;
+  };
+
+  struct Text {
+    uint32_t offset;
+    uint32_t length;
+  };
+
+  // The elements of one list operand
+  struct List {
+    const uint32_t *first;
+    uint32_t count;
+
+    const uint32_t *begin() const { return this->first; }
+    const uint32_t *end() const { return this->first + this->count; }
+  };
+
+  std::vector<AST_Node::Type> kinds;
+  std::vector<uint8_t> ops;
+  std::vector<Span> spans;
+  std::vector<uint32_t> a;
+  std::vector<uint32_t> b;
+  std::vector<uint32_t> c;
+
+  std::vector<uint32_t> extra;
+  std::vector<long long int> integers;
+  std::vector<double> floats;
+  std::vector<Text> strings;
+  std::string text;
+
+  std::vector<Node_Id> roots;
+
+  // Converts every top-level node of `tree`. The tree can be dropped
+  // afterwards, nothing here points back into it
+  static Flat_AST from(Parse_Tree &tree);
+
+  size_t size() const;
+  List list(uint32_t offset) const;
+  std::string_view string(uint32_t index) const;
+  std::string_view name(uint32_t id) const;
+
+  // Bytes held by all of the arrays, including string contents
+  size_t bytes() const;
+
+  void print() const;
+  void print_stats() const;
+
+private:
+  Node_Id add(const AST_Node *node);
+  Node_Id add_optional(const std::optional<AST_Node *> &node);
+  uint32_t add_string(std::string_view s);
+  uint32_t add_list(const std::vector<uint32_t> &items);
+
+  void print_node(Node_Id id, int indent) const;
+};
+
+#endif
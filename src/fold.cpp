@@ -0,0 +1,420 @@
+#include "fold.hpp"
+#include "ast.hpp"
+#include "cbc.hpp"
+#include <cmath>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Calls `f` on every child slot of `node`, so that `f` can replace children.
+// The right side of a lookup, assignment targets and type annotations are
+// names rather than values, so they're skipped
+template <typename F> static void for_each_child(AST_Node *node, F &&f) {
+  switch (node->type) {
+  case AST_Node::Type::Assignment:
+    f(static_cast<AST_Assignment *>(node)->value);
+    break;
+  case AST_Node::Type::Binary: {
+    AST_Binary *n = static_cast<AST_Binary *>(node);
+    f(n->left);
+    f(n->right);
+    break;
+  }
+  case AST_Node::Type::Logical: {
+    AST_Logical *n = static_cast<AST_Logical *>(node);
+    f(n->left);
+    f(n->right);
+    break;
+  }
+  case AST_Node::Type::Unary:
+    f(static_cast<AST_Unary *>(node)->operand);
+    break;
+  case AST_Node::Type::Call: {
+    AST_Call *n = static_cast<AST_Call *>(node);
+    f(n->callee);
+    for (AST_Node *&arg : n->args)
+      f(arg);
+    break;
+  }
+  case AST_Node::Type::Parameter: {
+    AST_Parameter *n = static_cast<AST_Parameter *>(node);
+    if (n->initializer)
+      f(*n->initializer);
+    break;
+  }
+  case AST_Node::Type::Function: {
+    AST_Function *n = static_cast<AST_Function *>(node);
+    for (AST_Parameter *param : n->params) {
+      AST_Node *p = param;
+      f(p);
+    }
+    f(n->body);
+    break;
+  }
+  case AST_Node::Type::Grouping:
+    f(static_cast<AST_Grouping *>(node)->inner);
+    break;
+  case AST_Node::Type::Lookup:
+    f(static_cast<AST_Lookup *>(node)->left);
+    break;
+  case AST_Node::Type::Block:
+    for (AST_Node *&n : static_cast<AST_Block *>(node)->nodes)
+      f(n);
+    break;
+  case AST_Node::Type::Array_Literal:
+    for (AST_Node *&n : static_cast<AST_Array_Literal *>(node)->elems)
+      f(n);
+    break;
+  case AST_Node::Type::Binding: {
+    AST_Binding *n = static_cast<AST_Binding *>(node);
+    if (n->initializer)
+      f(*n->initializer);
+    break;
+  }
+  case AST_Node::Type::If_Stmt: {
+    AST_If_Stmt *n = static_cast<AST_If_Stmt *>(node);
+    f(n->condition);
+    f(n->branch_if);
+    if (n->branch_else)
+      f(*n->branch_else);
+    break;
+  }
+  case AST_Node::Type::Return: {
+    AST_Return *n = static_cast<AST_Return *>(node);
+    if (n->value)
+      f(*n->value);
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+static bool is_literal(const AST_Node *node) {
+  return node != nullptr && (node->type == AST_Node::Type::Integer ||
+                             node->type == AST_Node::Type::Float ||
+                             node->type == AST_Node::Type::String);
+}
+
+// The value of a numeric literal
+struct Number {
+  bool is_float;
+  long long int i;
+  double f;
+
+  double as_float() const { return this->is_float ? this->f : (double)this->i; }
+};
+
+static std::optional<Number> number(AST_Node *node) {
+  if (AST_Integer *n = node_cast<AST_Integer>(node))
+    return Number{false, n->value, 0.0};
+  if (AST_Float *n = node_cast<AST_Float>(node))
+    return Number{true, 0, n->value};
+  return std::nullopt;
+}
+
+// ---------------------------------------------------------------------
+// DRIVER
+// ---------------------------------------------------------------------
+
+AST_Folder::AST_Folder(Parse_Tree &tree) : tree(tree) {}
+
+void AST_Folder::run() {
+  std::vector<AST_Node *> &nodes = this->tree.unpack();
+  for (AST_Node *node : nodes)
+    this->count(node);
+
+  this->scopes.emplace_back();
+  for (AST_Node *&node : nodes)
+    node = this->fold(node);
+  this->scopes.clear();
+}
+
+void AST_Folder::print_stats() const {
+  std::cout << "[fold] " << this->folded << " folded, " << this->propagated
+            << " propagated, " << this->pruned << " if statement(s) pruned"
+            << std::endl;
+}
+
+void AST_Folder::count(AST_Node *node) {
+  if (node == nullptr)
+    return;
+
+  switch (node->type) {
+  case AST_Node::Type::Binding:
+    this->bound[static_cast<AST_Binding *>(node)->symbol]++;
+    break;
+  case AST_Node::Type::Assignment:
+    if (AST_Symbol *target = node_cast<AST_Symbol>(
+            static_cast<AST_Assignment *>(node)->assignee))
+      this->bound[target->name]++;
+    break;
+  case AST_Node::Type::Parameter:
+  case AST_Node::Type::Args:
+  case AST_Node::Type::Kwargs:
+    this->bound[static_cast<AST_Parameter *>(node)->name]++;
+    break;
+  case AST_Node::Type::Enum_Decl:
+    this->bound[static_cast<AST_Enum_Decl *>(node)->symbol]++;
+    break;
+  case AST_Node::Type::Import: {
+    auto import = static_cast<AST_Import *>(node);
+    for (Symbol_Id item : import->items)
+      this->bound[item]++;
+    this->bound[import->alias.value_or(import->module)]++;
+    break;
+  }
+  default:
+    break;
+  }
+
+  for_each_child(node, [&](AST_Node *&child) { this->count(child); });
+}
+
+// Children first, so every rule below only has to look one level down
+AST_Node *AST_Folder::fold(AST_Node *node) {
+  if (node == nullptr)
+    return nullptr;
+
+  // Folds its own children, so that a dead branch is never looked at
+  if (node->type == AST_Node::Type::If_Stmt)
+    return this->visit(node);
+
+  bool block = node->type == AST_Node::Type::Block;
+  if (block)
+    this->scopes.emplace_back();
+  for_each_child(node, [&](AST_Node *&child) { child = this->fold(child); });
+  if (block)
+    this->scopes.pop_back();
+
+  return this->visit(node);
+}
+
+AST_Node *AST_Folder::copy_literal(AST_Node *literal, AST_Node *at) {
+  switch (literal->type) {
+  case AST_Node::Type::Integer: {
+    AST_Integer *n = static_cast<AST_Integer *>(literal);
+    return this->tree.make<AST_Integer>(n->value, n->base, at->line, at->start,
+                                        at->stop);
+  }
+  case AST_Node::Type::Float:
+    return this->tree.make<AST_Float>(static_cast<AST_Float *>(literal)->value,
+                                      at->line, at->start, at->stop);
+  default:
+    AST_String *s = static_cast<AST_String *>(literal);
+    return this->tree.make<AST_String>(s->text, s->escaped, at->line,
+                                       at->start, at->stop);
+  }
+}
+
+// ---------------------------------------------------------------------
+// RULES
+// ---------------------------------------------------------------------
+
+AST_Node *AST_Folder::visit_node(AST_Node *node) { return node; }
+
+AST_Node *AST_Folder::visit_symbol(AST_Symbol *node) {
+  for (auto scope = this->scopes.rbegin(); scope != this->scopes.rend();
+       scope++) {
+    auto found = scope->find(node->name);
+    if (found != scope->end()) {
+      this->propagated++;
+      return this->copy_literal(found->second, node);
+    }
+  }
+  return node;
+}
+
+AST_Node *AST_Folder::visit_binary(AST_Binary *node) {
+  std::optional<Number> a = number(node->left);
+  std::optional<Number> b = number(node->right);
+  if (!a || !b)
+    return node;
+
+  auto integer = [&](long long int value) -> AST_Node * {
+    this->folded++;
+    return this->tree.make<AST_Integer>(value, 10, node->line, node->start,
+                                        node->stop);
+  };
+  auto floating = [&](double value) -> AST_Node * {
+    this->folded++;
+    return this->tree.make<AST_Float>(value, node->line, node->start,
+                                      node->stop);
+  };
+
+  // Integers stay integers, anything mixed with a float becomes a float
+  bool ints = !a->is_float && !b->is_float;
+  double x = a->as_float();
+  double y = b->as_float();
+  switch (node->op) {
+  case AST_Op::ADD:
+    return ints ? integer(wrap_add(a->i, b->i)) : floating(x + y);
+  case AST_Op::SUBTRACT:
+    return ints ? integer(wrap_sub(a->i, b->i)) : floating(x - y);
+  case AST_Op::MULTIPLY:
+    return ints ? integer(wrap_mul(a->i, b->i)) : floating(x * y);
+  case AST_Op::DIVIDE:
+    if (!ints)
+      return floating(x / y);
+    if (b->i == 0)
+      return node;
+    return integer(b->i == -1 ? wrap_sub(0, a->i) : a->i / b->i);
+  case AST_Op::MODULUS:
+    if (!ints)
+      return floating(std::fmod(x, y));
+    if (b->i == 0)
+      return node;
+    return integer(b->i == -1 ? 0 : a->i % b->i);
+  default:
+    return node;
+  }
+}
+
+AST_Node *AST_Folder::visit_unary(AST_Unary *node) {
+  std::optional<Number> a = number(node->operand);
+  if (!a || node->op != AST_Op::SUBTRACT)
+    return node;
+
+  this->folded++;
+  if (a->is_float)
+    return this->tree.make<AST_Float>(-a->f, node->line, node->start,
+                                      node->stop);
+  return this->tree.make<AST_Integer>(wrap_sub(0, a->i), 10, node->line,
+                                      node->start, node->stop);
+}
+
+// `and` and `or` short circuit to whichever operand decides them, so a known
+// left side picks one operand without evaluating anything
+AST_Node *AST_Folder::visit_logical(AST_Logical *node) {
+  if (!is_literal(node->left))
+    return node;
+  bool left = *this->truth(node->left);
+
+  switch (node->op) {
+  case AST_Op::LOGICAL_AND:
+    this->folded++;
+    return left ? node->right : node->left;
+  case AST_Op::LOGICAL_OR:
+    this->folded++;
+    return left ? node->left : node->right;
+  default:
+    return node;
+  }
+}
+
+AST_Node *AST_Folder::visit_grouping(AST_Grouping *node) {
+  if (!is_literal(node->inner))
+    return node;
+  this->folded++;
+  return node->inner;
+}
+
+// The binding itself stays, the global still has to exist at runtime
+AST_Node *AST_Folder::visit_binding(AST_Binding *node) {
+  if (!node->mut && node->initializer && is_literal(*node->initializer) &&
+      this->bound[node->symbol] == 1)
+    this->scopes.back()[node->symbol] = *node->initializer;
+  return node;
+}
+
+AST_Node *AST_Folder::visit_if_stmt(AST_If_Stmt *node) {
+  node->condition = this->fold(node->condition);
+  std::optional<bool> taken = this->truth(node->condition);
+  if (!taken) {
+    node->branch_if = this->fold(node->branch_if);
+    if (node->branch_else)
+      node->branch_else = this->fold(*node->branch_else);
+    return node;
+  }
+
+  this->pruned++;
+  if (*taken)
+    return this->fold(node->branch_if);
+  if (node->branch_else)
+    return this->fold(*node->branch_else);
+  return this->tree.make<AST_Block>(node->line, node->start, node->stop);
+}
+
+// Same rules as the VM: false, nil and zero are false. Comparing a string with
+// anything but `==` or `!=` is a runtime error, so it isn't known here
+std::optional<bool> AST_Folder::truth(AST_Node *node) {
+  if (node == nullptr)
+    return std::nullopt;
+
+  switch (node->type) {
+  case AST_Node::Type::Integer:
+    return static_cast<AST_Integer *>(node)->value != 0;
+  case AST_Node::Type::Float:
+    return static_cast<AST_Float *>(node)->value != 0.0;
+  case AST_Node::Type::String:
+    return true;
+  case AST_Node::Type::Grouping:
+    return this->truth(static_cast<AST_Grouping *>(node)->inner);
+  case AST_Node::Type::Unary: {
+    AST_Unary *n = static_cast<AST_Unary *>(node);
+    std::optional<bool> operand = this->truth(n->operand);
+    if (n->op == AST_Op::COMP_NOT && operand)
+      return !*operand;
+    return std::nullopt;
+  }
+  case AST_Node::Type::Logical: {
+    AST_Logical *n = static_cast<AST_Logical *>(node);
+    std::optional<bool> left = this->truth(n->left);
+    if (!left)
+      return std::nullopt;
+    if (n->op == AST_Op::LOGICAL_AND)
+      return *left ? this->truth(n->right) : false;
+    if (n->op == AST_Op::LOGICAL_OR)
+      return *left ? true : this->truth(n->right);
+    return std::nullopt;
+  }
+  case AST_Node::Type::Binary:
+    break;
+  default:
+    return std::nullopt;
+  }
+
+  AST_Binary *n = static_cast<AST_Binary *>(node);
+  std::optional<Number> a = number(n->left);
+  std::optional<Number> b = number(n->right);
+
+  if (!a || !b) {
+    // Equality is still known between strings, or a string and a number
+    if (!is_literal(n->left) || !is_literal(n->right))
+      return std::nullopt;
+    AST_String *x = node_cast<AST_String>(n->left);
+    AST_String *y = node_cast<AST_String>(n->right);
+    bool equal = x && y &&
+                 (x->escaped || y->escaped ? x->value() == y->value()
+                                           : x->text == y->text);
+    if (n->op == AST_Op::COMP_EQUAL)
+      return equal;
+    if (n->op == AST_Op::COMP_NOT_EQUAL)
+      return !equal;
+    return std::nullopt;
+  }
+
+  bool ints = !a->is_float && !b->is_float;
+  int order = ints ? (a->i > b->i) - (a->i < b->i)
+                   : (a->as_float() > b->as_float()) -
+                         (a->as_float() < b->as_float());
+  bool equal = ints ? a->i == b->i : a->as_float() == b->as_float();
+
+  switch (n->op) {
+  case AST_Op::COMP_EQUAL:
+    return equal;
+  case AST_Op::COMP_NOT_EQUAL:
+    return !equal;
+  case AST_Op::COMP_LESS:
+    return order < 0;
+  case AST_Op::COMP_LESS_EQUAL:
+    return order < 0 || equal;
+  case AST_Op::COMP_MORE:
+    return order > 0;
+  case AST_Op::COMP_MORE_EQUAL:
+    return order > 0 || equal;
+  default:
+    return std::nullopt;
+  }
+}
@@ -0,0 +1,69 @@
+#ifndef FOLD_H
+#define FOLD_H
+
+#include "ast.hpp"
+#include "symbol.hpp"
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Compile-time evaluation over a parsed tree, run between `Parser::parse()`
+// and `CBC_Compiler::compile()`. Replaced nodes are left in the arena, the
+// tree just stops pointing at them
+//
+//   - `AST_Binary`, `AST_Unary` and `AST_Logical` over literals become the
+//     literal they evaluate to, with the same wrapping and division rules as
+//     the VM. Anything the VM would fail on at runtime, like dividing by zero,
+//     is left alone so it still fails there
+//   - `AST_Grouping` around a literal becomes the literal
+//   - An immutable `AST_Binding` to a literal makes later reads of the name in
+//     the same or an inner block read the literal instead. Only names that are
+//     bound once in the whole tree qualify, so shadowing and rebinding can't
+//     make this wrong
+//   - An `AST_If_Stmt` with a known condition becomes the branch it takes
+//
+// There is no boolean literal node, so comparisons are only evaluated where
+// just their truth matters, which is the condition of an if statement
+class AST_Folder : public AST_Visitor<AST_Folder, AST_Node *> {
+  Parse_Tree &tree;
+
+  // How many times each name is bound anywhere, by bindings, assignments,
+  // parameters, enum declarations or imports
+  std::unordered_map<Symbol_Id, size_t> bound;
+
+  // Literal value of each propagated name, innermost block last
+  std::vector<std::unordered_map<Symbol_Id, AST_Node *>> scopes;
+
+public:
+  size_t folded = 0;     // operators and groupings replaced by a literal
+  size_t propagated = 0; // names replaced by the literal bound to them
+  size_t pruned = 0;     // if statements replaced by the branch they take
+
+  AST_Folder(Parse_Tree &tree);
+
+  void run();
+  void print_stats() const;
+
+  AST_Node *visit_node(AST_Node *node);
+  AST_Node *visit_symbol(AST_Symbol *node);
+  AST_Node *visit_binary(AST_Binary *node);
+  AST_Node *visit_unary(AST_Unary *node);
+  AST_Node *visit_logical(AST_Logical *node);
+  AST_Node *visit_grouping(AST_Grouping *node);
+  AST_Node *visit_binding(AST_Binding *node);
+  AST_Node *visit_if_stmt(AST_If_Stmt *node);
+
+private:
+  AST_Node *fold(AST_Node *node);
+  void count(AST_Node *node);
+
+  // Whether a folded node is known to be true or false
+  std::optional<bool> truth(AST_Node *node);
+
+  // Copies a literal so it can be placed at `at`
+  AST_Node *copy_literal(AST_Node *literal, AST_Node *at);
+};
+
+#endif
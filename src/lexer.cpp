@@ -1,30 +1,95 @@
+#include <algorithm>
+#include <array>
 #include <cctype>
+#include <chrono>
+#include <iostream>
 #include <map>
+#include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "errors.hpp"
 #include "lexer.hpp"
+#include "scan.hpp"
 #include "token.hpp"
+#include "work_pool.hpp"
 
-#define LEXEME_SV                                                              \
-  (std::string_view(this->stream).substr(start, (1 + this->cursor - start)))
+// Offset and length of the lexeme that started at `start` and ends under the
+// cursor
+#define LEXEME start, (1 + this->cursor - start)
 
 inline Error *lexer_error(Error::Type t, size_t y, size_t x0, size_t x1,
                           Error::Flag flag, std::string message) {
   return new Error(t, y, x0, x1, flag, message);
 }
 
-Lexer::Lexer(const std::string &source, Reporter *reporter)
-    : stream(source), cursor(0), line(1), reporter(reporter) {}
+Lexer::Lexer(std::string_view source, Reporter *reporter)
+    : stream(source), cursor(0), limit(source.length()),
+      finished(false), reporter(reporter) {}
 
-bool is_hex(char c) {
-  return ('0' <= c && c <= '9') || ('A' <= c && c <= 'F') ||
-         ('a' <= c && c <= 'f');
+Lexer::Lexer(std::string_view source, Reporter *reporter, size_t begin,
+             size_t end)
+    : stream(source), cursor(begin), limit(end), finished(false),
+      reporter(reporter) {}
+
+// ---------------------------------------------------------------------
+// CHARACTER CLASSES
+// ---------------------------------------------------------------------
+
+// Every byte maps to a set of `Char_Class` bits, so classifying a character is
+// a single table load instead of a chain of `isalpha`/`isdigit` calls
+enum Char_Class : unsigned char {
+  CC_SPACE = 1 << 0,  // ' ', '\t', '\r' (newlines are tokens, not whitespace)
+  CC_ALPHA = 1 << 1,  // can start a symbol: [A-Za-z_]
+  CC_DIGIT = 1 << 2,  // [0-9]
+  CC_HEX = 1 << 3,    // [0-9A-Fa-f]
+  CC_OCTAL = 1 << 4,  // [0-7]
+  CC_BINARY = 1 << 5, // [01]
+  CC_SYMBOL = CC_ALPHA | CC_DIGIT, // can continue a symbol
+};
+
+constexpr std::array<unsigned char, 256> make_char_classes() {
+  std::array<unsigned char, 256> t{};
+  t[' '] = t['\t'] = t['\r'] = CC_SPACE;
+  t['_'] = CC_ALPHA;
+  for (int c = 'a'; c <= 'z'; c++)
+    t[c] |= CC_ALPHA;
+  for (int c = 'A'; c <= 'Z'; c++)
+    t[c] |= CC_ALPHA;
+  for (int c = '0'; c <= '9'; c++)
+    t[c] |= CC_DIGIT | CC_HEX;
+  for (int c = 'a'; c <= 'f'; c++)
+    t[c] |= CC_HEX;
+  for (int c = 'A'; c <= 'F'; c++)
+    t[c] |= CC_HEX;
+  for (int c = '0'; c <= '7'; c++)
+    t[c] |= CC_OCTAL;
+  t['0'] |= CC_BINARY;
+  t['1'] |= CC_BINARY;
+  return t;
+}
+
+constexpr std::array<unsigned char, 256> char_classes = make_char_classes();
+
+inline bool is_class(char c, unsigned char cls) {
+  return (char_classes[static_cast<unsigned char>(c)] & cls) != 0;
 }
 
 void Lexer::scan() {
-  while (this->cursor < this->stream.length()) {
+  while (this->step())
+    ;
+}
+
+bool Lexer::step() {
+  if (this->finished)
+    return false;
+  size_t produced = this->output.size();
+
+  // The fast path below never bounds checks: every loop stops on the '\0'
+  // sentinel at `stream[length()]`, and `peek()` only ever reads one byte past
+  // a cursor that is still inside the source
+  while (this->cursor < this->limit) {
     char ch = this->stream[this->cursor];
     std::size_t start = this->cursor;
 
@@ -33,154 +98,129 @@ void Lexer::scan() {
     case ' ':
     case '\r':
     case '\t':
+      this->cursor = scan_space_end(this->stream.data(), this->cursor + 1,
+                                    this->stream.length()) -
+                     1;
       break;
     case '\n': {
-      this->output.push_back(Token(Token::Type::NEWLINE,
-                                   std::string_view{"\\n"}, this->line, start));
-      this->line++;
+      this->output.push_back(Token(Token::Type::NEWLINE, start, 1));
       break;
     }
 
     // Handle grouping ops
     case '(':
-      this->output.push_back(
-          Token(Token::Type::LPAREN, LEXEME_SV, this->line, start));
+      this->output.push_back(Token(Token::Type::LPAREN, LEXEME));
       break;
     case ')':
-      this->output.push_back(
-          Token(Token::Type::RPAREN, LEXEME_SV, this->line, start));
+      this->output.push_back(Token(Token::Type::RPAREN, LEXEME));
       break;
     case '[':
-      this->output.push_back(
-          Token(Token::Type::LBRAC, LEXEME_SV, this->line, start));
+      this->output.push_back(Token(Token::Type::LBRAC, LEXEME));
       break;
     case ']':
-      this->output.push_back(
-          Token(Token::Type::RBRAC, LEXEME_SV, this->line, start));
+      this->output.push_back(Token(Token::Type::RBRAC, LEXEME));
       break;
     case '{':
-      this->output.push_back(
-          Token(Token::Type::LCURL, LEXEME_SV, this->line, start));
+      this->output.push_back(Token(Token::Type::LCURL, LEXEME));
       break;
     case '}':
-      this->output.push_back(
-          Token(Token::Type::RCURL, LEXEME_SV, this->line, start));
+      this->output.push_back(Token(Token::Type::RCURL, LEXEME));
       break;
 
     // Handle operators
     case '-': {
       if (expect('>'))
-        this->output.push_back(
-            Token(Token::Type::ARROW, LEXEME_SV, this->line, start));
+        this->output.push_back(Token(Token::Type::ARROW, LEXEME));
       else if (expect('-'))
-        this->output.push_back(
-            Token(Token::Type::MINUS_MINUS, LEXEME_SV, this->line, start));
+        this->output.push_back(Token(Token::Type::MINUS_MINUS, LEXEME));
       else if (expect('='))
-        this->output.push_back(
-            Token(Token::Type::MINUS_EQUAL, LEXEME_SV, this->line, start));
+        this->output.push_back(Token(Token::Type::MINUS_EQUAL, LEXEME));
       else
-        this->output.push_back(
-            Token(Token::Type::MINUS, LEXEME_SV, this->line, start));
+        this->output.push_back(Token(Token::Type::MINUS, LEXEME));
       break;
     };
     case '+': {
       if (expect('+'))
-        this->output.push_back(
-            Token(Token::Type::PLUS_PLUS, LEXEME_SV, this->line, start));
+        this->output.push_back(Token(Token::Type::PLUS_PLUS, LEXEME));
       else if (expect('='))
-        this->output.push_back(
-            Token(Token::Type::PLUS_EQUAL, LEXEME_SV, this->line, start));
+        this->output.push_back(Token(Token::Type::PLUS_EQUAL, LEXEME));
       else
-        this->output.push_back(
-            Token(Token::Type::PLUS, LEXEME_SV, this->line, start));
+        this->output.push_back(Token(Token::Type::PLUS, LEXEME));
       break;
     }
     case '*': {
       if (expect('*'))
-        this->output.push_back(
-            Token(Token::Type::STAR_STAR, LEXEME_SV, this->line, start));
+        this->output.push_back(Token(Token::Type::STAR_STAR, LEXEME));
       else if (expect('='))
-        this->output.push_back(
-            Token(Token::Type::STAR_EQUAL, LEXEME_SV, this->line, start));
+        this->output.push_back(Token(Token::Type::STAR_EQUAL, LEXEME));
       else
-        this->output.push_back(
-            Token(Token::Type::STAR, LEXEME_SV, this->line, start));
+        this->output.push_back(Token(Token::Type::STAR, LEXEME));
       break;
     }
     case '/': {
       if (expect('/'))
-        this->output.push_back(
-            Token(Token::Type::SLASH_SLASH, LEXEME_SV, this->line, start));
+        this->output.push_back(Token(Token::Type::SLASH_SLASH, LEXEME));
       else if (expect('='))
-        this->output.push_back(
-            Token(Token::Type::SLASH_EQUAL, LEXEME_SV, this->line, start));
+        this->output.push_back(Token(Token::Type::SLASH_EQUAL, LEXEME));
       else
-        this->output.push_back(
-            Token(Token::Type::SLASH, LEXEME_SV, this->line, start));
+        this->output.push_back(Token(Token::Type::SLASH, LEXEME));
       break;
     }
     case '>': {
       Token::Type t =
           (expect('=')) ? Token::Type::MORE_EQUAL : Token::Type::MORE;
-      this->output.push_back(Token(t, LEXEME_SV, this->line, start));
+      this->output.push_back(Token(t, LEXEME));
       break;
     };
     case '<': {
       Token::Type t =
           (expect('=')) ? Token::Type::LESS_EQUAL : Token::Type::LESS;
-      this->output.push_back(Token(t, LEXEME_SV, this->line, start));
+      this->output.push_back(Token(t, LEXEME));
       break;
     };
     case '=': {
       Token::Type t =
           (expect('=')) ? Token::Type::EQUAL_EQUAL : Token::Type::EQUAL;
-      this->output.push_back(Token(t, LEXEME_SV, this->line, start));
+      this->output.push_back(Token(t, LEXEME));
       break;
     };
     case '!': {
       Token::Type t =
           (expect('=')) ? Token::Type::BANG_EQUAL : Token::Type::BANG;
-      this->output.push_back(Token(t, LEXEME_SV, this->line, start));
+      this->output.push_back(Token(t, LEXEME));
       break;
     };
     case '&': {
       Token::Type t = (expect('&')) ? Token::Type::AMP_AMP : Token::Type::AMP;
-      this->output.push_back(Token(t, LEXEME_SV, this->line, start));
+      this->output.push_back(Token(t, LEXEME));
       break;
     };
     case '|': {
       Token::Type t = (expect('|')) ? Token::Type::BAR_BAR : Token::Type::BAR;
-      this->output.push_back(Token(t, LEXEME_SV, this->line, start));
+      this->output.push_back(Token(t, LEXEME));
       break;
     };
 
     case ',':
-      this->output.push_back(
-          Token(Token::Type::COMMA, LEXEME_SV, this->line, start));
+      this->output.push_back(Token(Token::Type::COMMA, LEXEME));
       break;
     case '.':
-      this->output.push_back(
-          Token(Token::Type::DOT, LEXEME_SV, this->line, start));
+      this->output.push_back(Token(Token::Type::DOT, LEXEME));
       break;
     case '?':
-      this->output.push_back(
-          Token(Token::Type::QMARK, LEXEME_SV, this->line, start));
+      this->output.push_back(Token(Token::Type::QMARK, LEXEME));
       break;
     case ':':
-      this->output.push_back(
-          Token(Token::Type::COLON, LEXEME_SV, this->line, start));
+      this->output.push_back(Token(Token::Type::COLON, LEXEME));
       break;
     case ';':
-      this->output.push_back(
-          Token(Token::Type::SEMICOLON, LEXEME_SV, this->line, start));
+      this->output.push_back(Token(Token::Type::SEMICOLON, LEXEME));
       break;
     case '@':
-      this->output.push_back(
-          Token(Token::Type::ATSIGN, LEXEME_SV, this->line, start));
+      this->output.push_back(Token(Token::Type::ATSIGN, LEXEME));
       break;
     case '%':
-      this->output.push_back(
-          Token(Token::Type::MODULO, LEXEME_SV, this->line, start));
+      this->output.push_back(Token(Token::Type::MODULO, LEXEME));
       break;
 
     // Handle comments
@@ -189,58 +229,61 @@ void Lexer::scan() {
       if (peek() == '\'')
         docs = true;
       else if (peek() == '[') {
-        this->output.push_back(
-            Token(Token::Type::HASH_BRAC, LEXEME_SV, this->line, start));
+        this->output.push_back(Token(Token::Type::HASH_BRAC, LEXEME));
         break;
       }
 
-      this->cursor++;
-      while (this->stream[this->cursor] != '\n' &&
-             this->stream[this->cursor] != '\0')
-        this->cursor++;
+      this->cursor = scan_line_end(this->stream.data(), this->cursor + 1,
+                                   this->stream.length());
 
       if (docs) {
         start += 2; /* ignore the #' at the begining */
-        this->output.push_back(
-            Token(Token::Type::DOC, LEXEME_SV, this->line, start));
+        this->output.push_back(Token(Token::Type::DOC, LEXEME));
       }
       break;
     }
 
     case '"': {
-      this->cursor++;
-      while (peek() != '"' && peek() != '\0')
-        this->cursor++;
-      
+      // Leave the cursor on the last character of the body so `peek()` is
+      // the closing '"' (or the sentinel if there isn't one). A '\\' takes
+      // the character after it along, so `\"` doesn't end the string
+      const char *s = this->stream.data();
+      size_t n = this->stream.length();
+      size_t i = scan_string_end(s, this->cursor + 1, n);
+      while (i < n && s[i] == '\\') {
+        if (i + 1 < n && escape_value(s[i + 1]) < 0)
+          this->reporter->new_error(Error::Type::INVALID_ESCAPE, i, i + 1,
+                                    Error::Flag::ABORT,
+                                    "Unknown escape sequence");
+        i = scan_string_end(s, std::min(i + 2, n), n);
+      }
+      this->cursor = i - 1;
+
       if (peek() == '\0') {
-        this->reporter->new_error(Error::Type::NONTERMINATING_STRLITERAL, this->line, start, this->cursor, Error::Flag::ABORT, "String literal has no closing '\"'");
-        this->output.push_back(
-          Token(Token::Type::STRING, LEXEME_SV, this->line, start));
+        this->reporter->new_error(Error::Type::NONTERMINATING_STRLITERAL, start,
+                                  this->cursor, Error::Flag::ABORT,
+                                  "String literal has no closing '\"'");
+        this->output.push_back(Token(Token::Type::STRING, LEXEME));
         break;
       }
       this->cursor++;
-      this->output.push_back(
-          Token(Token::Type::STRING, LEXEME_SV, this->line, start));
+      this->output.push_back(Token(Token::Type::STRING, LEXEME));
       break;
     }
 
     // Handle literals and keywords
     default: {
-      if (isalpha(ch) || ch == '_') {
+      if (is_class(ch, CC_ALPHA)) {
         // Tokenize symbols here
-        while (isalnum(peek()) || peek() == '_')
-          next(); /* unused return */
+        this->cursor = scan_symbol_end(this->stream.data(), this->cursor + 1,
+                                       this->stream.length()) -
+                       1;
 
         // Check to see if this is a keyword
-        std::string_view lexeme = LEXEME_SV;
-        if (keywords.count(std::string(lexeme)) != 0)
-          this->output.push_back(
-              Token(keywords[std::string(lexeme)], lexeme, this->line, start));
-        else
-          this->output.push_back(
-              Token(Token::Type::SYMBOL, lexeme, this->line, start));
-
-      } else if (isdigit(ch)) {
+        std::string_view lexeme = this->stream.substr(LEXEME);
+        this->output.push_back(Token(keyword_type(lexeme), LEXEME));
+
+      } else if (is_class(ch, CC_DIGIT)) {
         if (ch == '0') {
           // Could be octal/hex/binary
           if (peek() == 'x' || peek() == 'X') {
@@ -249,73 +292,59 @@ void Lexer::scan() {
             // Hex requires more tokenizing
             while (true) {
               char now = peek();
-              if (isspace(now))
+              if (is_class(now, CC_SPACE) || now == '\n' || now == '\0')
                 break;
-              else if (now == '\0')
-                break;
-              else if (now == '_')
-                this->cursor++;
-              else if (is_hex(now))
+              else if (now == '_' || is_class(now, CC_HEX))
                 this->cursor++;
               else {
                 this->reporter->new_error(
-                    Error::Type::SYNTAX_ERROR, this->line, this->cursor+1,
+                    Error::Type::SYNTAX_ERROR, this->cursor+1,
                     this->cursor+1, Error::Flag::ABORT,
                     "Invalid character in hexadecimal number literal");
                 break;
               }
             }
-            this->output.push_back(
-                Token(Token::Type::NUMBER, LEXEME_SV, this->line, start));
+            this->output.push_back(Token(Token::Type::NUMBER, LEXEME));
             break;
           }
 
           if (peek() == 'o' || peek() == 'O' || peek() == 'b' ||
               peek() == 'B') {
             char base = peek();
+            unsigned char digits =
+                (base == 'b' || base == 'B') ? CC_BINARY : CC_OCTAL;
             this->cursor++;
 
             while (true) {
               char now = peek();
-              if (isspace(now))
+              if (is_class(now, CC_SPACE) || now == '\n' || now == '\0')
                 break;
-              else if (now == '\0')
-                break;
-              else if (now == '_') {
-                this->cursor++;
-                continue;
-              } else if ((base == 'b' ||
-                          base == 'B' && (now == '0' || now == '1')) ||
-                         (base == 'o' ||
-                          base == 'O' && (now >= '0' && now <= '7'))) {
+              else if (now == '_' || is_class(now, digits)) {
                 this->cursor++;
               } else {
                 this->reporter->new_error(
-                    Error::Type::SYNTAX_ERROR, this->line, this->cursor+1,
+                    Error::Type::SYNTAX_ERROR, this->cursor+1,
                     this->cursor+1, Error::Flag::ABORT,
                     "Invalid character in binary/octal number literal");
                 break;
               }
             }
-            this->output.push_back(
-                Token(Token::Type::NUMBER, LEXEME_SV, this->line, start));
+            this->output.push_back(Token(Token::Type::NUMBER, LEXEME));
             break;
           }
         }
 
         // Tokenize numbers here
-        while (isdigit(peek()) || peek() == '_' || peek() == '.')
+        while (is_class(peek(), CC_DIGIT) || peek() == '_' || peek() == '.')
           this->cursor++;
-        this->output.push_back(
-            Token(Token::Type::NUMBER, LEXEME_SV, this->line, start));
+        this->output.push_back(Token(Token::Type::NUMBER, LEXEME));
       } else {
         // This is the catchall for anything that didn't go through the rest of
         // the switch or the else cases afterwards Going to push an error that
         // this character is illegal and just not push it to the output at all
-        std::cout << "This is an erroring character" << std::endl;
-        this->reporter->new_error(Error::Type::ILLEGAL_CHAR, this->line,
-                                  this->cursor, this->cursor,
-                                  Error::Flag::ABORT, "Illegal Character");
+        this->reporter->new_error(Error::Type::ILLEGAL_CHAR, this->cursor,
+                                  this->cursor, Error::Flag::ABORT,
+                                  "Illegal Character");
         break; // !!! Untested
       }
     }
@@ -324,10 +353,166 @@ void Lexer::scan() {
     if (this->stream[this->cursor] == '\0')
       break;
     this->cursor++;
+
+    // Whitespace and comments don't produce anything, so keep going until
+    // there is at least one new token to hand back
+    if (this->output.size() != produced)
+      return true;
+  }
+
+  // The next chunk carries on from here
+  if (this->limit < this->stream.length()) {
+    this->finished = true;
+    return false;
+  }
+  this->output.push_back(Token(Token::Type::END_OF_FILE, this->cursor, 0));
+  this->finished = true;
+  return false;
+}
+
+// ---------------------------------------------------------------------
+// PARALLEL LEXING
+// ---------------------------------------------------------------------
+
+// Chunks smaller than this aren't worth a thread
+static constexpr size_t MIN_LEX_CHUNK = 1 << 16;
+
+std::vector<Token> Lexer::scan_parallel(std::string_view source,
+                                        Reporter *reporter, size_t threads) {
+  if (threads == 0)
+    threads = std::thread::hardware_concurrency();
+  threads = std::min(threads, source.length() / MIN_LEX_CHUNK);
+
+  struct Chunk {
+    size_t begin, end;
+    size_t stop = 0; // where lexing it ended, past `end` inside a string
+    std::vector<Token> tokens;
+    // Errors only look their line up in the map, but that builds its line
+    // index on first use, so each thread needs a map of its own
+    std::unique_ptr<Source_Map> map;
+    std::unique_ptr<Reporter> errors;
+  };
+  std::vector<Chunk> chunks;
+  for (size_t k = 1, begin = 0; k <= threads && begin < source.length();
+       k++) {
+    size_t end = source.length();
+    if (k < threads) {
+      size_t newline = source.find('\n', source.length() * k / threads);
+      if (newline != std::string_view::npos)
+        end = newline + 1;
+    }
+    if (end > begin) {
+      chunks.emplace_back();
+      chunks.back().begin = begin;
+      chunks.back().end = end;
+    }
+    begin = end;
+  }
+
+  if (chunks.size() <= 1) {
+    Lexer lexer = Lexer(source, reporter);
+    lexer.scan();
+    return std::move(lexer.output);
+  }
+
+  // Chunk errors are collected quietly and handed to `reporter` in order.
+  // Offsets are into the whole source, so they need no fixing up
+  {
+    Work_Pool pool = Work_Pool(chunks.size());
+    for (Chunk &chunk : chunks)
+      pool.submit([&] {
+        chunk.map = std::make_unique<Source_Map>(source);
+        chunk.errors = std::make_unique<Reporter>("", "", *chunk.map, false);
+        Lexer lexer =
+            Lexer(source, chunk.errors.get(), chunk.begin, chunk.end);
+        lexer.scan();
+        chunk.stop = lexer.cursor;
+        chunk.tokens = std::move(lexer.output);
+      });
+    pool.wait();
+  }
+
+  size_t total = 0;
+  for (const Chunk &chunk : chunks)
+    total += chunk.tokens.size();
+  std::vector<Token> tokens;
+  tokens.reserve(total);
+
+  // Where the real lexer would be
+  size_t position = 0;
+  for (Chunk &chunk : chunks) {
+    if (chunk.begin == position) {
+      reporter->take_errors(*chunk.errors);
+      tokens.insert(tokens.end(), chunk.tokens.begin(), chunk.tokens.end());
+      position = chunk.stop;
+      continue;
+    }
+
+    // A string literal from an earlier chunk ran into this one, so its tokens
+    // started in the wrong place. Whatever is left of it is lexed again, and
+    // if the string ran past all of it, that's nothing (or just the EOF)
+    Lexer lexer = Lexer(source, reporter, position, chunk.end);
+    lexer.scan();
+    tokens.insert(tokens.end(), lexer.output.begin(), lexer.output.end());
+    position = lexer.cursor;
+  }
+  return tokens;
+}
+
+// Statements, calls, comments and the odd string that spans lines, so that
+// some chunks start inside a string
+static std::string lex_benchmark_source(size_t bytes) {
+  std::string source;
+  source.reserve(bytes + 256);
+  for (size_t i = 0; source.size() < bytes; i++) {
+    std::string n = std::to_string(i);
+    source += "value_" + n + " = " + n + " * 3 + compute(value_" + n +
+              ", 4.25, \"label " + n + "\") # running total\n";
+    if (i % 97 == 0)
+      source += "text = \"first line\nsecond line " + n + "\n\"\n";
+    if (i % 13 == 0)
+      source += "if value_" + n + " >= 10 { result += 0x1F_FF } \n";
+  }
+  return source;
+}
+
+static bool same_tokens(const std::vector<Token> &a,
+                        const std::vector<Token> &b) {
+  return std::equal(a.begin(), a.end(), b.begin(), b.end(),
+                    [](const Token &x, const Token &y) {
+                      return x.type == y.type && x.offset == y.offset &&
+                             x.length == y.length;
+                    });
+}
+
+void lex_benchmark(size_t max_threads) {
+  if (max_threads == 0)
+    max_threads = std::max<size_t>(std::thread::hardware_concurrency(), 8);
+
+  std::string source = lex_benchmark_source(64 << 20);
+  double mb = source.size() / (1024.0 * 1024.0);
+  Source_Map map = Source_Map(source);
+
+  std::vector<Token> expected;
+  double single = 0;
+  for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+    Reporter reporter = Reporter("bench", "bench", map, false);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<Token> tokens =
+        Lexer::scan_parallel(source, &reporter, threads);
+    std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+
+    if (threads == 1) {
+      expected = std::move(tokens);
+      single = d.count();
+    }
+    bool ok = threads == 1 || same_tokens(tokens, expected);
+
+    std::cout << "[bench] lex " << threads << " thread(s) " << mb / d.count()
+              << " MB/s (" << d.count() * 1000 << " ms, "
+              << single / d.count() << "x)" << (ok ? "" : " WRONG TOKENS")
+              << std::endl;
   }
-  this->output.push_back(Token(Token::Type::END_OF_FILE,
-                               std::string_view{"{ EOF }"}, this->line,
-                               this->cursor));
 }
 
 char Lexer::next() {
@@ -336,11 +521,9 @@ char Lexer::next() {
   return this->stream[this->cursor++];
 }
 
-char Lexer::peek() const {
-  if (this->cursor + 1 >= this->stream.length())
-    return '\0';
-  return this->stream[this->cursor + 1];
-}
+// No bounds check: `step()` only calls this while `cursor < length()`, so the
+// furthest it can read is the '\0' sentinel at `stream[length()]`
+char Lexer::peek() const { return this->stream[this->cursor + 1]; }
 
 bool Lexer::expect(char ch) {
   if (peek() == ch) {
@@ -348,4 +531,58 @@ bool Lexer::expect(char ch) {
     return true;
   }
   return false;
-}
\ No newline at end of file
+}
+
+// ---------------------------------------------------------------------
+// TOKEN STREAM
+// ---------------------------------------------------------------------
+
+Token_Stream::Token_Stream(Lexer &lexer, size_t capacity)
+    : lexer(&lexer), tokens(nullptr), n_tokens(0), produced(0),
+      finished(false) {
+  size_t size = 1;
+  while (size < capacity)
+    size <<= 1;
+  this->ring.resize(size, Token(Token::Type::END_OF_FILE, 0, 0));
+}
+
+Token_Stream::Token_Stream(const std::vector<Token> &tokens)
+    : lexer(nullptr), tokens(tokens.data()), n_tokens(tokens.size()),
+      produced(tokens.size()), finished(true) {}
+
+const Token &Token_Stream::at(size_t anchor, size_t i) {
+  if (this->lexer == nullptr)
+    return this->tokens[i < this->n_tokens ? i : this->n_tokens - 1];
+
+  while (i >= this->produced && !this->finished)
+    this->pull(anchor);
+
+  // Anything past the end is the EOF token, which is always the last one
+  if (i >= this->produced)
+    i = this->produced - 1;
+  return this->ring[i & (this->ring.size() - 1)];
+}
+
+void Token_Stream::pull(size_t anchor) {
+  this->finished = !this->lexer->step();
+
+  size_t oldest = anchor > HISTORY ? anchor - HISTORY : 0;
+  for (const Token &tk : this->lexer->output) {
+    // Only grow when the parser is looking further ahead than the ring can
+    // hold, e.g. a long run of blank lines
+    if (this->produced - oldest >= this->ring.size())
+      this->grow();
+    this->ring[this->produced & (this->ring.size() - 1)] = tk;
+    this->produced++;
+  }
+  this->lexer->output.clear();
+}
+
+void Token_Stream::grow() {
+  size_t size = this->ring.size();
+  std::vector<Token> bigger(size * 2, Token(Token::Type::END_OF_FILE, 0, 0));
+  size_t first = this->produced > size ? this->produced - size : 0;
+  for (size_t i = first; i < this->produced; i++)
+    bigger[i & (size * 2 - 1)] = this->ring[i & (size - 1)];
+  this->ring = std::move(bigger);
+}
@@ -7,21 +7,49 @@
 #include <vector>
 
 class Lexer {
-  const std::string &stream;
-  size_t cursor, line;
+  std::string_view stream;
+  size_t cursor;
+  size_t limit; // no token starts here or later
+  bool finished;
 
 public:
   std::vector<Token> output;
   Reporter *reporter;
 
-  Lexer(const std::string &source, Reporter *reporter);
+  // `source` must be followed by a '\0' sentinel, which is the case for both
+  // `std::string` and `Source_Buffer`
+  Lexer(std::string_view source, Reporter *reporter);
+
+  // Only tokenizes what starts in `[begin, end)`, although the last token may
+  // run past `end`. No EOF token is added unless `end` is the end of the source
+  Lexer(std::string_view source, Reporter *reporter, size_t begin, size_t end);
+
+  // Tokenize the whole source into `output`
   void scan();
 
+  // Tokenizes the whole source on up to `threads` threads, one per hardware
+  // thread if 0, and returns the same tokens `scan()` would. Errors are
+  // pushed to `reporter` in source order once every thread is done
+  //
+  // The source is split into chunks that each start right after a newline.
+  // Comments end at newlines, so there the lexer is always between tokens
+  // unless a string literal is still open. Every chunk is lexed as if none
+  // is, and the chunks are stitched together in order. A chunk that turns
+  // out to start inside a string is lexed again from where the string ends
+  static std::vector<Token> scan_parallel(std::string_view source,
+                                          Reporter *reporter,
+                                          size_t threads = 0);
+
+  // Tokenize until at least one more token has been appended to `output`.
+  // Returns false once the EOF token has been appended
+  bool step();
+
 private:
   // Get the next character and advance. If EOF reached, will return '\0'
   char next();
 
-  // Exact same implementation as `Lexer::next()` but does not advance `x`
+  // Look at the character after the cursor without advancing. Relies on the
+  // '\0' sentinel at the end of the source instead of a bounds check
   char peek() const;
 
   // Peeks ahead to see if char `ch` exists, if it does, it will consume it and
@@ -29,4 +57,39 @@ private:
   bool expect(char ch);
 };
 
+// Lexes a generated source of a few tens of MB with 1, 2, 4... threads up to
+// `max_threads` (one per hardware thread if 0, and at least 8), and prints the
+// throughput of each next to the single-threaded one
+void lex_benchmark(size_t max_threads = 0);
+
+// Hands tokens to the `Parser` by absolute index. When built on a `Lexer` it
+// pulls tokens on demand into a small ring, so token memory stays constant no
+// matter how big the source is, and lexing and parsing interleave in cache.
+// It can also replay a token vector that was lexed up front
+class Token_Stream {
+  // Number of tokens behind the parser's position that stay readable
+  static constexpr size_t HISTORY = 4;
+
+  Lexer *lexer;
+  std::vector<Token> ring; // size is always a power of two
+
+  const Token *tokens;
+  size_t n_tokens;
+
+  size_t produced; // tokens pulled from the lexer so far
+  bool finished;
+
+public:
+  Token_Stream(Lexer &lexer, size_t capacity = 256);
+  Token_Stream(const std::vector<Token> &tokens);
+
+  // Returns token `i`. `anchor` is the parser's position: tokens from a few
+  // before it onwards are kept around, older ones may be overwritten
+  const Token &at(size_t anchor, size_t i);
+
+private:
+  void pull(size_t anchor);
+  void grow();
+};
+
 #endif
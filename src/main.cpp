@@ -1,89 +1,273 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <filesystem>
-#include <fstream>
 #include <iostream>
+#include <memory>
 #include <optional>
-#include <streambuf>
 #include <string>
+#include <string_view>
 
 #include "ast.hpp"
+#include "build.hpp"
 #include "cbc.hpp"
 #include "errors.hpp"
+#include "flat_ast.hpp"
+#include "fold.hpp"
 #include "lexer.hpp"
 #include "parser.hpp"
+#include "source.hpp"
 #include "token.hpp"
+#include "vm.hpp"
 
 const char *FILE_PATH = "../main.chao";
 
-std::optional<std::string> read_file(const char *path) {
-  // First check if the file exists before we try to open it.
-  if (!std::filesystem::exists(path)) {
-    std::cerr << "File path '" << path << "' does not exist!";
-    return std::nullopt;
-  }
-
-  // Then check to see if we actually opened the file
-  // If the file exists but wasn't opened, there's probably an OS
-  // permissions issue with this file
-  std::ifstream file(path);
-  if (!file) {
-    std::cerr << "There was an error opening the file '" << path << "'!";
-    return std::nullopt;
-  }
-
-  // Use a streambuffer iterator from the file and create a string from it
-  std::string content((std::istreambuf_iterator<char>(file)),
-                      std::istreambuf_iterator<char>());
-  return content;
-}
-
 // Move the tokenize functionality out of main() so that the lexer only
 // exists on the stack for as long as we need it to
-std::vector<Token> tokenize(std::string &source, Reporter *reporter) {
+std::vector<Token> tokenize(std::string_view source, Reporter *reporter) {
   Lexer lexer = Lexer(source, reporter);
   lexer.scan();
-  std::vector<Token> tokens = lexer.output;
-  return tokens;
+  return std::move(lexer.output);
 }
 
-Parse_Tree make_parse_tree(std::vector<Token> stream, Reporter *reporter) {
-  Parser parser = Parser(stream, reporter);
+Parse_Tree make_parse_tree(Token_Stream &stream, const Source_Map &map,
+                           Reporter *reporter) {
+  Parser parser = Parser(stream, map, reporter);
   parser.parse();
-  Parse_Tree tree = parser.tree;
-  return tree;
+  return std::move(parser.tree);
 }
 
-int main() {
-  auto source = read_file(FILE_PATH);
-  if (!source)
-    return -1;
+// Wall-clock time since `start` in seconds, used by `--time`
+double seconds_since(std::chrono::steady_clock::time_point start) {
+  std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+  return d.count();
+}
+
+struct Options {
+  int level = 0;
+  bool time_stages = false;
+  bool dump_tokens = false;
+  bool arena_stats = false;
+  bool flat_tree = false;
+  size_t lex_threads = 1;
+};
+
+// Everything from source to a program for one module. Only the entry prints
+// its tree and program, the rest just their errors
+std::optional<CBC_Program> compile_module(Module &module, const Options &opts,
+                                          bool entry) {
+  std::string_view source = module.source->view();
+  std::string file_name = std::filesystem::path(module.path).filename();
 
+  Source_Map map = Source_Map(source);
   // Allocate this on the heap so we can leave more stack space for AST nodes
-  Reporter *reporter = new Reporter("main.chao", FILE_PATH, *source);
-  std::vector<Token> tokens = tokenize(*source, reporter);
+  auto reporter = std::make_unique<Reporter>(file_name, module.path, map);
 
-  for (auto t : tokens)
-    t.print();
+  // The parser pulls tokens straight from the lexer, so lexing on its own
+  // only happens when we want to look at (or time) the tokens by themselves
+  if (opts.time_stages || opts.dump_tokens) {
+    Reporter scratch = Reporter(file_name, module.path, map);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<Token> tokens =
+        opts.lex_threads == 1
+            ? tokenize(source, &scratch)
+            : Lexer::scan_parallel(source, &scratch, opts.lex_threads);
+    double t_lex = seconds_since(start);
 
-  // reporter->print_errors();
+    if (opts.dump_tokens)
+      for (auto t : tokens)
+        map.print(t);
+
+    if (opts.time_stages) {
+      double mb = source.size() / (1024.0 * 1024.0);
+      std::cerr << "[time] lex   " << t_lex * 1000 << " ms (" << tokens.size()
+                << " tokens, " << (t_lex > 0 ? mb / t_lex : 0) << " MB/s, "
+                << module.name << ")" << std::endl;
+    }
+  }
 
-  // Parse_Tree parse_tree = make_parse_tree(tokens, reporter);
-  Parser parser = Parser(tokens, reporter);
+  // With more than one lexer thread the whole module is lexed up front,
+  // otherwise the parser pulls tokens as it goes
+  Lexer lexer = Lexer(source, reporter.get());
+  std::vector<Token> tokens;
+  if (opts.lex_threads != 1)
+    tokens = Lexer::scan_parallel(source, reporter.get(), opts.lex_threads);
+  Token_Stream stream = opts.lex_threads == 1 ? Token_Stream(lexer)
+                                              : Token_Stream(tokens);
+  Parser parser = Parser(stream, map, reporter.get());
 
+  auto start = std::chrono::steady_clock::now();
   parser.parse();
-  parser.tree.print();
+  if (opts.time_stages)
+    std::cerr << "[time] parse " << seconds_since(start) * 1000
+              << " ms (lexing included, " << module.name << ")" << std::endl;
+  if (entry && opts.flat_tree) {
+    Flat_AST flat = Flat_AST::from(parser.tree);
+    flat.print();
+    if (opts.arena_stats)
+      flat.print_stats();
+  } else if (entry) {
+    parser.tree.print();
+  }
+  if (entry && opts.arena_stats)
+    parser.tree.print_stats();
 
   reporter->print_errors();
 
+  AST_Folder folder = AST_Folder(parser.tree);
+  folder.run();
+  if (entry && opts.arena_stats)
+    folder.print_stats();
+
   // Temp garbage btw
-  CBC_Compiler compiler = CBC_Compiler(parser.tree.unpack());
+  CBC_Compiler compiler = CBC_Compiler(parser.tree.unpack(), opts.level);
+  compiler.exported = module.exported;
 
   int i = compiler.compile();
   if (i != 0) {
-    std::cerr << "Error compiling program" << std::endl;
-    return -1;
+    std::cerr << "Error compiling " << module.path << std::endl;
+    return std::nullopt;
   }
 
-  compiler.print_program();
+  if (entry)
+    compiler.print_program();
 
-  return 0;
-}
\ No newline at end of file
+  std::optional<CBC_Program> program =
+      CBC_Program::assemble(compiler.output(), std::move(compiler.pool));
+  if (program && entry && opts.arena_stats) {
+    compiler.print_stats();
+    program->print_stats();
+  }
+  module.cacheable = !reporter->has_errors();
+  return program;
+}
+
+// Usage: chaocpp [path] [-O0 | -O1 | -O2] [--time] [--tokens] [--stats]
+//                [--flat] [--profile <file>] [--no-cache] [-j<jobs>]
+//                [--lex-threads <n>] [--bench-vm] [--bench-lex]
+//                [--bench-keywords]
+// `-O1` runs the peephole optimizer over the compiled program, `-O2` also
+// fuses runs of instructions into superinstructions, `-O0` (the default)
+// does neither
+// `--time` reports how long each stage took and the lexer throughput in MB/s
+// `--tokens` dumps every token before parsing
+// `--stats` reports how much memory the AST arena used, per node type, what
+// constant folding, the peephole optimizer and register allocation did, and
+// the size of the encoded CBC program
+// `--flat` prints the tree from its flattened `Flat_AST` form instead
+// `--profile` runs the program counting which opcodes run back to back and
+// appends the counts to the file, for `cbc_supergen`
+// `--no-cache` always compiles from source. Otherwise every module compiled
+// is saved to `.chao_cache` next to the program, keyed by a hash of its
+// source and everything it imports, and the next run at the same level loads
+// the ones that haven't changed instead. Flags that look at the tree or the
+// compiler skip the cache too
+// `-j` builds modules on that many threads instead of one per hardware
+// thread
+// `--lex-threads` lexes each module up front on that many threads, one per
+// hardware thread with 0, instead of as the parser goes
+// `--bench-vm` measures CBC dispatch throughput and exits, profiling it too
+// when given `--profile`
+// `--bench-lex` measures how lexing one large source scales with threads and
+// exits
+// `--bench-keywords` compares keyword lookup through the perfect hash with the
+// `std::map` it replaced and exits
+int main(int argc, char **argv) {
+  const char *path = FILE_PATH;
+  Options opts;
+  bool bench_vm = false;
+  bool bench_lex = false;
+  bool bench_keywords = false;
+  bool no_cache = false;
+  const char *profile_path = nullptr;
+  size_t jobs = 0;
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "-O0") == 0)
+      opts.level = 0;
+    else if (std::strcmp(argv[i], "-O1") == 0)
+      opts.level = 1;
+    else if (std::strcmp(argv[i], "-O2") == 0)
+      opts.level = 2;
+    else if (std::strcmp(argv[i], "--time") == 0)
+      opts.time_stages = true;
+    else if (std::strcmp(argv[i], "--tokens") == 0)
+      opts.dump_tokens = true;
+    else if (std::strcmp(argv[i], "--stats") == 0)
+      opts.arena_stats = true;
+    else if (std::strcmp(argv[i], "--flat") == 0)
+      opts.flat_tree = true;
+    else if (std::strcmp(argv[i], "--profile") == 0 && i + 1 < argc)
+      profile_path = argv[++i];
+    else if (std::strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+      jobs = std::strtoul(argv[++i], nullptr, 10);
+    else if (std::strncmp(argv[i], "-j", 2) == 0 && argv[i][2] != '\0')
+      jobs = std::strtoul(argv[i] + 2, nullptr, 10);
+    else if (std::strcmp(argv[i], "--no-cache") == 0)
+      no_cache = true;
+    else if (std::strcmp(argv[i], "--lex-threads") == 0 && i + 1 < argc)
+      opts.lex_threads = std::strtoul(argv[++i], nullptr, 10);
+    else if (std::strcmp(argv[i], "--bench-vm") == 0)
+      bench_vm = true;
+    else if (std::strcmp(argv[i], "--bench-lex") == 0)
+      bench_lex = true;
+    else if (std::strcmp(argv[i], "--bench-keywords") == 0)
+      bench_keywords = true;
+    else
+      path = argv[i];
+  }
+
+  if (bench_vm) {
+    cbc_benchmark(profile_path);
+    return 0;
+  }
+  if (bench_lex) {
+    lex_benchmark();
+    return 0;
+  }
+  if (bench_keywords) {
+    keyword_benchmark();
+    return 0;
+  }
+
+  bool use_cache = !no_cache && !opts.dump_tokens && !opts.arena_stats &&
+                   !opts.flat_tree && !profile_path;
+  std::optional<std::string> cache_dir;
+  if (use_cache)
+    cache_dir =
+        (std::filesystem::path(path).parent_path() / ".chao_cache").string();
+
+  Module_Build build = Module_Build(path, opts.level, cache_dir);
+  auto start = std::chrono::steady_clock::now();
+  if (!build.discover())
+    return -1;
+  if (opts.time_stages)
+    std::cerr << "[time] discover " << seconds_since(start) * 1000 << " ms ("
+              << build.modules.size() << " module(s))" << std::endl;
+
+  start = std::chrono::steady_clock::now();
+  bool built = build.build(
+      [&](Module &module) {
+        return compile_module(module, opts, &module == &build.entry());
+      },
+      jobs);
+  if (!built)
+    return -1;
+  if (opts.time_stages)
+    std::cerr << "[time] build " << seconds_since(start) * 1000 << " ms"
+              << std::endl;
+  if (opts.arena_stats)
+    build.print_stats();
+
+  // A program that fails partway still says something about what runs, so
+  // whatever was counted up to there is kept
+  if (profile_path) {
+    CBC_Profile profile;
+    build.run(&profile);
+    build.print_globals();
+    return profile.save(profile_path) ? 0 : -1;
+  }
+
+  int status = build.run();
+  build.print_globals();
+  return status;
+}
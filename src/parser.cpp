@@ -1,11 +1,15 @@
 #include "parser.hpp"
 #include "ast.hpp"
 #include "errors.hpp"
+#include "scan.hpp"
 #include "token.hpp"
-#include <algorithm>
 #include <array>
+#include <charconv>
+#include <cstdint>
 #include <iostream>
+#include <limits>
 #include <optional>
+#include <string>
 #include <string_view>
 #include <vector>
 
@@ -13,70 +17,168 @@
 // HELPER FUNCTIONS
 // ---------------------------------------------------------------------
 
-std::optional<AST_Op> operator_from_token(Token &tk) {
-  if (operators.count(tk.type) != 0) {
-    return operators[tk.type];
-  }
+std::optional<AST_Op> operator_from_token(const Token &tk) {
+  if (operators[tk.type].valid)
+    return operators[tk.type].op;
   return std::nullopt;
 }
 
-AST_Node *parse_number(std::string str, int line, int start, int stop) {
-  // Remove underscores
-  str.erase(std::remove(str.begin(), str.end(), '_'), str.end());
-  std::cout << "AFTER ERASE: " << str << std::endl;
-
-  if (str[0] == '0') {
-    // // Directly handle the '0' case
-    // if (str.length() == 1) {
-    //   std::cout << "Zero detected!" << std::endl;
-    //   AST_Node *n = new AST_Integer(0, 10, line, start, stop);
-    //   return n;
-    // }
-
-    if (str.length() > 1) {
-      // Binary representation
-      if (str[1] == 'B' || str[1] == 'b') {
-        str.erase(0, 2);
-        std::cout << "PARSING N: " << str << std::endl;
-        long long int value = strtoll(str.c_str(), NULL, 2);
-        AST_Node *n = new AST_Integer(value, 2, line, start, stop);
-        return n;
-
-        // Hexadecimal
-      } else if (str[1] == 'X' || str[1] == 'x') {
-        str.erase(0, 2);
-        std::cout << "PARSING N: " << str << std::endl;
-        long long int value = strtoll(str.c_str(), NULL, 16);
-        AST_Node *n = new AST_Integer(value, 16, line, start, stop);
-        return n;
-
-        // Octal
-      } else if (str[1] == 'O' || str[1] == 'o') {
-        str.erase(0, 2);
-        std::cout << "PARSING N: " << str << std::endl;
-        long long int value = strtoll(str.c_str(), NULL, 8);
-        AST_Node *n = new AST_Integer(value, 8, line, start, stop);
-        return n;
-      }
+// ---------------------------------------------------------------------
+// OPERATOR PRECEDENCE
+// ---------------------------------------------------------------------
+
+constexpr std::array<Infix_Rule, N_TOKEN_TYPES> make_infix_rules() {
+  using P = Precedence;
+  using Kind = AST_Node::Type;
+  std::array<Infix_Rule, N_TOKEN_TYPES> rules{};
+
+  rules[Token::Type::ARROW] = {P::ASSIGNMENT, true, Kind::Assignment};
+  rules[Token::Type::PLUS_EQUAL] = {P::ASSIGNMENT, true, Kind::Assignment};
+  rules[Token::Type::MINUS_EQUAL] = {P::ASSIGNMENT, true, Kind::Assignment};
+  rules[Token::Type::STAR_EQUAL] = {P::ASSIGNMENT, true, Kind::Assignment};
+  rules[Token::Type::SLASH_EQUAL] = {P::ASSIGNMENT, true, Kind::Assignment};
+
+  rules[Token::Type::BAR_BAR] = {P::LOGICAL_OR, false, Kind::Logical};
+  rules[Token::Type::AMP_AMP] = {P::LOGICAL_AND, false, Kind::Logical};
+
+  rules[Token::Type::LESS] = {P::COMPARISON, false, Kind::Binary};
+  rules[Token::Type::LESS_EQUAL] = {P::COMPARISON, false, Kind::Binary};
+  rules[Token::Type::MORE] = {P::COMPARISON, false, Kind::Binary};
+  rules[Token::Type::MORE_EQUAL] = {P::COMPARISON, false, Kind::Binary};
+
+  rules[Token::Type::EQUAL_EQUAL] = {P::EQUALITY, false, Kind::Binary};
+  rules[Token::Type::BANG_EQUAL] = {P::EQUALITY, false, Kind::Binary};
+  rules[Token::Type::IS] = {P::EQUALITY, false, Kind::Binary};
+  rules[Token::Type::NOT] = {P::EQUALITY, false, Kind::Binary};
+
+  rules[Token::Type::PLUS] = {P::TERM, false, Kind::Binary};
+  rules[Token::Type::MINUS] = {P::TERM, false, Kind::Binary};
+
+  rules[Token::Type::STAR] = {P::FACTOR, false, Kind::Binary};
+  rules[Token::Type::SLASH] = {P::FACTOR, false, Kind::Binary};
+  rules[Token::Type::MODULO] = {P::FACTOR, false, Kind::Binary};
+
+  rules[Token::Type::STAR_STAR] = {P::EXPONENT, true, Kind::Binary};
+
+  rules[Token::Type::LPAREN] = {P::POSTFIX, false, Kind::Call};
+  rules[Token::Type::LBRAC] = {P::POSTFIX, false, Kind::Lookup};
+  return rules;
+}
+
+// Indexed by the token that follows the left operand, `NONE` if it doesn't
+// continue the expression
+static constexpr std::array<Infix_Rule, N_TOKEN_TYPES> infix_rules =
+    make_infix_rules();
+
+// Every operator except calls and lookups has to have an `AST_Op`
+constexpr bool infix_rules_have_operators() {
+  for (size_t i = 0; i < N_TOKEN_TYPES; i++) {
+    const Infix_Rule &rule = infix_rules[i];
+    if (rule.precedence != Precedence::NONE &&
+        rule.kind != AST_Node::Type::Call &&
+        rule.kind != AST_Node::Type::Lookup && !operators[i].valid)
+      return false;
+  }
+  return true;
+}
+static_assert(infix_rules_have_operators(),
+              "an infix rule has no entry in `operator_list`");
+
+// The value of a digit in bases up to 16, or too big for any of them if `c`
+// isn't one
+static int digit_value(char c) {
+  if ('0' <= c && c <= '9')
+    return c - '0';
+  char lower = c | 0x20;
+  if ('a' <= lower && lower <= 'f')
+    return lower - 'a' + 10;
+  return 36;
+}
+
+// Number literals are never negative, a leading '-' is a unary operator.
+// Anything wrong with the literal is reported and it reads as 0, so parsing
+// can go on
+static AST_Node *parse_number(Parse_Tree &tree, Reporter *reporter,
+                              std::string_view lexeme, int line, int start,
+                              int stop) {
+  auto fail = [&](Error::Type type, std::string message) -> AST_Node * {
+    reporter->new_error(type, line, start, stop, Error::Flag::ABORT, message);
+    return tree.make<AST_Integer>(0, 10, line, start, stop);
+  };
+
+  if (lexeme.find('.') != std::string_view::npos) {
+    // `from_chars` can't skip underscores, so they're dropped into a buffer
+    // on the stack first. Only absurdly long literals need the heap
+    std::array<char, 128> small;
+    std::string large;
+    char *digits = small.data();
+    if (lexeme.size() > small.size()) {
+      large.resize(lexeme.size());
+      digits = large.data();
     }
+    size_t n = 0;
+    for (char c : lexeme)
+      if (c != '_')
+        digits[n++] = c;
+
+    double value = 0;
+    std::from_chars_result result =
+        std::from_chars(digits, digits + n, value, std::chars_format::fixed);
+    if (result.ec == std::errc::result_out_of_range)
+      return fail(Error::Type::NUMBER_OUT_OF_RANGE,
+                  "Float literal is too large or too small for a float");
+    if (result.ec != std::errc() || result.ptr != digits + n)
+      return fail(Error::Type::SYNTAX_ERROR, "Malformed float literal");
+    return tree.make<AST_Float>(value, line, start, stop);
   }
 
-  if (str.find('.') != std::string::npos) {
-    double value = strtod(str.c_str(), NULL);
-    AST_Node *n = new AST_Float(value, line, start, stop);
-    return n;
+  int base = 10;
+  const char *kind = "decimal";
+  if (lexeme.size() > 1 && lexeme[0] == '0') {
+    switch (lexeme[1] | 0x20) {
+    case 'b':
+      base = 2, kind = "binary";
+      break;
+    case 'o':
+      base = 8, kind = "octal";
+      break;
+    case 'x':
+      base = 16, kind = "hexadecimal";
+      break;
+    }
+    if (base != 10)
+      lexeme.remove_prefix(2);
+  }
+
+  // Checking before every step keeps `value` within `long long int`
+  constexpr uint64_t max = std::numeric_limits<long long int>::max();
+  uint64_t value = 0;
+  bool any = false;
+  for (char c : lexeme) {
+    if (c == '_')
+      continue;
+    int d = digit_value(c);
+    if (d >= base)
+      return fail(Error::Type::SYNTAX_ERROR, std::string("Invalid digit '") +
+                                                 c + "' in " + kind +
+                                                 " literal");
+    if (value > (max - d) / base)
+      return fail(Error::Type::NUMBER_OUT_OF_RANGE,
+                  "Integer literal is larger than " + std::to_string(max));
+    value = value * base + d;
+    any = true;
   }
+  if (!any)
+    return fail(Error::Type::SYNTAX_ERROR,
+                std::string("The ") + kind + " literal has no digits");
 
-  std::cout << "normal integer" << std::endl;
-  long long int value = strtoll(str.c_str(), NULL, 10);
-  AST_Node *n = new AST_Integer(value, 10, line, start, stop);
-  return n;
+  return tree.make<AST_Integer>((long long int)value, base, line, start, stop);
 }
 
 void Parser::parse() {
   while (true) {
-    Token &current = this->current();
-    std::cout << "cycle start " << current.lexeme << std::endl;
+    Token current = this->current();
+    std::cout << "cycle start " << this->source.lexeme(current) << std::endl;
     if (current.type == Token::Type::NEWLINE) {
       this->pos++;
       continue;
@@ -85,7 +187,8 @@ void Parser::parse() {
     }
     AST_Node *new_node = this->statement();
     if (new_node == nullptr) {
-      std::cerr << "Got nullptr for .." << this->current().lexeme << std::endl;
+      std::cerr << "Got nullptr for .." << this->source.lexeme(this->current())
+                << std::endl;
       this->pos++;
       continue;
     }
@@ -98,32 +201,27 @@ void Parser::parse() {
 // HELPER METHODS
 // ---------------------------------------------------------------------
 
-Parser::Parser(std::vector<Token> stream, Reporter *reporter)
-    : stream(stream), pos(0), tree(Parse_Tree()), reporter(reporter) {}
+Parser::Parser(Token_Stream &stream, const Source_Map &source,
+               Reporter *reporter)
+    : stream(stream), pos(0), source(source), tree(Parse_Tree()),
+      reporter(reporter) {}
 
-Token &Parser::peek() {
-  if (this->pos + 1 >= this->stream.size()) {
-    return this->stream.back(); // will return EOF
-  }
-  return this->stream[this->pos + 1];
-}
+// Past the end of the stream all of these return EOF
 
-Token &Parser::next() {
-  if (this->pos >= this->stream.size()) {
-    return this->stream.back(); // will return EOF
-  }
-  return this->stream[this->pos++];
+const Token &Parser::peek() {
+  return this->stream.at(this->pos, this->pos + 1);
 }
 
-Token &Parser::current() {
-  if (this->pos >= this->stream.size()) {
-    return this->stream.back(); // will return EOF
-  }
-  return this->stream[this->pos];
+const Token &Parser::next() {
+  const Token &tk = this->stream.at(this->pos, this->pos);
+  this->pos++;
+  return tk;
 }
 
+const Token &Parser::current() { return this->stream.at(this->pos, this->pos); }
+
 bool Parser::peek_consume_if(Token::Type assert_type) {
-  Token &tk = this->peek();
+  Token tk = this->peek();
   if (tk.type == assert_type) {
     this->pos++;
     return true;
@@ -132,24 +230,23 @@ bool Parser::peek_consume_if(Token::Type assert_type) {
 }
 
 bool Parser::peek_consume_if_ignore_newlines(Token::Type assert_type) {
-  size_t original_pos = this->pos;
-
-  Token &tk = this->peek();
-  if (tk.type == assert_type) {
-    this->pos++;
-    return true;
-  } else if (tk.type == Token::Type::NEWLINE) {
-    this->pos++;
-    return this->peek_consume_if_ignore_newlines(assert_type);
+  // Look past any newlines without moving, so that nothing is consumed unless
+  // the token is found
+  size_t ahead = 1;
+  while (true) {
+    Token tk = this->stream.at(this->pos, this->pos + ahead);
+    if (tk.type == assert_type) {
+      this->pos += ahead;
+      return true;
+    } else if (tk.type != Token::Type::NEWLINE) {
+      return false;
+    }
+    ahead++;
   }
-  // Reset the original position so that we don't consume anything unless the
-  // token as found
-  this->pos = original_pos;
-  return false;
 }
 
 bool Parser::peek_consume_if(std::vector<Token::Type> assert_types) {
-  Token &tk = this->peek();
+  Token tk = this->peek();
 
   for (Token::Type assert_type : assert_types) {
     if (tk.type == assert_type) {
@@ -169,7 +266,7 @@ void Parser::error_here(Error::Type error_type, Error::Flag flag,
 }
 
 template <typename T> bool Parser::assert_node_type(AST_Node *node) {
-  return dynamic_cast<T *>(node) != nullptr;
+  return node_cast<T>(node) != nullptr;
 }
 
 // ---------------------------------------------------------------------
@@ -183,10 +280,10 @@ std::vector<AST_Parameter *> Parser::function_parameters() {
     return params;
 
   while (!this->peek_consume_if(Token::Type::RPAREN)) {
-    Token &tk = this->current();
-    int line = tk.y;
-    int start = tk.x;
-    int stop = tk.x + tk.lexeme.length() - 1;
+    Token tk = this->current();
+    int line = this->source.line(tk);
+    int start = tk.offset;
+    int stop = tk.end();
 
     if (params.size() > 255) {
       this->reporter->new_error(
@@ -213,19 +310,19 @@ std::vector<AST_Parameter *> Parser::function_parameters() {
     }
 
     tk = this->current();
-    line = tk.y;
-    start = tk.x;
-    stop = tk.x + tk.lexeme.length() - 1;
+    line = this->source.line(tk);
+    start = tk.offset;
+    stop = tk.end();
 
     if (tk.type != Token::Type::SYMBOL) {
       this->reporter->new_error(
           Error::Type::SYNTAX_ERROR, line, start, stop, Error::Flag::ABORT,
           ("Expected a symbol for function parameter, got '" +
-           std::string{tk.lexeme} + "' instead"));
+           std::string{this->source.lexeme(tk)} + "' instead"));
       this->pos++;
       continue;
     }
-    std::string name = std::string{tk.lexeme};
+    Symbol_Id name = Symbol_Id::intern(this->source.lexeme(tk));
 
     if (args == 0) {
       if (!this->peek_consume_if(Token::Type::COLON)) {
@@ -241,17 +338,18 @@ std::vector<AST_Parameter *> Parser::function_parameters() {
       // (todo) enforce type
       // (todo) also enforce that it isn't nullptr
 
-      AST_Parameter *p = new AST_Parameter(name, line, start, stop);
+      AST_Parameter *p =
+          this->tree.make<AST_Parameter>(name, line, start, stop);
       p->type = type;
 
       // (todo) look for initializer
 
       params.push_back(p);
     } else if (args == 1) {
-      AST_Parameter *p = new AST_Args(line, start, stop);
+      AST_Parameter *p = this->tree.make<AST_Args>(line, start, stop);
       params.push_back(p);
     } else {
-      AST_Parameter *p = new AST_Kwargs(line, start, stop);
+      AST_Parameter *p = this->tree.make<AST_Kwargs>(line, start, stop);
       params.push_back(p);
     }
 
@@ -273,11 +371,11 @@ std::vector<AST_Parameter *> Parser::function_parameters() {
 
 // This parsers ends when current() = RCURL
 AST_Block *Parser::block() {
-  Token &tk = this->current();
-  int line = tk.y;
-  int start = tk.x;
-  int stop = tk.x + tk.lexeme.length() - 1;
-  AST_Block *node = new AST_Block(line, start, stop);
+  Token tk = this->current();
+  int line = this->source.line(tk);
+  int start = tk.offset;
+  int stop = tk.end();
+  AST_Block *node = this->tree.make<AST_Block>(line, start, stop);
 
   while (true) {
     // Skip all newlines at the beginning of looking for statements
@@ -293,10 +391,11 @@ AST_Block *Parser::block() {
     if (expr != nullptr)
       node->append(expr);
 
-    std::cout << "After expression: " << this->current().lexeme << std::endl;
+    std::cout << "After expression: " << this->source.lexeme(this->current())
+              << std::endl;
 
     while (true) {
-      Token &tk = this->current();
+      Token tk = this->current();
       if (tk.type == Token::Type::NEWLINE || tk.type == Token::Type::SEMICOLON)
         break;
 
@@ -307,8 +406,8 @@ AST_Block *Parser::block() {
       if (tk.type == Token::Type::END_OF_FILE ||
           tk.type == Token::Type::RCURL) {
         this->reporter->new_error(
-            Error::Type::SYNTAX_ERROR, tk.y, tk.x,
-            tk.x + tk.lexeme.length() - 1, Error::Flag::ABORT,
+            Error::Type::SYNTAX_ERROR, this->source.line(tk), tk.offset,
+            tk.end(), Error::Flag::ABORT,
             "Expected a semicolon or newline to close the previous statement");
         return node;
       }
@@ -329,10 +428,10 @@ std::vector<AST_Node *> Parser::call_arguments() {
     return args;
 
   while (this->current().type != Token::Type::RPAREN) {
-    Token &tk = this->current();
-    int line = tk.y;
-    int start = tk.x;
-    int stop = tk.x + tk.lexeme.length() - 1;
+    Token tk = this->current();
+    int line = this->source.line(tk);
+    int start = tk.offset;
+    int stop = tk.end();
 
     if (args.size() > 255) {
       this->reporter->new_error(
@@ -345,12 +444,12 @@ std::vector<AST_Node *> Parser::call_arguments() {
     AST_Node *expr = this->expression();
 
     if (this->peek_consume_if(Token::Type::EQUAL)) {
-      Token &tk = this->current();
-      int line = tk.y;
-      int start = tk.x;
-      int stop = tk.x + tk.lexeme.length() - 1;
-      AST_Assignment *init =
-          new AST_Assignment(AST_Op::INITIALIZER, line, start, stop);
+      Token tk = this->current();
+      int line = this->source.line(tk);
+      int start = tk.offset;
+      int stop = tk.end();
+      AST_Assignment *init = this->tree.make<AST_Assignment>(
+          AST_Op::INITIALIZER, line, start, stop);
 
       this->pos++;
 
@@ -371,9 +470,9 @@ std::vector<AST_Node *> Parser::call_arguments() {
     break;
 
     tk = this->current();
-    line = tk.y;
-    start = tk.x;
-    stop = tk.x + tk.lexeme.length() - 1;
+    line = this->source.line(tk);
+    start = tk.offset;
+    stop = tk.end();
     this->reporter->new_error(
         Error::Type::SYNTAX_ERROR, line, start, stop, Error::Flag::ABORT,
         "Expected an ')' to close function call argument, did you forget a "
@@ -384,10 +483,10 @@ std::vector<AST_Node *> Parser::call_arguments() {
   return args;
 }
 
-AST_Node *Parser::array_literal(Token &tk) {
-  int line = tk.y;
-  int start = tk.x;
-  int stop = tk.x + tk.lexeme.length() - 1;
+AST_Node *Parser::array_literal(Token tk) {
+  int line = this->source.line(tk);
+  int start = tk.offset;
+  int stop = tk.end();
 
   this->pos++; // consume [
 
@@ -401,9 +500,9 @@ AST_Node *Parser::array_literal(Token &tk) {
     AST_Node *expr = this->expression();
     if (expr == nullptr) {
       tk = this->current();
-      line = tk.y;
-      start = tk.x;
-      stop = tk.x + tk.lexeme.length() - 1;
+      line = this->source.line(tk);
+      start = tk.offset;
+      stop = tk.end();
 
       this->reporter->new_error(Error::Type::SYNTAX_ERROR, line, start, stop,
                                 Error::Flag::ABORT,
@@ -418,9 +517,9 @@ AST_Node *Parser::array_literal(Token &tk) {
       break;
     } else {
       tk = this->current();
-      line = tk.y;
-      start = tk.x;
-      stop = tk.x + tk.lexeme.length() - 1;
+      line = this->source.line(tk);
+      start = tk.offset;
+      stop = tk.end();
 
       this->reporter->new_error(
           Error::Type::SYNTAX_ERROR, line, start, stop, Error::Flag::ABORT,
@@ -430,7 +529,8 @@ AST_Node *Parser::array_literal(Token &tk) {
   }
 
   // current = RBRAC
-  AST_Array_Literal *node = new AST_Array_Literal(line, start, stop);
+  AST_Array_Literal *node =
+      this->tree.make<AST_Array_Literal>(line, start, stop);
   node->elems = elems;
   return node;
 }
@@ -440,27 +540,36 @@ AST_Node *Parser::array_literal(Token &tk) {
 // ---------------------------------------------------------------------
 
 AST_Node *Parser::primary() {
-  Token &tk = this->current();
-  int line = tk.y;
-  int start = tk.x;
-  int stop = tk.x + tk.lexeme.length() - 1;
+  Token tk = this->current();
+  int line = this->source.line(tk);
+  int start = tk.offset;
+  int stop = tk.end();
 
-  std::cout << "Starting primary: " << tk.lexeme << std::endl;
+  std::cout << "Starting primary: " << this->source.lexeme(tk) << std::endl;
 
   switch (tk.type) {
   case Token::Type::NEWLINE:
     this->pos++;
     return this->primary();
   case Token::Type::SYMBOL: {
-    AST_Node *n = new AST_Symbol(std::string{tk.lexeme}, line, start, stop);
+    AST_Node *n = this->tree.make<AST_Symbol>(
+        Symbol_Id::intern(this->source.lexeme(tk)), line, start, stop);
     return n;
   }
   case Token::Type::STRING: {
-    AST_Node *n = new AST_String(std::string(tk.lexeme), line, start, stop);
+    // The lexeme has its quotes, unless the literal ran into the end of the
+    // source before it was closed
+    std::string_view text = this->source.lexeme(tk).substr(1);
+    if (!text.empty() && text.back() == '"')
+      text.remove_suffix(1);
+    bool escaped = scan_escape(text.data(), 0, text.size()) < text.size();
+    AST_Node *n =
+        this->tree.make<AST_String>(text, escaped, line, start, stop);
     return n;
   }
   case Token::Type::NUMBER:
-    return parse_number(std::string{tk.lexeme}, line, start, stop);
+    return parse_number(this->tree, this->reporter, this->source.lexeme(tk),
+                        line, start, stop);
   case Token::Type::LBRAC:
     return this->array_literal(tk);
   default: {
@@ -473,10 +582,10 @@ AST_Node *Parser::primary() {
 }
 
 AST_Node *Parser::function() {
-  Token &tk = this->current();
-  int line = tk.y;
-  int start = tk.x;
-  int stop = tk.x + tk.lexeme.length() - 1;
+  Token tk = this->current();
+  int line = this->source.line(tk);
+  int start = tk.offset;
+  int stop = tk.end();
 
   if (tk.type == Token::Type::FUNCTION) {
     if (!this->peek_consume_if(Token::Type::LPAREN)) {
@@ -497,7 +606,7 @@ AST_Node *Parser::function() {
       // (todo) enforce return_type
     }
 
-    AST_Function *node = new AST_Function(line, start, stop);
+    AST_Function *node = this->tree.make<AST_Function>(line, start, stop);
 
     while (this->peek_consume_if(Token::Type::NEWLINE))
       this->pos++;
@@ -521,259 +630,144 @@ AST_Node *Parser::function() {
   return this->primary();
 }
 
-AST_Node *Parser::call() {
-  AST_Node *expr = this->function();
-
-  while (true) {
-    if (this->peek_consume_if(Token::Type::LPAREN)) {
-      Token &tk = this->current();
-      int line = tk.y;
-      int start = tk.x;
-      int stop = tk.x + tk.lexeme.length() - 1;
+AST_Node *Parser::call(AST_Node *callee) {
+  Token tk = this->current();
+  int line = this->source.line(tk);
+  int start = tk.offset;
+  int stop = tk.end();
 
-      AST_Call *node = new AST_Call(expr, line, start, stop);
-      this->pos++;
+  AST_Call *node = this->tree.make<AST_Call>(callee, line, start, stop);
+  this->pos++;
 
-      // Use expression as the callee
-      std::vector<AST_Node *> args = this->call_arguments();
-      if (this->current().type != Token::Type::RPAREN) {
-        std::cerr << "ERROR parsing function args missing RPAREN" << std::endl;
-        // return nullptr;
+  std::vector<AST_Node *> args = this->call_arguments();
+  if (this->current().type != Token::Type::RPAREN) {
+    std::cerr << "ERROR parsing function args missing RPAREN" << std::endl;
 
-        this->reporter->new_error(
-            Error::Type::SYNTAX_ERROR, line, start, stop, Error::Flag::ABORT,
-            "This function call is missing the closing ')'");
-
-        // try returning whatever this ended up being, although it may shoot us
-        // in the foot
-      }
+    this->reporter->new_error(Error::Type::SYNTAX_ERROR, line, start, stop,
+                              Error::Flag::ABORT,
+                              "This function call is missing the closing ')'");
 
-      node->args = args;
-      expr = node;
-      std::cout << "After call: " << this->current().lexeme << std::endl;
-    } else
-      break;
+    // try returning whatever this ended up being, although it may shoot us
+    // in the foot
   }
 
-  return expr;
+  node->args = args;
+  std::cout << "After call: " << this->source.lexeme(this->current())
+            << std::endl;
+  return node;
 }
 
-AST_Node *Parser::lookup() {
-  AST_Node *expr = this->call();
-
-  while (true) {
-    if (this->peek_consume_if(Token::Type::LBRAC)) {
-      Token &tk = this->current();
-      int line = tk.y;
-      int start = tk.x;
-      int stop = tk.x + tk.lexeme.length() - 1;
-      AST_Lookup *node = new AST_Lookup(expr, line, start, stop);
-
-      // Get the index
-      this->pos++;
-      AST_Node *right = this->term();
-      node->right = right;
-
-      if (!this->peek_consume_if_ignore_newlines(Token::Type::RBRAC)) {
-        Token &tk = this->current();
-        int line = tk.y;
-        int start = tk.x;
-        int stop = tk.x + tk.lexeme.length() - 1;
-        this->reporter->new_error(Error::Type::SYNTAX_ERROR, line, start, stop,
-                                  Error::Flag::ABORT,
-                                  "Expected a ']' to close the array lookup");
-        // pretend like we consumed it anyway
-      }
-      std::cout << "after the lookip: " << this->current().lexeme << std::endl;
-      expr = node;
-    } else
-      break;
+AST_Node *Parser::lookup(AST_Node *left) {
+  Token tk = this->current();
+  int line = this->source.line(tk);
+  int start = tk.offset;
+  int stop = tk.end();
+  AST_Lookup *node = this->tree.make<AST_Lookup>(left, line, start, stop);
+
+  // Get the index
+  this->pos++;
+  node->right = this->expression();
+
+  if (!this->peek_consume_if_ignore_newlines(Token::Type::RBRAC)) {
+    Token tk = this->current();
+    int line = this->source.line(tk);
+    int start = tk.offset;
+    int stop = tk.end();
+    this->reporter->new_error(Error::Type::SYNTAX_ERROR, line, start, stop,
+                              Error::Flag::ABORT,
+                              "Expected a ']' to close the array lookup");
+    // pretend like we consumed it anyway
   }
-
-  return expr;
+  std::cout << "after the lookip: " << this->source.lexeme(this->current())
+            << std::endl;
+  return node;
 }
 
-AST_Node *Parser::unary() {
+// Any operator token in prefix position is a unary operator
+AST_Node *Parser::prefix() {
   auto op = operator_from_token(this->current());
   if (op) {
-    Token &tk = this->current();
-    int line = tk.y;
-    int start = tk.x;
-    int stop = tk.x + tk.lexeme.length() - 1;
-    AST_Unary *n = new AST_Unary(*op, line, start, stop);
+    Token tk = this->current();
+    int line = this->source.line(tk);
+    int start = tk.offset;
+    int stop = tk.end();
+    AST_Unary *n = this->tree.make<AST_Unary>(*op, line, start, stop);
 
     // Get the operand
     this->pos++;
-    AST_Node *operand = this->unary();
-
-    n->operand = operand;
-    return n;
-  }
-  return this->lookup();
-}
-
-AST_Node *Parser::factor() {
-  AST_Node *expr = this->unary();
-
-  if (this->peek_consume_if(std::vector{Token::Type::SLASH, Token::Type::STAR,
-                                        Token::Type::MODULO})) {
-    Token &tk = this->current();
-    int line = tk.y;
-    int start = tk.x;
-    int stop = tk.x + tk.lexeme.length() - 1;
-    AST_Op op = *(operator_from_token(tk));
-    AST_Binary *n = new AST_Binary(op, line, start, stop);
-
-    // Get the right node
-    this->pos++;
-    AST_Node *right = this->factor();
-    n->right = right;
-    n->left = expr;
+    n->operand = this->expression(Precedence::PREFIX);
     return n;
   }
-  return expr;
+  return this->function();
 }
 
-AST_Node *Parser::term() {
-  AST_Node *expr = this->factor();
+// Builds the node for the infix operator at `current()`, whose left operand
+// has already been parsed
+AST_Node *Parser::infix(AST_Node *left, const Infix_Rule &rule) {
+  if (rule.kind == AST_Node::Type::Call)
+    return this->call(left);
+  if (rule.kind == AST_Node::Type::Lookup)
+    return this->lookup(left);
+
+  Token tk = this->current();
+  int line = this->source.line(tk);
+  int start = tk.offset;
+  int stop = tk.end();
+  AST_Op op = *(operator_from_token(tk));
+
+  // Right-associative operators let the right side hold another operator of
+  // the same precedence, left-associative ones stop there
+  Precedence next = rule.precedence;
+  if (rule.right_assoc)
+    next = static_cast<Precedence>(static_cast<uint8_t>(next) - 1);
+  this->pos++;
+  AST_Node *right = this->expression(next);
+
+  switch (rule.kind) {
+  case AST_Node::Type::Assignment: {
+    AST_Assignment *n =
+        this->tree.make<AST_Assignment>(op, line, start, stop);
 
-  if (this->peek_consume_if(
-          std::vector{Token::Type::PLUS, Token::Type::MINUS})) {
-    Token &tk = this->current();
-    int line = tk.y;
-    int start = tk.x;
-    int stop = tk.x + tk.lexeme.length() - 1;
-    AST_Op op = *(operator_from_token(tk));
-    AST_Binary *n = new AST_Binary(op, line, start, stop);
+    // Assert the type of assignee
+    if (!node_cast<AST_Symbol>(left)) {
+      this->error_here(Error::Type::SYNTAX_ERROR, Error::Flag::ABORT, left,
+                       "Expected an identifier for assignment expression");
+      return nullptr;
+    }
 
-    // Get the right node
-    this->pos++;
-    AST_Node *right = this->factor();
-    n->right = right;
-    n->left = expr;
+    n->assignee = left;
+    n->value = right;
     return n;
   }
-  return expr;
-}
-
-AST_Node *Parser::equality() {
-  AST_Node *expr = this->term();
-
-  while (this->peek_consume_if(
-      std::vector{Token::Type::EQUAL_EQUAL, Token::Type::BANG_EQUAL,
-                  Token::Type::IS, Token::Type::NOT})) {
-    Token &tk = this->current();
-    int line = tk.y;
-    int start = tk.x;
-    int stop = tk.x + tk.lexeme.length() - 1;
-    AST_Op op = *(operator_from_token(tk));
-    AST_Binary *n = new AST_Binary(op, line, start, stop);
-
-    // Get the right node
-    this->pos++;
-    AST_Node *right = this->term();
+  case AST_Node::Type::Logical: {
+    AST_Logical *n = this->tree.make<AST_Logical>(op, line, start, stop);
+    n->left = left;
     n->right = right;
-    n->left = expr;
     return n;
   }
-  return expr;
-}
-
-AST_Node *Parser::comparison() {
-  AST_Node *expr = this->equality();
-
-  while (this->peek_consume_if(
-      std::vector{Token::Type::LESS, Token::Type::LESS_EQUAL, Token::Type::MORE,
-                  Token::Type::MORE_EQUAL})) {
-    Token &tk = this->current();
-    int line = tk.y;
-    int start = tk.x;
-    int stop = tk.x + tk.lexeme.length() - 1;
-    AST_Op op = *(operator_from_token(tk));
-    AST_Binary *n = new AST_Binary(op, line, start, stop);
-
-    // Get the right node
-    this->pos++;
-    AST_Node *right = this->term();
+  default: {
+    AST_Binary *n = this->tree.make<AST_Binary>(op, line, start, stop);
+    n->left = left;
     n->right = right;
-    n->left = expr;
     return n;
   }
-  return expr;
-}
-
-AST_Node *Parser::logical_and() {
-  AST_Node *expr = this->comparison();
-
-  while (this->peek_consume_if(Token::Type::BAR_BAR)) {
-    Token &tk = this->current();
-    int line = tk.y;
-    int start = tk.x;
-    int stop = tk.x + tk.lexeme.length() - 1;
-    AST_Op op = *(operator_from_token(tk));
-    AST_Logical *n = new AST_Logical(op, line, start, stop);
-
-    // Get the right node
-    this->pos++;
-    AST_Node *right = this->comparison();
-    n->right = right;
-    n->left = expr;
-    return n;
   }
-  return expr;
 }
 
-AST_Node *Parser::logical_or() {
-  AST_Node *expr = this->logical_and();
+// Pratt parser: parse one operand, then keep folding it into the left side of
+// every following operator that binds tighter than `min_precedence`
+AST_Node *Parser::expression(Precedence min_precedence) {
+  AST_Node *expr = this->prefix();
 
-  while (this->peek_consume_if(Token::Type::BAR_BAR)) {
-    Token &tk = this->current();
-    int line = tk.y;
-    int start = tk.x;
-    int stop = tk.x + tk.lexeme.length() - 1;
-    AST_Op op = *(operator_from_token(tk));
-    AST_Logical *n = new AST_Logical(op, line, start, stop);
+  while (true) {
+    const Infix_Rule &rule = infix_rules[this->peek().type];
+    if (rule.precedence <= min_precedence)
+      break;
 
-    // Get the right node
     this->pos++;
-    AST_Node *right = this->logical_and();
-    n->right = right;
-    n->left = expr;
-    return n;
+    expr = this->infix(expr, rule);
   }
-  return expr;
-}
-
-AST_Node *Parser::assignment() {
-  AST_Node *expr = this->logical_or();
-
-  if (this->peek_consume_if(std::vector{Token::Type::ARROW,
-                                        Token::Type::PLUS_EQUAL,
-                                        Token::Type::MINUS_EQUAL})) {
-    Token &tk = this->current();
-    int line = tk.y;
-    int start = tk.x;
-    int stop = tk.x + tk.lexeme.length() - 1;
-
-    AST_Op op = *(operator_from_token(tk));
-    this->pos++;
-    AST_Assignment *n = new AST_Assignment(op, line, start, stop);
-
-    // Get the value node
-    AST_Node *value = this->expression();
-
-    // Assert the type of assignee
-    AST_Symbol *symbol = dynamic_cast<AST_Symbol *>(expr);
-    if (!symbol) {
-      this->error_here(Error::Type::SYNTAX_ERROR, Error::Flag::ABORT, expr,
-                       "Expected an identifier for assignment expression");
-      return nullptr;
-    }
 
-    n->assignee = expr;
-    n->value = value;
-    return n;
-  }
   return expr;
 }
 
@@ -783,7 +777,7 @@ AST_Node *Parser::expression() {
     this->pos++;
     return this->expression();
   }
-  return this->assignment();
+  return this->expression(Precedence::NONE);
 }
 
 // ---------------------------------------------------------------------
@@ -792,7 +786,7 @@ AST_Node *Parser::expression() {
 
 void Parser::skip_to_endof_statement() {
   while (true) {
-    Token &tk = this->current();
+    Token tk = this->current();
     switch (tk.type) {
     case Token::Type::NEWLINE:
     case Token::Type::SEMICOLON:
@@ -804,12 +798,12 @@ void Parser::skip_to_endof_statement() {
   }
 }
 
-AST_Node *Parser::if_stmt(Token &token) {
+AST_Node *Parser::if_stmt(Token token) {
   this->pos++; // consume IF
-  int line = token.y;
-  int start = token.x;
-  int stop = token.x + token.lexeme.length() - 1;
-  AST_If_Stmt *node = new AST_If_Stmt(line, start, stop);
+  int line = this->source.line(token);
+  int start = token.offset;
+  int stop = token.end();
+  AST_If_Stmt *node = this->tree.make<AST_If_Stmt>(line, start, stop);
 
   // Get the condition
   // Also, allow this to be a nullptr if neccesary, we still want to parse the
@@ -829,10 +823,10 @@ AST_Node *Parser::if_stmt(Token &token) {
 
     // Expect the RCURL to close
     if (this->current().type != Token::Type::RCURL) {
-      Token &tk = this->current();
-      int line = tk.y;
-      int start = tk.x;
-      int stop = tk.x + tk.lexeme.length() - 1;
+      Token tk = this->current();
+      int line = this->source.line(tk);
+      int start = tk.offset;
+      int stop = tk.end();
 
       // If this breaks then throw a tantrum and do absolutely nothing to fix it
       // so we can return the rest of this crap
@@ -841,14 +835,15 @@ AST_Node *Parser::if_stmt(Token &token) {
                                 "Expected a '}' to close the previous block");
     }
     // this->pos++;
-    std::cout << "IF AFTER BLOCK: " << this->current().lexeme << std::endl;
+    std::cout << "IF AFTER BLOCK: " << this->source.lexeme(this->current())
+              << std::endl;
 
   } else if (this->peek_consume_if_ignore_newlines(Token::Type::END_OF_FILE)) {
     // There is an error here
-    Token &tk = this->current();
-    int line = tk.y;
-    int start = tk.x;
-    int stop = tk.x + tk.lexeme.length() - 1;
+    Token tk = this->current();
+    int line = this->source.line(tk);
+    int start = tk.offset;
+    int stop = tk.end();
     this->reporter->new_error(
         Error::Type::SYNTAX_ERROR, line, start, stop, Error::Flag::ABORT,
         "There is no body statement for this selection statement");
@@ -863,17 +858,17 @@ AST_Node *Parser::if_stmt(Token &token) {
           Error::Type::SYNTAX_ERROR, line, start, stop, Error::Flag::ABORT,
           "The body statement for this selection statement is invalid");
     }
-    std::cout << "Current after the if branch: " << this->current().lexeme
-              << std::endl;
+    std::cout << "Current after the if branch: "
+              << this->source.lexeme(this->current()) << std::endl;
   }
   std::optional<AST_Node *> branch_else = std::nullopt;
 
   if (this->peek_consume_if_ignore_newlines(Token::Type::ELSE)) {
     // this->pos++;
-    Token &tk = this->current();
-    line = tk.y;
-    start = tk.x;
-    stop = tk.x + tk.lexeme.length() - 1;
+    Token tk = this->current();
+    line = this->source.line(tk);
+    start = tk.offset;
+    stop = tk.end();
 
     if (this->peek_consume_if_ignore_newlines(Token::Type::IF)) {
       // This is for an else if block
@@ -895,25 +890,25 @@ AST_Node *Parser::if_stmt(Token &token) {
 
         // Expect the RCURL to close
         if (this->current().type != Token::Type::RCURL) {
-          Token &tk = this->current();
-          int line = tk.y;
-          int start = tk.x;
-          int stop = tk.x + tk.lexeme.length() - 1;
+          Token tk = this->current();
+          int line = this->source.line(tk);
+          int start = tk.offset;
+          int stop = tk.end();
           this->reporter->new_error(
               Error::Type::SYNTAX_ERROR, line, start, stop, Error::Flag::ABORT,
               "Expected a '}' to close the previous block");
         }
         this->pos++;
-        std::cout << "IF AFTER BLOCK DOS: " << this->current().lexeme
-                  << std::endl;
+        std::cout << "IF AFTER BLOCK DOS: "
+                  << this->source.lexeme(this->current()) << std::endl;
 
       } else if (this->peek_consume_if_ignore_newlines(
                      Token::Type::END_OF_FILE)) {
         // There is an error here
-        Token &tk = this->current();
-        int line = tk.y;
-        int start = tk.x;
-        int stop = tk.x + tk.lexeme.length() - 1;
+        Token tk = this->current();
+        int line = this->source.line(tk);
+        int start = tk.offset;
+        int stop = tk.end();
         this->reporter->new_error(Error::Type::SYNTAX_ERROR, line, start, stop,
                                   Error::Flag::ABORT,
                                   "There is no body statement for the else "
@@ -941,24 +936,24 @@ AST_Node *Parser::if_stmt(Token &token) {
   return node;
 }
 
-AST_Node *Parser::initialized_binding(Token &token, bool mut) {
+AST_Node *Parser::initialized_binding(Token token, bool mut) {
   this->pos++; // consume =
-  int line = token.y;
-  int start = token.x;
-  int stop = token.x + token.lexeme.length() - 1;
-  AST_Binding *node =
-      new AST_Binding(mut, std::string{token.lexeme}, line, start, stop);
+  int line = this->source.line(token);
+  int start = token.offset;
+  int stop = token.end();
+  AST_Binding *node = this->tree.make<AST_Binding>(
+      mut, Symbol_Id::intern(this->source.lexeme(token)), line, start, stop);
 
   std::optional<AST_Node *> initializer = this->expression();
   node->initializer = initializer;
   return node;
 }
 
-AST_Node *Parser::enum_declaration(Token &token) {
+AST_Node *Parser::enum_declaration(Token token) {
   this->pos++; // consume ENUM
-  int line = token.y;
-  int start = token.x;
-  int stop = token.x + token.lexeme.length() - 1;
+  int line = this->source.line(token);
+  int start = token.offset;
+  int stop = token.end();
 
   if (this->current().type != Token::Type::SYMBOL) {
     this->reporter->new_error(Error::Type::SYNTAX_ERROR, line, start, stop,
@@ -968,14 +963,15 @@ AST_Node *Parser::enum_declaration(Token &token) {
   }
 
   // Get the symbol for the enum
-  std::string symbol = std::string(this->current().lexeme);
-  AST_Enum_Decl *node = new AST_Enum_Decl(symbol, line, start, stop);
+  Symbol_Id symbol = Symbol_Id::intern(this->source.lexeme(this->current()));
+  AST_Enum_Decl *node =
+      this->tree.make<AST_Enum_Decl>(symbol, line, start, stop);
 
   if (!this->peek_consume_if_ignore_newlines(Token::Type::LCURL)) {
-    Token &tk = this->current();
-    int line = tk.y;
-    int start = tk.x;
-    int stop = tk.x + tk.lexeme.length() - 1;
+    Token tk = this->current();
+    int line = this->source.line(tk);
+    int start = tk.offset;
+    int stop = tk.end();
     this->reporter->new_error(Error::Type::SYNTAX_ERROR, line, start, stop,
                               Error::Flag::ABORT,
                               "Expected '{' after enum declaration.");
@@ -986,16 +982,16 @@ AST_Node *Parser::enum_declaration(Token &token) {
   // Take variants
   while (true) {
     if (this->current().type != Token::Type::SYMBOL) {
-      Token &tk = this->current();
-      int line = tk.y;
-      int start = tk.x;
-      int stop = tk.x + tk.lexeme.length() - 1;
+      Token tk = this->current();
+      int line = this->source.line(tk);
+      int start = tk.offset;
+      int stop = tk.end();
       this->reporter->new_error(
           Error::Type::SYNTAX_ERROR, line, start, stop, Error::Flag::ABORT,
           "Only symbols are allowed in enum declarations");
     } else {
-      std::string variant = std::string(this->current().lexeme);
-      node->variants.push_back(variant);
+      node->variants.push_back(
+          Symbol_Id::intern(this->source.lexeme(this->current())));
     }
 
     if (this->peek_consume_if(
@@ -1007,10 +1003,10 @@ AST_Node *Parser::enum_declaration(Token &token) {
   }
 
   if (!this->peek_consume_if_ignore_newlines(Token::Type::RCURL)) {
-    Token &tk = this->current();
-    int line = tk.y;
-    int start = tk.x;
-    int stop = tk.x + tk.lexeme.length() - 1;
+    Token tk = this->current();
+    int line = this->source.line(tk);
+    int start = tk.offset;
+    int stop = tk.end();
     this->reporter->new_error(Error::Type::SYNTAX_ERROR, line, start, stop,
                               Error::Flag::ABORT,
                               "Expected '}' to close declaration.");
@@ -1020,18 +1016,90 @@ AST_Node *Parser::enum_declaration(Token &token) {
   return node;
 }
 
+// import module [as alias]
+AST_Node *Parser::import_stmt(Token token) {
+  int line = this->source.line(token);
+  int start = token.offset;
+  int stop = token.end();
+
+  if (!this->peek_consume_if(Token::Type::SYMBOL)) {
+    this->reporter->new_error(Error::Type::SYNTAX_ERROR, line, start, stop,
+                              Error::Flag::ABORT,
+                              "Expected a module name after 'import'");
+    return nullptr;
+  }
+  AST_Import *node = this->tree.make<AST_Import>(
+      Symbol_Id::intern(this->source.lexeme(this->current())), line, start,
+      stop);
+
+  if (this->peek_consume_if(Token::Type::AS)) {
+    if (!this->peek_consume_if(Token::Type::SYMBOL)) {
+      this->reporter->new_error(Error::Type::SYNTAX_ERROR, line, start, stop,
+                                Error::Flag::ABORT,
+                                "Expected a name after 'as'");
+      return nullptr;
+    }
+    node->alias = Symbol_Id::intern(this->source.lexeme(this->current()));
+  }
+  return node;
+}
+
+// from module import a, b
+// from module import *
+AST_Node *Parser::from_import(Token token) {
+  int line = this->source.line(token);
+  int start = token.offset;
+  int stop = token.end();
+
+  if (!this->peek_consume_if(Token::Type::SYMBOL)) {
+    this->reporter->new_error(Error::Type::SYNTAX_ERROR, line, start, stop,
+                              Error::Flag::ABORT,
+                              "Expected a module name after 'from'");
+    return nullptr;
+  }
+  AST_Import *node = this->tree.make<AST_Import>(
+      Symbol_Id::intern(this->source.lexeme(this->current())), line, start,
+      stop);
+
+  if (!this->peek_consume_if(Token::Type::IMPORT)) {
+    this->reporter->new_error(Error::Type::SYNTAX_ERROR, line, start, stop,
+                              Error::Flag::ABORT,
+                              "Expected 'import' after the module name");
+    return nullptr;
+  }
+
+  if (this->peek_consume_if(Token::Type::STAR)) {
+    node->items.push_back(Symbol_Id::intern("*"));
+    return node;
+  }
+
+  do {
+    if (!this->peek_consume_if(Token::Type::SYMBOL)) {
+      Token tk = this->peek();
+      this->reporter->new_error(Error::Type::SYNTAX_ERROR, tk,
+                                Error::Flag::ABORT,
+                                "Expected a name to import");
+      return nullptr;
+    }
+    node->items.push_back(
+        Symbol_Id::intern(this->source.lexeme(this->current())));
+  } while (this->peek_consume_if(Token::Type::COMMA));
+  return node;
+}
+
 AST_Node *Parser::end_statement(AST_Node *stmt) {
   this->skip_to_endof_statement();
   return stmt;
 }
 
 AST_Node *Parser::statement() {
-  std::cout << "Entering statement: " << this->current().lexeme << std::endl;
+  std::cout << "Entering statement: " << this->source.lexeme(this->current())
+            << std::endl;
 
-  Token &tk = this->current();
-  int line = tk.y;
-  int start = tk.x;
-  int stop = tk.x + tk.lexeme.length() - 1;
+  Token tk = this->current();
+  int line = this->source.line(tk);
+  int start = tk.offset;
+  int stop = tk.end();
 
   switch (tk.type) {
   case Token::Type::NEWLINE: {
@@ -1050,11 +1118,11 @@ AST_Node *Parser::statement() {
   case Token::Type::RETURN: {
     this->pos++;
     tk = this->current();
-    int line = tk.y;
-    int start = tk.x;
-    int stop = tk.x + tk.lexeme.length() - 1;
+    int line = this->source.line(tk);
+    int start = tk.offset;
+    int stop = tk.end();
 
-    AST_Return *return_node = new AST_Return(line, start, stop);
+    AST_Return *return_node = this->tree.make<AST_Return>(line, start, stop);
 
     if (this->peek().type == Token::Type::NEWLINE ||
         this->peek().type == Token::Type::SEMICOLON ||
@@ -1074,9 +1142,9 @@ AST_Node *Parser::statement() {
   case Token::Type::MUT: {
     this->pos++;
     tk = this->current();
-    int line = tk.y;
-    int start = tk.x;
-    int stop = tk.x + tk.lexeme.length() - 1;
+    int line = this->source.line(tk);
+    int start = tk.offset;
+    int stop = tk.end();
 
     if (tk.type != Token::Type::SYMBOL) {
       this->reporter->new_error(
@@ -1107,6 +1175,12 @@ AST_Node *Parser::statement() {
 
   case Token::Type::IF:
     return this->end_statement(this->if_stmt(tk));
+
+  case Token::Type::IMPORT:
+    return this->end_statement(this->import_stmt(tk));
+
+  case Token::Type::FROM:
+    return this->end_statement(this->from_import(tk));
   }
 
   AST_Node *expr = this->expression();
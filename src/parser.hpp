@@ -3,25 +3,50 @@
 
 #include "ast.hpp"
 #include "errors.hpp"
+#include "lexer.hpp"
 #include "token.hpp"
+#include <cstdint>
 #include <optional>
 #include <vector>
 
+// How tightly an infix operator binds, loosest first
+enum class Precedence : uint8_t {
+  NONE,
+  ASSIGNMENT,
+  LOGICAL_OR,
+  LOGICAL_AND,
+  COMPARISON,
+  EQUALITY,
+  TERM,
+  FACTOR,
+  EXPONENT,
+  PREFIX,
+  POSTFIX,
+};
+
+// What to do when a token shows up after a complete operand
+struct Infix_Rule {
+  Precedence precedence = Precedence::NONE;
+  bool right_assoc = false;
+  AST_Node::Type kind = AST_Node::Type::Binary;
+};
+
 class Parser {
-  std::vector<Token> stream;
-  int pos;
+  Token_Stream &stream;
+  size_t pos;
+  const Source_Map &source;
 
 public:
   Parse_Tree tree;
   Reporter *reporter;
 
-  Parser(std::vector<Token> stream, Reporter *reporter);
+  Parser(Token_Stream &stream, const Source_Map &source, Reporter *reporter);
   void parse();
 
 private:
-  Token &peek();
-  Token &next();
-  Token &current();
+  const Token &peek();
+  const Token &next();
+  const Token &current();
 
   bool peek_consume_if(Token::Type asserted_type);
   bool peek_consume_if(std::vector<Token::Type> asserted_types);
@@ -34,7 +59,7 @@ private:
   std::vector<AST_Parameter *> function_parameters();
   std::vector<AST_Node *> call_arguments();
   // template <size_t n_elems> AST_Array_Literal<n_elems> *array_literal();
-  AST_Node *array_literal(Token &tk);
+  AST_Node *array_literal(Token tk);
 
   void skip_to_endof_statement();
   template <typename T> bool assert_node_type(AST_Node *node);
@@ -43,22 +68,19 @@ private:
 
   AST_Node *primary();
   AST_Node *function();
-  AST_Node *lookup();
-  AST_Node *call();
-  AST_Node *unary();
-  AST_Node *factor();
-  AST_Node *term();
-  AST_Node *equality();
-  AST_Node *comparison();
-  AST_Node *logical_and();
-  AST_Node *logical_or();
-  AST_Node *assignment();
+  AST_Node *call(AST_Node *callee);
+  AST_Node *lookup(AST_Node *left);
+  AST_Node *prefix();
+  AST_Node *infix(AST_Node *left, const Infix_Rule &rule);
+  AST_Node *expression(Precedence min_precedence);
   AST_Node *expression(); // top-level
 
 private:
-  AST_Node *if_stmt(Token &token);
-  AST_Node *initialized_binding(Token &token, bool mut);
-  AST_Node *enum_declaration(Token &token);
+  AST_Node *if_stmt(Token token);
+  AST_Node *initialized_binding(Token token, bool mut);
+  AST_Node *enum_declaration(Token token);
+  AST_Node *import_stmt(Token token);
+  AST_Node *from_import(Token token);
   AST_Node *end_statement(AST_Node *stmt); // wrapper
   AST_Node *statement();                   // top-level
 };
@@ -0,0 +1,250 @@
+#include "peephole.hpp"
+#include "cbc.hpp"
+#include <cstddef>
+#include <iostream>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+static bool is_jump(const CBC_Instruction &i) {
+  return i.code == CBC_Opcode::JUMP || i.code == CBC_Opcode::JUMP_IF_FALSE;
+}
+
+static bool is_store(const CBC_Instruction &i) {
+  return i.code == CBC_Opcode::STORE_CONST || i.code == CBC_Opcode::STORE_VAR;
+}
+
+CBC_Peephole::CBC_Peephole(std::vector<CBC_Instruction> &program,
+                           bool keep_globals)
+    : program(program), keep_globals(keep_globals),
+      rules({
+          {"redundant load", &CBC_Peephole::redundant_load, 0},
+          {"redundant store", &CBC_Peephole::redundant_store, 0},
+          {"move coalescing", &CBC_Peephole::move_coalescing, 0},
+          {"jump threading", &CBC_Peephole::jump_threading, 0},
+          {"dead store", &CBC_Peephole::dead_store, 0},
+          {"dead code", &CBC_Peephole::dead_code, 0},
+      }) {}
+
+size_t CBC_Peephole::run() {
+  size_t total = 0;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (Rule &rule : this->rules) {
+      this->dead.assign(this->program.size(), false);
+      size_t removed = (this->*rule.apply)();
+      if (removed == 0)
+        continue;
+      this->compact();
+      rule.removed += removed;
+      total += removed;
+      changed = true;
+    }
+  }
+  return total;
+}
+
+void CBC_Peephole::print_stats() const {
+  std::cout << "[peephole]";
+  for (const Rule &rule : this->rules)
+    std::cout << " " << rule.name << " " << rule.removed << ",";
+  std::cout << " " << this->program.size() << " instruction(s) left"
+            << std::endl;
+}
+
+// ---------------------------------------------------------------------
+// HELPERS
+// ---------------------------------------------------------------------
+
+std::vector<bool> CBC_Peephole::leaders() const {
+  std::vector<bool> leader(this->program.size() + 1, false);
+  leader[0] = true;
+  for (size_t pc = 0; pc < this->program.size(); pc++) {
+    const CBC_Instruction &i = this->program[pc];
+    if (!is_jump(i))
+      continue;
+    leader[i.o2] = true;
+    leader[pc + 1] = true;
+  }
+  return leader;
+}
+
+void CBC_Peephole::rename(int from, int to) {
+  for (CBC_Instruction &i : this->program) {
+    CBC_Instruction::Registers rs = i.registers();
+    for (int n : rs.uses)
+      if (n != 0 && i.operand(n) == from)
+        i.set_operand(n, to);
+  }
+}
+
+// A jump to a removed instruction lands on the next one that's left
+void CBC_Peephole::compact() {
+  size_t n = this->program.size();
+  std::vector<long long int> moved(n + 1);
+  size_t kept = 0;
+  for (size_t pc = 0; pc < n; pc++) {
+    moved[pc] = kept;
+    if (!this->dead[pc])
+      this->program[kept++] = this->program[pc];
+  }
+  moved[n] = kept;
+  this->program.erase(this->program.begin() + kept, this->program.end());
+
+  for (CBC_Instruction &i : this->program)
+    if (is_jump(i))
+      i.o2 = moved[i.o2];
+}
+
+// ---------------------------------------------------------------------
+// RULES
+// ---------------------------------------------------------------------
+
+size_t CBC_Peephole::redundant_load() {
+  std::vector<bool> leader = this->leaders();
+  std::unordered_map<long long int, int> globals;   // slot -> register
+  std::unordered_map<long long int, int> constants; // constant -> register
+  size_t removed = 0;
+
+  for (size_t pc = 0; pc < this->program.size(); pc++) {
+    if (leader[pc]) {
+      globals.clear();
+      constants.clear();
+    }
+
+    CBC_Instruction &i = this->program[pc];
+    switch (i.code) {
+    case CBC_Opcode::STORE_CONST:
+    case CBC_Opcode::STORE_VAR:
+      globals[i.o2] = i.o1;
+      break;
+    case CBC_Opcode::LOAD_GLOBAL:
+    case CBC_Opcode::LOAD_CONST: {
+      auto &known = i.code == CBC_Opcode::LOAD_GLOBAL ? globals : constants;
+      auto [found, added] = known.try_emplace(i.o2, i.o1);
+      if (added)
+        break;
+      this->rename(i.o1, found->second);
+      this->dead[pc] = true;
+      removed++;
+      break;
+    }
+    case CBC_Opcode::CALL:
+      // Could store to any global
+      globals.clear();
+      break;
+    default:
+      break;
+    }
+  }
+  return removed;
+}
+
+size_t CBC_Peephole::redundant_store() {
+  std::vector<bool> leader = this->leaders();
+  std::unordered_map<long long int, size_t> pending; // slot -> unread store
+  size_t removed = 0;
+
+  for (size_t pc = 0; pc < this->program.size(); pc++) {
+    if (leader[pc])
+      pending.clear();
+
+    const CBC_Instruction &i = this->program[pc];
+    if (is_store(i)) {
+      auto [found, added] = pending.try_emplace(i.o2, pc);
+      if (!added) {
+        this->dead[found->second] = true;
+        found->second = pc;
+        removed++;
+      }
+    } else if (i.code == CBC_Opcode::LOAD_GLOBAL) {
+      pending.erase(i.o2);
+    } else if (i.code == CBC_Opcode::CALL || i.code == CBC_Opcode::QUIT) {
+      // Anything might be read from here on
+      pending.clear();
+    }
+  }
+  return removed;
+}
+
+size_t CBC_Peephole::move_coalescing() {
+  size_t removed = 0;
+  for (size_t pc = 0; pc < this->program.size(); pc++) {
+    const CBC_Instruction &i = this->program[pc];
+    if (i.code != CBC_Opcode::MOVE)
+      continue;
+    this->rename(i.o1, i.o2);
+    this->dead[pc] = true;
+    removed++;
+  }
+  return removed;
+}
+
+size_t CBC_Peephole::jump_threading() {
+  size_t n = this->program.size();
+  size_t removed = 0;
+
+  for (size_t pc = 0; pc < n; pc++) {
+    CBC_Instruction &i = this->program[pc];
+    if (!is_jump(i))
+      continue;
+
+    // Follow chains of unconditional jumps, stopping if they loop
+    for (size_t hops = 0; hops < n; hops++) {
+      const CBC_Instruction &target = this->program[i.o2];
+      if (target.code != CBC_Opcode::JUMP || target.o2 == i.o2)
+        break;
+      i.o2 = target.o2;
+    }
+
+    if (i.o2 == (long long int)pc + 1) {
+      this->dead[pc] = true;
+      removed++;
+    }
+  }
+  return removed;
+}
+
+size_t CBC_Peephole::dead_store() {
+  if (this->keep_globals)
+    return 0;
+
+  std::unordered_set<long long int> read;
+  for (const CBC_Instruction &i : this->program)
+    if (i.code == CBC_Opcode::LOAD_GLOBAL || i.code == CBC_Opcode::CALL)
+      read.insert(i.o2);
+
+  size_t removed = 0;
+  for (size_t pc = 0; pc < this->program.size(); pc++) {
+    const CBC_Instruction &i = this->program[pc];
+    if (is_store(i) && read.count(i.o2) == 0) {
+      this->dead[pc] = true;
+      removed++;
+    }
+  }
+  return removed;
+}
+
+// Only loads of constants and moves can go, everything else may still fail
+// at runtime
+size_t CBC_Peephole::dead_code() {
+  std::unordered_set<long long int> used;
+  for (const CBC_Instruction &i : this->program) {
+    CBC_Instruction::Registers rs = i.registers();
+    for (int n : rs.uses)
+      if (n != 0)
+        used.insert(i.operand(n));
+  }
+
+  size_t removed = 0;
+  for (size_t pc = 0; pc < this->program.size(); pc++) {
+    const CBC_Instruction &i = this->program[pc];
+    if ((i.code == CBC_Opcode::LOAD_CONST || i.code == CBC_Opcode::MOVE) &&
+        used.count(i.o1) == 0) {
+      this->dead[pc] = true;
+      removed++;
+    }
+  }
+  return removed;
+}
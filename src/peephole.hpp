@@ -0,0 +1,66 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include "cbc.hpp"
+#include <cstddef>
+#include <vector>
+
+// Small local rewrites over a compiled program, run at `-O1` before register
+// allocation. At that point every virtual register is written exactly once,
+// which is what makes renaming one register to another safe.
+//
+// Each rule is one entry of `rules` and walks the whole program, marking the
+// instructions it makes useless. They're run in order, over and over, until
+// none of them finds anything. Removed instructions are dropped between rules
+// and jump targets moved to match
+class CBC_Peephole {
+public:
+  struct Rule {
+    const char *name;
+    size_t (CBC_Peephole::*apply)();
+    size_t removed;
+  };
+
+  // With `keep_globals`, every global keeps its last store even if the
+  // program never reads it, for modules whose globals are imported
+  CBC_Peephole(std::vector<CBC_Instruction> &program,
+               bool keep_globals = false);
+
+  // Returns how many instructions were removed in total
+  size_t run();
+  void print_stats() const;
+
+private:
+  std::vector<CBC_Instruction> &program;
+  bool keep_globals;
+  std::vector<bool> dead;
+  std::vector<Rule> rules;
+
+  // A second load of a global just stored, or of a constant already loaded,
+  // in the same basic block reuses the register that has it
+  size_t redundant_load();
+
+  // A store to a global that's stored again before anything can read it
+  size_t redundant_store();
+
+  // `MOVE a, b` goes away by reading `b` wherever `a` was read
+  size_t move_coalescing();
+
+  // Jumps to jumps go straight to the final target, and jumps to the next
+  // instruction are dropped
+  size_t jump_threading();
+
+  // Stores to globals nothing in the program ever reads
+  size_t dead_store();
+
+  // Constant loads and moves into registers nothing reads
+  size_t dead_code();
+
+  // Where each basic block starts: the first instruction, jump targets and
+  // whatever follows a jump
+  std::vector<bool> leaders() const;
+  void rename(int from, int to);
+  void compact();
+};
+
+#endif
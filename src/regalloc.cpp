@@ -0,0 +1,199 @@
+#include "regalloc.hpp"
+#include "cbc.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+CBC_Register_Allocator::CBC_Register_Allocator(
+    std::vector<CBC_Instruction> &program, size_t virtual_registers,
+    int registers)
+    : program(program), registers(registers),
+      intervals(virtual_registers, Interval{-1, -1}) {
+  this->stats.virtual_registers = virtual_registers;
+}
+
+CBC_Register_Stats CBC_Register_Allocator::run() {
+  this->build_intervals();
+  this->scan();
+  this->rewrite();
+  return this->stats;
+}
+
+static bool is_jump(const CBC_Instruction &i) {
+  return i.code == CBC_Opcode::JUMP || i.code == CBC_Opcode::JUMP_IF_FALSE;
+}
+
+// ---------------------------------------------------------------------
+// LIVE INTERVALS
+// ---------------------------------------------------------------------
+
+void CBC_Register_Allocator::build_intervals() {
+  for (size_t pc = 0; pc < this->program.size(); pc++) {
+    const CBC_Instruction &i = this->program[pc];
+    CBC_Instruction::Registers rs = i.registers();
+    for (int n : {rs.def, rs.uses[0], rs.uses[1]}) {
+      if (n == 0)
+        continue;
+      Interval &interval = this->intervals[i.operand(n)];
+      if (interval.start < 0)
+        interval.start = pc;
+      interval.end = std::max(interval.end, (int)pc);
+    }
+  }
+
+  // Anything live on entry to a loop has to stay live until its back edge.
+  // Stretching one interval can put it across another loop's entry, so this
+  // repeats until nothing changes
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t pc = 0; pc < this->program.size(); pc++) {
+      const CBC_Instruction &i = this->program[pc];
+      if (!is_jump(i) || i.o2 > (long long int)pc)
+        continue;
+      int target = i.o2;
+      for (Interval &interval : this->intervals) {
+        if (interval.start < target && interval.end >= target &&
+            interval.end < (int)pc) {
+          interval.end = pc;
+          changed = true;
+        }
+      }
+    }
+  }
+}
+
+// ---------------------------------------------------------------------
+// LINEAR SCAN
+// ---------------------------------------------------------------------
+
+void CBC_Register_Allocator::scan() {
+  std::vector<int> order;
+  for (size_t v = 0; v < this->intervals.size(); v++)
+    if (this->intervals[v].start >= 0)
+      order.push_back(v);
+  std::sort(order.begin(), order.end(), [&](int a, int b) {
+    return this->intervals[a].start < this->intervals[b].start;
+  });
+
+  std::vector<bool> in_use(this->registers, false);
+  std::vector<int> active; // sorted by end, soonest first
+  int slots = 0;
+
+  auto by_end = [&](int a, int b) {
+    return this->intervals[a].end < this->intervals[b].end;
+  };
+  auto activate = [&](int v) {
+    active.insert(std::upper_bound(active.begin(), active.end(), v, by_end), v);
+  };
+
+  for (int v : order) {
+    Interval &current = this->intervals[v];
+
+    // Reading an operand and writing the result happen in the same
+    // instruction, so an interval ending right where this one starts is
+    // already done with its register
+    while (!active.empty() &&
+           this->intervals[active.front()].end <= current.start) {
+      in_use[this->intervals[active.front()].reg] = false;
+      active.erase(active.begin());
+    }
+
+    auto free = std::find(in_use.begin(), in_use.end(), false);
+    if (free != in_use.end()) {
+      current.reg = free - in_use.begin();
+      in_use[current.reg] = true;
+      activate(v);
+      continue;
+    }
+
+    // Out of registers. Whichever of these lives longest gets spilled, since
+    // that frees a register for the most instructions
+    this->stats.spilled++;
+    Interval &last = this->intervals[active.back()];
+    if (last.end > current.end) {
+      current.reg = last.reg;
+      last.reg = -1;
+      last.slot = slots++;
+      active.pop_back();
+      activate(v);
+    } else {
+      current.slot = slots++;
+    }
+  }
+
+  for (const Interval &interval : this->intervals)
+    if (interval.reg >= 0)
+      this->stats.physical_registers = std::max(
+          this->stats.physical_registers, (size_t)interval.reg + 1);
+}
+
+// ---------------------------------------------------------------------
+// REWRITING
+// ---------------------------------------------------------------------
+
+void CBC_Register_Allocator::rewrite() {
+  std::vector<CBC_Instruction> out;
+  out.reserve(this->program.size());
+
+  // Where each original instruction ended up, for fixing jump targets
+  std::vector<long long int> moved(this->program.size() + 1);
+
+  for (size_t pc = 0; pc < this->program.size(); pc++) {
+    moved[pc] = out.size();
+    CBC_Instruction i = this->program[pc];
+    CBC_Instruction::Registers rs = i.registers();
+
+    // Both operands may be the same spilled value, which only needs the one
+    // reload
+    int scratch = this->registers;
+    int reloaded = -1;
+    for (int n : rs.uses) {
+      if (n == 0)
+        continue;
+      int v = i.operand(n);
+      const Interval &interval = this->intervals[v];
+      if (interval.slot < 0) {
+        i.set_operand(n, interval.reg);
+      } else if (v == reloaded) {
+        i.set_operand(n, scratch - 1);
+      } else {
+        CBC_Instruction reload = CBC_Instruction(
+            CBC_Opcode::RELOAD, scratch, (long long int)interval.slot);
+        reload.line = i.line;
+        out.push_back(reload);
+        this->stats.spill_code++;
+        i.set_operand(n, scratch++);
+        reloaded = v;
+      }
+    }
+
+    const Interval *spilled = nullptr;
+    if (rs.def != 0) {
+      const Interval &interval = this->intervals[i.operand(rs.def)];
+      if (interval.slot < 0) {
+        i.set_operand(rs.def, interval.reg);
+      } else {
+        i.set_operand(rs.def, this->registers);
+        spilled = &interval;
+      }
+    }
+
+    out.push_back(i);
+    if (spilled) {
+      CBC_Instruction spill = CBC_Instruction(
+          CBC_Opcode::SPILL, this->registers, (long long int)spilled->slot);
+      spill.line = i.line;
+      out.push_back(spill);
+      this->stats.spill_code++;
+    }
+  }
+  moved[this->program.size()] = out.size();
+
+  if (this->stats.spill_code != 0)
+    for (CBC_Instruction &i : out)
+      if (is_jump(i))
+        i.o2 = moved[i.o2];
+
+  this->program = std::move(out);
+}
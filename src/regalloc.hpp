@@ -0,0 +1,58 @@
+#ifndef REGALLOC_H
+#define REGALLOC_H
+
+#include "cbc.hpp"
+#include <cstddef>
+#include <vector>
+
+// Two physical registers are kept back from allocation so that spilled values
+// always have somewhere to be reloaded into
+constexpr int CBC_SCRATCH_REGISTERS = 2;
+constexpr int CBC_ALLOCATABLE = CBC_REGISTERS - CBC_SCRATCH_REGISTERS;
+
+// Linear-scan register allocation over a compiled CBC program. The compiler
+// gives every value its own virtual register, numbered from 0, and this maps
+// them onto the physical register file:
+//
+//   1. Each virtual register gets a live interval from the instruction that
+//      writes it to the last one that reads it. Intervals that are live into
+//      the target of a backwards jump are stretched to the jump, so values
+//      survive a loop
+//   2. Intervals are walked in order of their start. Ones that have ended give
+//      their register back first, so a result can take the register of an
+//      operand it was computed from
+//   3. When every register is in use, whichever interval ends last is spilled
+//      and lives in a spill slot instead
+//
+// Spilled values are reloaded into a scratch register right before each read
+// and saved right after each write. Jump targets are moved to account for the
+// added instructions
+class CBC_Register_Allocator {
+public:
+  // `registers` is how many physical registers may be handed out, which is
+  // only ever lowered to exercise spilling
+  CBC_Register_Allocator(std::vector<CBC_Instruction> &program,
+                         size_t virtual_registers,
+                         int registers = CBC_ALLOCATABLE);
+
+  CBC_Register_Stats run();
+
+private:
+  struct Interval {
+    int start;
+    int end;
+    int reg = -1;
+    int slot = -1; // spill slot, if it didn't get a register
+  };
+
+  std::vector<CBC_Instruction> &program;
+  int registers;
+  std::vector<Interval> intervals; // indexed by virtual register
+  CBC_Register_Stats stats;
+
+  void build_intervals();
+  void scan();
+  void rewrite();
+};
+
+#endif
@@ -0,0 +1,273 @@
+#include "scan.hpp"
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCAN_X86
+#include <immintrin.h>
+#endif
+
+// ---------------------------------------------------------------------
+// SCALAR KERNELS
+// ---------------------------------------------------------------------
+
+// These also finish off whatever is left over after the vector loops, so they
+// never read past `n`
+
+static size_t line_end_scalar(const char *s, size_t i, size_t n) {
+  while (i < n && s[i] != '\n' && s[i] != '\0')
+    i++;
+  return i;
+}
+
+static size_t string_end_scalar(const char *s, size_t i, size_t n) {
+  while (i < n && s[i] != '"' && s[i] != '\\' && s[i] != '\0')
+    i++;
+  return i;
+}
+
+static size_t escape_scalar(const char *s, size_t i, size_t n) {
+  while (i < n && s[i] != '\\')
+    i++;
+  return i;
+}
+
+static size_t symbol_end_scalar(const char *s, size_t i, size_t n) {
+  while (i < n) {
+    char c = s[i];
+    char lower = c | 0x20;
+    if (!(('a' <= lower && lower <= 'z') || ('0' <= c && c <= '9') ||
+          c == '_'))
+      break;
+    i++;
+  }
+  return i;
+}
+
+static size_t space_end_scalar(const char *s, size_t i, size_t n) {
+  while (i < n && (s[i] == ' ' || s[i] == '\t' || s[i] == '\r'))
+    i++;
+  return i;
+}
+
+#ifdef SCAN_X86
+
+// ---------------------------------------------------------------------
+// SSE2 KERNELS
+// ---------------------------------------------------------------------
+
+// Each `*_stop` function returns a bitmask where bit `k` is set if byte `k` of
+// the block ends the run. The scan loop then only has to find the lowest bit
+
+static inline unsigned sse2_line_stop(__m128i v) {
+  __m128i nl = _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+  __m128i nul = _mm_cmpeq_epi8(v, _mm_setzero_si128());
+  return _mm_movemask_epi8(_mm_or_si128(nl, nul));
+}
+
+static inline unsigned sse2_string_stop(__m128i v) {
+  __m128i quote = _mm_cmpeq_epi8(v, _mm_set1_epi8('"'));
+  __m128i slash = _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'));
+  __m128i nul = _mm_cmpeq_epi8(v, _mm_setzero_si128());
+  return _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(quote, slash), nul));
+}
+
+static inline unsigned sse2_escape_stop(__m128i v) {
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+}
+
+// Bytes >= 0x80 compare as negative, so they fall outside every range below
+static inline unsigned sse2_symbol_stop(__m128i v) {
+  __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+  __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+  __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                                _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+  __m128i under = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+  __m128i ok = _mm_or_si128(_mm_or_si128(alpha, digit), under);
+  return ~_mm_movemask_epi8(ok) & 0xFFFF;
+}
+
+static inline unsigned sse2_space_stop(__m128i v) {
+  __m128i sp = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+  __m128i tab = _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'));
+  __m128i cr = _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'));
+  __m128i ok = _mm_or_si128(_mm_or_si128(sp, tab), cr);
+  return ~_mm_movemask_epi8(ok) & 0xFFFF;
+}
+
+template <unsigned (*Stop)(__m128i),
+          size_t (*Tail)(const char *, size_t, size_t)>
+static size_t sse2_scan(const char *s, size_t i, size_t n) {
+  while (i + 16 <= n) {
+    unsigned mask = Stop(_mm_loadu_si128((const __m128i *)(s + i)));
+    if (mask != 0)
+      return i + __builtin_ctz(mask);
+    i += 16;
+  }
+  return Tail(s, i, n);
+}
+
+// ---------------------------------------------------------------------
+// AVX2 KERNELS
+// ---------------------------------------------------------------------
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static inline unsigned avx2_line_stop(__m256i v) {
+  __m256i nl = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'));
+  __m256i nul = _mm256_cmpeq_epi8(v, _mm256_setzero_si256());
+  return _mm256_movemask_epi8(_mm256_or_si256(nl, nul));
+}
+
+AVX2 static inline unsigned avx2_string_stop(__m256i v) {
+  __m256i quote = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'));
+  __m256i slash = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'));
+  __m256i nul = _mm256_cmpeq_epi8(v, _mm256_setzero_si256());
+  return _mm256_movemask_epi8(
+      _mm256_or_si256(_mm256_or_si256(quote, slash), nul));
+}
+
+AVX2 static inline unsigned avx2_escape_stop(__m256i v) {
+  return _mm256_movemask_epi8(
+      _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')));
+}
+
+AVX2 static inline unsigned avx2_symbol_stop(__m256i v) {
+  __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+  __m256i alpha =
+      _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+                       _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+  __m256i digit =
+      _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+                       _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+  __m256i under = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+  __m256i ok = _mm256_or_si256(_mm256_or_si256(alpha, digit), under);
+  return ~static_cast<unsigned>(_mm256_movemask_epi8(ok));
+}
+
+AVX2 static inline unsigned avx2_space_stop(__m256i v) {
+  __m256i sp = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+  __m256i tab = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'));
+  __m256i cr = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'));
+  __m256i ok = _mm256_or_si256(_mm256_or_si256(sp, tab), cr);
+  return ~static_cast<unsigned>(_mm256_movemask_epi8(ok));
+}
+
+template <unsigned (*Stop)(__m256i),
+          size_t (*Tail)(const char *, size_t, size_t)>
+AVX2 static size_t avx2_scan(const char *s, size_t i, size_t n) {
+  while (i + 32 <= n) {
+    unsigned mask = Stop(_mm256_loadu_si256((const __m256i *)(s + i)));
+    if (mask != 0)
+      return i + __builtin_ctz(mask);
+    i += 32;
+  }
+  return Tail(s, i, n);
+}
+
+#undef AVX2
+
+#endif
+
+// ---------------------------------------------------------------------
+// RUNTIME DISPATCH
+// ---------------------------------------------------------------------
+
+typedef size_t (*Scan_Fn)(const char *, size_t, size_t);
+
+struct Scan_Kernels {
+  Scan_Fn line_end;
+  Scan_Fn string_end;
+  Scan_Fn symbol_end;
+  Scan_Fn space_end;
+  Scan_Fn escape;
+};
+
+static Scan_Kernels select_kernels() {
+#ifdef SCAN_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return Scan_Kernels{
+        avx2_scan<avx2_line_stop, line_end_scalar>,
+        avx2_scan<avx2_string_stop, string_end_scalar>,
+        avx2_scan<avx2_symbol_stop, symbol_end_scalar>,
+        avx2_scan<avx2_space_stop, space_end_scalar>,
+        avx2_scan<avx2_escape_stop, escape_scalar>,
+    };
+  if (__builtin_cpu_supports("sse2"))
+    return Scan_Kernels{
+        sse2_scan<sse2_line_stop, line_end_scalar>,
+        sse2_scan<sse2_string_stop, string_end_scalar>,
+        sse2_scan<sse2_symbol_stop, symbol_end_scalar>,
+        sse2_scan<sse2_space_stop, space_end_scalar>,
+        sse2_scan<sse2_escape_stop, escape_scalar>,
+    };
+#endif
+  return Scan_Kernels{line_end_scalar, string_end_scalar, symbol_end_scalar,
+                      space_end_scalar, escape_scalar};
+}
+
+static const Scan_Kernels kernels = select_kernels();
+
+size_t scan_line_end(const char *s, size_t i, size_t n) {
+  return kernels.line_end(s, i, n);
+}
+
+size_t scan_string_end(const char *s, size_t i, size_t n) {
+  return kernels.string_end(s, i, n);
+}
+
+size_t scan_symbol_end(const char *s, size_t i, size_t n) {
+  return kernels.symbol_end(s, i, n);
+}
+
+size_t scan_space_end(const char *s, size_t i, size_t n) {
+  return kernels.space_end(s, i, n);
+}
+
+size_t scan_escape(const char *s, size_t i, size_t n) {
+  return kernels.escape(s, i, n);
+}
+
+// ---------------------------------------------------------------------
+// ESCAPES
+// ---------------------------------------------------------------------
+
+int escape_value(char c) {
+  switch (c) {
+  case 'n':
+    return '\n';
+  case 't':
+    return '\t';
+  case 'r':
+    return '\r';
+  case '0':
+    return '\0';
+  case '\\':
+  case '"':
+  case '\'':
+    return c;
+  default:
+    return -1;
+  }
+}
+
+// Copies the runs between escapes whole, finding each '\\' 16 or 32 bytes at
+// a time
+std::string decode_escapes(std::string_view body) {
+  std::string out;
+  out.reserve(body.size());
+  size_t i = 0;
+  while (i < body.size()) {
+    size_t slash = scan_escape(body.data(), i, body.size());
+    out.append(body, i, slash - i);
+    if (slash + 1 >= body.size())
+      break;
+    int c = escape_value(body[slash + 1]);
+    out += c < 0 ? body[slash + 1] : (char)c;
+    i = slash + 2;
+  }
+  return out;
+}
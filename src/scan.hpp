@@ -0,0 +1,35 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Vectorized scanning kernels used by the lexer to skip over long runs of
+// bytes 16 or 32 at a time. Every kernel starts at index `i` of `s` and returns
+// the index of the first byte that ends the run, or `n` if the run reaches the
+// end of the source. The AVX2, SSE2 or scalar version is picked once at runtime
+
+// Ends on '\n' or '\0' (comments and doc comments)
+size_t scan_line_end(const char *s, size_t i, size_t n);
+
+// Ends on '"', '\\' or '\0' (string literal bodies, stopping at escapes)
+size_t scan_string_end(const char *s, size_t i, size_t n);
+
+// Ends on anything that can't continue a symbol, i.e. not [A-Za-z0-9_]
+size_t scan_symbol_end(const char *s, size_t i, size_t n);
+
+// Ends on anything other than ' ', '\t' or '\r'
+size_t scan_space_end(const char *s, size_t i, size_t n);
+
+// Ends on '\\' (escapes in a string literal that's already been lexed)
+size_t scan_escape(const char *s, size_t i, size_t n);
+
+// The character the escape `\c` stands for, or -1 if there's no such escape
+int escape_value(char c);
+
+// A string literal body with its escapes replaced by what they stand for.
+// Only called once the lexer has accepted every escape in it
+std::string decode_escapes(std::string_view body);
+
+#endif
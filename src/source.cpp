@@ -0,0 +1,140 @@
+#include "source.hpp"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <string_view>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SOURCE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+Source_Buffer::Source_Buffer(const char *base, size_t size, size_t mapped)
+    : base(base), size(size), mapped(mapped) {}
+
+Source_Buffer::Source_Buffer(Source_Buffer &&other)
+    : base(other.base), size(other.size), mapped(other.mapped) {
+  other.base = nullptr;
+  other.size = 0;
+  other.mapped = 0;
+}
+
+Source_Buffer &Source_Buffer::operator=(Source_Buffer &&other) {
+  if (this != &other) {
+    this->release();
+    this->base = other.base;
+    this->size = other.size;
+    this->mapped = other.mapped;
+    other.base = nullptr;
+    other.size = 0;
+    other.mapped = 0;
+  }
+  return *this;
+}
+
+Source_Buffer::~Source_Buffer() { this->release(); }
+
+void Source_Buffer::release() {
+  if (this->base == nullptr)
+    return;
+#ifdef SOURCE_MMAP
+  if (this->mapped != 0) {
+    munmap(const_cast<char *>(this->base), this->mapped);
+    this->base = nullptr;
+    return;
+  }
+#endif
+  delete[] this->base;
+  this->base = nullptr;
+}
+
+const char *Source_Buffer::data() const { return this->base; }
+
+size_t Source_Buffer::length() const { return this->size; }
+
+std::string_view Source_Buffer::view() const {
+  return std::string_view(this->base, this->size);
+}
+
+// Tokens store 32-bit offsets, so anything bigger can't be lexed anyway
+static bool check_size(const char *path, size_t size) {
+  if (size > UINT32_MAX - SOURCE_PADDING) {
+    std::cerr << "File '" << path << "' is too large (" << size
+              << " bytes) to compile!";
+    return false;
+  }
+  return true;
+}
+
+// Fallback for when the file can't be mapped: one read into a zero-padded
+// heap block
+std::optional<Source_Buffer> Source_Buffer::read_into_heap(const char *path) {
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file) {
+    std::cerr << "There was an error opening the file '" << path << "'!";
+    return std::nullopt;
+  }
+
+  size_t size = static_cast<size_t>(file.tellg());
+  if (!check_size(path, size))
+    return std::nullopt;
+
+  char *buffer = new char[size + SOURCE_PADDING]();
+  file.seekg(0);
+  file.read(buffer, size);
+  return Source_Buffer(buffer, size, 0);
+}
+
+std::optional<Source_Buffer> Source_Buffer::open(const char *path) {
+#ifdef SOURCE_MMAP
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0) {
+    std::cerr << "There was an error opening the file '" << path << "'!";
+    return std::nullopt;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    ::close(fd);
+    return read_into_heap(path);
+  }
+
+  size_t size = static_cast<size_t>(st.st_size);
+  if (!check_size(path, size)) {
+    ::close(fd);
+    return std::nullopt;
+  }
+
+  // Reserve zeroed anonymous memory for the file plus the padding, then map
+  // the file over the front of it. Whatever is left of the last file page and
+  // the anonymous pages after it stay zero, so the padding is always there
+  // even when the file ends exactly on a page boundary
+  size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  size_t mapped = (size + SOURCE_PADDING + page - 1) / page * page;
+  void *base = mmap(nullptr, mapped, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS,
+                    -1, 0);
+  if (base == MAP_FAILED) {
+    ::close(fd);
+    return read_into_heap(path);
+  }
+
+  if (size != 0 && mmap(base, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd,
+                        0) == MAP_FAILED) {
+    munmap(base, mapped);
+    ::close(fd);
+    return read_into_heap(path);
+  }
+  ::close(fd);
+
+  // The lexer makes one front-to-back pass
+  madvise(base, mapped, MADV_SEQUENTIAL);
+  return Source_Buffer(static_cast<const char *>(base), size, mapped);
+#else
+  return read_into_heap(path);
+#endif
+}
@@ -0,0 +1,44 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <cstddef>
+#include <optional>
+#include <string_view>
+
+// Number of zero bytes guaranteed after the end of every `Source_Buffer`. The
+// first one is the '\0' sentinel the lexer stops on, the rest let vector loads
+// run off the end without faulting
+constexpr size_t SOURCE_PADDING = 64;
+
+// Read-only contents of a source file. Where possible the file is mapped
+// straight into memory instead of being copied, and every `Token` lexeme,
+// the `Lexer` and the `Reporter` all look into this one buffer, so it has to
+// outlive all of them
+class Source_Buffer {
+  const char *base;
+  size_t size;
+  size_t mapped; // bytes mapped with mmap, 0 if `base` is on the heap
+
+  Source_Buffer(const char *base, size_t size, size_t mapped);
+
+public:
+  // Prints the reason to stderr and returns `std::nullopt` if the file can't
+  // be read
+  static std::optional<Source_Buffer> open(const char *path);
+
+  Source_Buffer(Source_Buffer &&other);
+  Source_Buffer &operator=(Source_Buffer &&other);
+  Source_Buffer(const Source_Buffer &) = delete;
+  Source_Buffer &operator=(const Source_Buffer &) = delete;
+  ~Source_Buffer();
+
+  const char *data() const;
+  size_t length() const;
+  std::string_view view() const;
+
+private:
+  static std::optional<Source_Buffer> read_into_heap(const char *path);
+  void release();
+};
+
+#endif
@@ -0,0 +1,145 @@
+#include "cbc.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Picks superinstructions from opcode profiles written by `chaocpp
+// --profile` and writes them to `cbc_super.def`.
+//
+// Usage: cbc_supergen <output> <count> <profile>...
+//
+// Every run the profiles counted is scored by how many dispatches fusing it
+// would have saved, which is its count times one less than its length, and
+// the best `count` of them are kept. Only the last instruction of a run may
+// jump or stop, anything before it has to fall through for the run to be
+// fused in place
+
+// The sequences profiles use as keys, with how often each ran
+using Counts = std::map<std::vector<CBC_Opcode>, uint64_t>;
+
+static bool fusable(const std::vector<CBC_Opcode> &run) {
+  for (size_t i = 0; i < run.size(); i++) {
+    CBC_Opcode op = run[i];
+    if ((size_t)op >= N_CBC_BASE_OPCODES)
+      return false;
+    bool last = i + 1 == run.size();
+    if (!last && (op == CBC_Opcode::JUMP || op == CBC_Opcode::JUMP_IF_FALSE ||
+                  op == CBC_Opcode::QUIT || op == CBC_Opcode::CALL))
+      return false;
+  }
+  return true;
+}
+
+static bool read_profile(const char *path, Counts &counts) {
+  std::ifstream in(path);
+  if (!in) {
+    std::cerr << "Could not read profile " << path << std::endl;
+    return false;
+  }
+
+  std::string line;
+  size_t number = 0;
+  while (std::getline(in, line)) {
+    number++;
+    std::istringstream words(line);
+    uint64_t count;
+    std::string name;
+    std::vector<CBC_Opcode> run;
+    bool ok = static_cast<bool>(words >> count);
+    while (ok && words >> name) {
+      std::optional<CBC_Opcode> op = cbc_opcode(name);
+      ok = op.has_value();
+      if (ok)
+        run.push_back(*op);
+    }
+    if (!ok || run.size() < 2 || run.size() > 3) {
+      std::cerr << path << ":" << number << ": malformed profile line"
+                << std::endl;
+      return false;
+    }
+    counts[run] += count;
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 4) {
+    std::cerr << "Usage: cbc_supergen <output> <count> <profile>..."
+              << std::endl;
+    return 1;
+  }
+  const char *output = argv[1];
+  size_t wanted = std::strtoul(argv[2], nullptr, 10);
+
+  Counts counts;
+  for (int i = 3; i < argc; i++)
+    if (!read_profile(argv[i], counts))
+      return 1;
+
+  struct Candidate {
+    std::vector<CBC_Opcode> run;
+    uint64_t count;
+    uint64_t saved;
+  };
+  std::vector<Candidate> candidates;
+  for (const auto &[run, count] : counts)
+    if (fusable(run))
+      candidates.push_back({run, count, count * (run.size() - 1)});
+
+  // Ties go to the shorter run, then to the order opcodes are declared in,
+  // so the same profiles always give the same file
+  std::stable_sort(candidates.begin(), candidates.end(),
+                   [](const Candidate &a, const Candidate &b) {
+                     if (a.saved != b.saved)
+                       return a.saved > b.saved;
+                     return a.run.size() < b.run.size();
+                   });
+
+  std::ofstream out(output);
+  if (!out) {
+    std::cerr << "Could not write " << output << std::endl;
+    return 1;
+  }
+  out << "// Superinstructions for the CBC VM. Generated by `cbc_supergen` "
+         "from opcode\n"
+         "// profiles, so don't edit by hand. To regenerate from the current "
+         "workloads:\n"
+         "//\n"
+         "//   cmake --build <build dir> --target superinstructions\n"
+         "//\n"
+         "// CBC_SUPER2(name, first, second)\n"
+         "// CBC_SUPER3(name, first, second, third)\n";
+
+  std::vector<std::string> names;
+  for (const Candidate &c : candidates) {
+    if (names.size() == wanted)
+      break;
+
+    std::ostringstream name;
+    std::ostringstream parts;
+    for (size_t i = 0; i < c.run.size(); i++) {
+      name << (i == 0 ? "" : "_") << c.run[i];
+      parts << ", " << c.run[i];
+    }
+    // Names are the parts joined up, which could in principle say the same
+    // thing for two different runs
+    if (std::find(names.begin(), names.end(), name.str()) != names.end())
+      continue;
+    names.push_back(name.str());
+
+    out << "\n// ran " << c.count << " times\n"
+        << "CBC_SUPER" << c.run.size() << "(" << name.str() << parts.str()
+        << ")\n";
+  }
+
+  std::cout << "[supergen] " << names.size() << " superinstruction(s) from "
+            << candidates.size() << " fusable run(s) written to " << output
+            << std::endl;
+  return 0;
+}
@@ -0,0 +1,68 @@
+#include "symbol.hpp"
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+namespace {
+
+struct Symbol_Table {
+  std::shared_mutex mutex;
+  std::deque<std::string> names; // never moves what it holds
+  std::unordered_map<std::string_view, uint32_t> ids;
+
+  Symbol_Table() {
+    this->names.emplace_back();
+    this->ids.emplace(this->names.back(), 0);
+  }
+};
+
+Symbol_Table &table() {
+  static Symbol_Table table;
+  return table;
+}
+
+// Names this thread has already looked up. Threads lexing and parsing
+// different modules mostly see their own names over and over, so this keeps
+// them off the shared lock. Keys point into the table, which never frees
+thread_local std::unordered_map<std::string_view, uint32_t> seen;
+
+} // namespace
+
+Symbol_Id Symbol_Id::intern(std::string_view name) {
+  auto cached = seen.find(name);
+  if (cached != seen.end())
+    return Symbol_Id(cached->second);
+
+  Symbol_Table &t = table();
+  std::unordered_map<std::string_view, uint32_t>::iterator found;
+  {
+    std::shared_lock<std::shared_mutex> lock(t.mutex);
+    found = t.ids.find(name);
+    if (found != t.ids.end()) {
+      seen.emplace(found->first, found->second);
+      return Symbol_Id(found->second);
+    }
+  }
+
+  std::unique_lock<std::shared_mutex> lock(t.mutex);
+  // Someone else may have added it in between
+  found = t.ids.find(name);
+  if (found == t.ids.end()) {
+    t.names.emplace_back(name);
+    found = t.ids.emplace(t.names.back(), t.names.size() - 1).first;
+  }
+  seen.emplace(found->first, found->second);
+  return Symbol_Id(found->second);
+}
+
+std::string_view Symbol_Id::name() const {
+  Symbol_Table &t = table();
+  std::shared_lock<std::shared_mutex> lock(t.mutex);
+  return t.names[this->index];
+}
+
+std::ostream &operator<<(std::ostream &os, Symbol_Id symbol) {
+  return os << symbol.name();
+}
@@ -0,0 +1,50 @@
+#ifndef SYMBOL_H
+#define SYMBOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <string_view>
+
+// An interned name. Every distinct name gets one 32-bit id for the rest of
+// the process, so names are compared and hashed as integers and each one is
+// stored once, however many times it appears. The table behind it is shared
+// by every thread. Ids aren't stable from one run to the next, so anything
+// written to disk stores the name instead
+class Symbol_Id {
+  uint32_t index;
+
+  explicit Symbol_Id(uint32_t index) : index(index) {}
+
+public:
+  // The empty name
+  Symbol_Id() : index(0) {}
+
+  static Symbol_Id intern(std::string_view name);
+
+  // For a symbol that was stored as its id
+  static Symbol_Id from_id(uint32_t id) { return Symbol_Id(id); }
+
+  uint32_t id() const { return this->index; }
+
+  // Stays valid for the rest of the process
+  std::string_view name() const;
+
+  bool operator==(Symbol_Id other) const {
+    return this->index == other.index;
+  }
+  bool operator!=(Symbol_Id other) const {
+    return this->index != other.index;
+  }
+};
+
+std::ostream &operator<<(std::ostream &os, Symbol_Id symbol);
+
+namespace std {
+template <> struct hash<Symbol_Id> {
+  size_t operator()(Symbol_Id symbol) const noexcept { return symbol.id(); }
+};
+} // namespace std
+
+#endif
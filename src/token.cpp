@@ -1,15 +1,80 @@
 #include "token.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <iostream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
 
 // Constructor definition
-Token::Token(Type type, std::string_view lexeme, int line, int offset)
-    : type(type), lexeme(lexeme), x(offset), y(line) {}
-
-// Method definition
-void Token::print() const {
-  std::cout << this->y << "; " << this->x << "-"
-            << this->x + this->lexeme.length() - 1 << "; " << this->type << "; "
-            << this->lexeme << std::endl;
+Token::Token(Type type, uint32_t offset, uint32_t length)
+    : offset(offset), length(length), type(type) {}
+
+uint32_t Token::end() const {
+  return this->length == 0 ? this->offset : this->offset + this->length - 1;
+}
+
+// =================================================================
+// SOURCE MAP
+// =================================================================
+
+Source_Map::Source_Map(std::string_view text) : text(text) {}
+
+std::string_view Source_Map::source() const { return this->text; }
+
+std::string_view Source_Map::lexeme(const Token &tk) const {
+  return this->text.substr(tk.offset, tk.length);
+}
+
+size_t Source_Map::line_index(uint32_t offset) const {
+  if (this->line_starts.empty()) {
+    this->line_starts.push_back(0);
+    const char *begin = this->text.data();
+    const char *end = begin + this->text.length();
+    for (const char *p = begin;
+         (p = static_cast<const char *>(std::memchr(p, '\n', end - p)));
+         p++)
+      this->line_starts.push_back(p - begin + 1);
+  }
+
+  // Try the line we found last time and the one after it before searching
+  size_t n = this->line_starts.size();
+  size_t i = this->last_line;
+  if (this->line_starts[i] <= offset &&
+      (i + 1 == n || offset < this->line_starts[i + 1]))
+    return i;
+  if (i + 1 < n && this->line_starts[i + 1] <= offset &&
+      (i + 2 == n || offset < this->line_starts[i + 2]))
+    return this->last_line = i + 1;
+
+  auto it = std::upper_bound(this->line_starts.begin(),
+                             this->line_starts.end(), offset);
+  return this->last_line = (it - this->line_starts.begin()) - 1;
+}
+
+int Source_Map::line(uint32_t offset) const {
+  return this->line_index(offset) + 1;
+}
+
+int Source_Map::line(const Token &tk) const { return this->line(tk.offset); }
+
+int Source_Map::column(uint32_t offset) const {
+  size_t i = this->line_index(offset);
+  return offset - this->line_starts[i];
+}
+
+void Source_Map::print(const Token &tk) const {
+  std::string_view lexeme = this->lexeme(tk);
+  if (tk.type == Token::Type::NEWLINE)
+    lexeme = "\\n";
+  else if (tk.type == Token::Type::END_OF_FILE)
+    lexeme = "{ EOF }";
+
+  std::cout << this->line(tk) << "; " << tk.offset << "-" << tk.end() << "; "
+            << tk.type << "; " << lexeme << std::endl;
 }
 
 // Output operator definition
@@ -100,28 +165,65 @@ std::ostream &operator<<(std::ostream &os, const Token::Type &type) {
   return os;
 }
 
-std::map<std::string, Token::Type> keywords = {
-    {"function", Token::Type::FUNCTION},
-    {"class", Token::Type::CLASS},
-    {"enum", Token::Type::ENUM},
-    {"mut", Token::Type::MUT},
-    {"true", Token::Type::TRUE},
-    {"false", Token::Type::FALSE},
-    {"nil", Token::Type::NIL},
-    {"switch", Token::Type::SWITCH},
-    {"if", Token::Type::IF},
-    {"else", Token::Type::ELSE},
-    {"continue", Token::Type::CONTINUE},
-    {"break", Token::Type::BREAK},
-    {"for", Token::Type::FOR},
-    {"while", Token::Type::WHILE},
-    {"case", Token::Type::CASE},
-    {"in", Token::Type::IN},
-    {"defer", Token::Type::DEFER},
-    {"return", Token::Type::RETURN},
-    {"from", Token::Type::FROM},
-    {"import", Token::Type::IMPORT},
-    {"as", Token::Type::AS},
-    {"is", Token::Type::IS},
-    {"not", Token::Type::NOT},
-};
\ No newline at end of file
+// =================================================================
+// KEYWORD BENCHMARK
+// =================================================================
+
+// Roughly what a lexer sees: mostly symbols, some of them close to a keyword,
+// and a keyword every few of them
+static std::vector<std::string> keyword_benchmark_lexemes() {
+  const char *symbols[] = {
+      "x",         "value", "compute", "result",   "index",   "i",
+      "functions", "iff",   "classes", "returned", "nothing", "total",
+  };
+  std::vector<std::string> lexemes;
+  size_t k = 0;
+  for (size_t i = 0; i < 4096; i++) {
+    if (i % 4 == 0) {
+      lexemes.emplace_back(keyword_list[k++ % std::size(keyword_list)].text);
+      continue;
+    }
+    lexemes.push_back(symbols[i % std::size(symbols)]);
+    if (i % 3 == 0)
+      lexemes.back() += "_" + std::to_string(i);
+  }
+  return lexemes;
+}
+
+void keyword_benchmark() {
+  // The table and the lookup as they were before the perfect hash
+  std::map<std::string, Token::Type> keywords;
+  for (const Keyword &k : keyword_list)
+    keywords[std::string(k.text)] = k.type;
+  auto map_lookup = [&](std::string_view lexeme) {
+    if (keywords.count(std::string(lexeme)) != 0)
+      return keywords[std::string(lexeme)];
+    return Token::Type::SYMBOL;
+  };
+
+  std::vector<std::string> lexemes = keyword_benchmark_lexemes();
+  const size_t rounds = 2000;
+  double lookups = (double)rounds * lexemes.size();
+
+  // The sums of the types found keep the lookups from being optimized away,
+  // and have to match
+  auto time = [&](auto lookup, uint64_t &sum) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < rounds; r++)
+      for (const std::string &lexeme : lexemes)
+        sum += lookup(lexeme);
+    std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+    return d.count();
+  };
+
+  uint64_t hashed_sum = 0, map_sum = 0;
+  double hashed = time(keyword_type, hashed_sum);
+  double map = time(map_lookup, map_sum);
+  bool ok = hashed_sum == map_sum;
+
+  std::cout << "[bench] keywords perfect hash " << lookups / hashed / 1e6
+            << " M lookups/s (" << hashed * 1000 << " ms, " << map / hashed
+            << "x)" << (ok ? "" : " WRONG RESULT") << std::endl;
+  std::cout << "[bench] keywords std::map     " << lookups / map / 1e6
+            << " M lookups/s (" << map * 1000 << " ms)" << std::endl;
+}
@@ -1,18 +1,21 @@
 #ifndef TOKEN_H
 #define TOKEN_H
 
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
-#include <map>
 #include <string_view>
+#include <vector>
 
-// Pretty self explanatory here
-// The location of the token is tracked by the `x`, `y`, and `lexeme` members
-// `x` is the index of the first character of the lexeme
-// `y` is the line number, starts at 1
-// `lexeme` stores the lexeme, but also we use `length()` method to get the end
-// of the token e.g. `x + lexeme.length() - 1`
+// Tokens are packed down to an offset, a length and a type so that large
+// token streams stay cache friendly
+// `offset` is the index of the first character of the lexeme in the source
+// `length` is the number of characters in the lexeme
+// The lexeme itself and the line/column are looked up through a `Source_Map`
+// only when they're needed
 struct Token {
-  enum Type {
+  enum Type : uint8_t {
     // OTHER
     END_OF_FILE,
     NEWLINE,
@@ -96,18 +99,155 @@ struct Token {
     NOT,
   };
 
+  uint32_t offset;
+  uint32_t length;
   Type type;
-  int x, y;
-  std::string_view lexeme;
 
-  Token(Type type, std::string_view lexeme, int line, int offset);
-  void print() const;
+  Token(Type type, uint32_t offset, uint32_t length);
+
+  // Index of the last character of the lexeme. Empty tokens (EOF) end where
+  // they start so that diagnostics still have something to point at
+  uint32_t end() const;
+};
+
+static_assert(sizeof(Token) <= 16, "Token should stay packed");
+
+// Number of `Token::Type` values, for tables indexed by token type
+constexpr size_t N_TOKEN_TYPES = static_cast<size_t>(Token::Type::NOT) + 1;
+
+// Resolves everything about a token that isn't stored in it. The line index is
+// only built the first time a line or column is asked for, so nothing pays
+// for it unless there is a diagnostic or an AST node to attach it to
+class Source_Map {
+  std::string_view text;
+  mutable std::vector<uint32_t> line_starts;
+  mutable size_t last_line = 0; // lookups are mostly in order, so cache these
+
+public:
+  Source_Map(std::string_view text);
+
+  std::string_view source() const;
+  std::string_view lexeme(const Token &tk) const;
+
+  // Line numbers start at 1, columns start at 0
+  int line(uint32_t offset) const;
+  int line(const Token &tk) const;
+  int column(uint32_t offset) const;
+
+  void print(const Token &tk) const;
+
+private:
+  size_t line_index(uint32_t offset) const;
 };
 
 // Operator overload `<<` for `Token`
 std::ostream &operator<<(std::ostream &os, const Token::Type &type);
 
-// For matching `string_views` to keyword TokenTypes
-extern std::map<std::string, Token::Type> keywords;
+// ---------------------------------------------------------------------
+// KEYWORDS
+// ---------------------------------------------------------------------
+
+// Keywords are matched with a perfect hash that is found at compile time, so a
+// lookup is one hash, one table load and one compare with no allocation
+
+struct Keyword {
+  std::string_view text;
+  Token::Type type;
+};
+
+constexpr Keyword keyword_list[] = {
+    {"function", Token::Type::FUNCTION},
+    {"class", Token::Type::CLASS},
+    {"enum", Token::Type::ENUM},
+    {"mut", Token::Type::MUT},
+    {"true", Token::Type::TRUE},
+    {"false", Token::Type::FALSE},
+    {"nil", Token::Type::NIL},
+    {"switch", Token::Type::SWITCH},
+    {"if", Token::Type::IF},
+    {"else", Token::Type::ELSE},
+    {"continue", Token::Type::CONTINUE},
+    {"break", Token::Type::BREAK},
+    {"for", Token::Type::FOR},
+    {"while", Token::Type::WHILE},
+    {"case", Token::Type::CASE},
+    {"in", Token::Type::IN},
+    {"defer", Token::Type::DEFER},
+    {"return", Token::Type::RETURN},
+    {"from", Token::Type::FROM},
+    {"import", Token::Type::IMPORT},
+    {"as", Token::Type::AS},
+    {"is", Token::Type::IS},
+    {"not", Token::Type::NOT},
+};
+
+constexpr size_t KEYWORD_TABLE_SIZE = 64;
+
+// Hashes the length and the first and last characters with the multipliers
+// picked by `find_keyword_seeds()`. `s` must not be empty
+constexpr size_t keyword_hash(std::string_view s, size_t a, size_t b) {
+  return (s.length() + static_cast<unsigned char>(s.front()) * a +
+          static_cast<unsigned char>(s.back()) * b) %
+         KEYWORD_TABLE_SIZE;
+}
+
+struct Keyword_Seeds {
+  size_t a, b;
+};
+
+// Searches for the first pair of multipliers that sends every keyword to its
+// own slot. Runs entirely at compile time
+constexpr Keyword_Seeds find_keyword_seeds() {
+  for (size_t a = 1; a < 256; a++) {
+    for (size_t b = 1; b < 256; b++) {
+      bool used[KEYWORD_TABLE_SIZE] = {};
+      bool collision = false;
+      for (const Keyword &k : keyword_list) {
+        size_t h = keyword_hash(k.text, a, b);
+        if (used[h]) {
+          collision = true;
+          break;
+        }
+        used[h] = true;
+      }
+      if (!collision)
+        return Keyword_Seeds{a, b};
+    }
+  }
+  return Keyword_Seeds{0, 0};
+}
+
+constexpr Keyword_Seeds keyword_seeds = find_keyword_seeds();
+static_assert(keyword_seeds.a != 0, "No perfect hash for the keyword list");
+
+// Empty slots have an empty `text`, which never matches a lexeme
+constexpr std::array<Keyword, KEYWORD_TABLE_SIZE> make_keyword_table() {
+  std::array<Keyword, KEYWORD_TABLE_SIZE> table{};
+  for (const Keyword &k : keyword_list)
+    table[keyword_hash(k.text, keyword_seeds.a, keyword_seeds.b)] = k;
+  return table;
+}
+
+constexpr std::array<Keyword, KEYWORD_TABLE_SIZE> keyword_table =
+    make_keyword_table();
+
+// Returns the keyword type for `lexeme`, or `Token::Type::SYMBOL` if it isn't
+// a keyword
+constexpr Token::Type keyword_type(std::string_view lexeme) {
+  if (lexeme.empty())
+    return Token::Type::SYMBOL;
+  const Keyword &k =
+      keyword_table[keyword_hash(lexeme, keyword_seeds.a, keyword_seeds.b)];
+  return k.text == lexeme ? k.type : Token::Type::SYMBOL;
+}
+
+static_assert(keyword_type("function") == Token::Type::FUNCTION);
+static_assert(keyword_type("not") == Token::Type::NOT);
+static_assert(keyword_type("functions") == Token::Type::SYMBOL);
+
+// Times `keyword_type()` against the `std::map<std::string, Token::Type>`
+// lookup the lexer used before, over the same mix of keywords and symbols,
+// and prints the lookup rate of each
+void keyword_benchmark();
 
 #endif
\ No newline at end of file
@@ -0,0 +1,572 @@
+#include "vm.hpp"
+#include "cbc.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Labels-as-values are a GNU extension, everything else gets the switch
+#if defined(__GNUC__) || defined(__clang__)
+#define CBC_COMPUTED_GOTO
+#endif
+
+// ---------------------------------------------------------------------
+// VALUE HELPERS
+// ---------------------------------------------------------------------
+
+// Words that are equal are equal values, except for the NaN. Otherwise numbers
+// compare by value across integers and floats, and strings and boxed integers
+// by what they point to
+static bool values_equal(const CBC_Value &a, const CBC_Value &b) {
+  if (a.is_float() || b.is_float())
+    return a.is_number() && b.is_number() && a.as_float() == b.as_float();
+  if (a.word() == b.word())
+    return true;
+  if (a.is_integer() && b.is_integer())
+    return a.as_integer() == b.as_integer();
+  if (a.type() == CBC_Value::Type::STRING &&
+      b.type() == CBC_Value::Type::STRING)
+    return *a.as_string() == *b.as_string();
+  return false;
+}
+
+// ---------------------------------------------------------------------
+// PROFILING
+// ---------------------------------------------------------------------
+
+CBC_Profile::CBC_Profile() : pairs(N_CBC_OPCODES * N_CBC_OPCODES, 0) {}
+
+static uint32_t triple_key(CBC_Opcode a, CBC_Opcode b, CBC_Opcode c) {
+  return (uint32_t)a << 16 | (uint32_t)b << 8 | (uint32_t)c;
+}
+
+void CBC_Profile::record(size_t pc, CBC_Opcode op) {
+  // Anything but the next instruction means a jump was taken, which breaks
+  // the run
+  if (pc != this->last_pc + 1)
+    this->run = 0;
+  if (this->run >= 1)
+    this->pairs[(size_t)this->previous[1] * N_CBC_OPCODES + (size_t)op]++;
+  if (this->run >= 2)
+    this->triples[triple_key(this->previous[0], this->previous[1], op)]++;
+
+  this->previous[0] = this->previous[1];
+  this->previous[1] = op;
+  this->run = this->run < 2 ? this->run + 1 : 2;
+  this->last_pc = pc;
+}
+
+bool CBC_Profile::save(const char *path) const {
+  std::ofstream out(path, std::ios::app);
+  if (!out) {
+    std::cerr << "Could not write profile to " << path << std::endl;
+    return false;
+  }
+
+  for (size_t first = 0; first < N_CBC_OPCODES; first++)
+    for (size_t second = 0; second < N_CBC_OPCODES; second++)
+      if (uint64_t count = this->pairs[first * N_CBC_OPCODES + second])
+        out << count << " " << (CBC_Opcode)first << " " << (CBC_Opcode)second
+            << "\n";
+  for (const auto &[key, count] : this->triples)
+    out << count << " " << (CBC_Opcode)(key >> 16) << " "
+        << (CBC_Opcode)(key >> 8 & 0xff) << " " << (CBC_Opcode)(key & 0xff)
+        << "\n";
+  return true;
+}
+
+// ---------------------------------------------------------------------
+// VIRTUAL MACHINE
+// ---------------------------------------------------------------------
+
+CBC_VM::CBC_VM(const CBC_Program &program)
+    : program(program), globals(program.pool.slots.size()),
+      defined(program.pool.slots.size(), false),
+      spills(program.spill_slots) {}
+
+const CBC_Value &CBC_VM::reg(size_t r) const { return this->registers[r]; }
+
+void CBC_VM::print_globals() const {
+  std::cout << "\n[GLOBALS]:\n" << std::endl;
+  for (size_t slot = 0; slot < this->globals.size(); slot++)
+    if (this->defined[slot])
+      std::cout << this->program.pool.slots[slot] << " = "
+                << this->globals[slot] << std::endl;
+}
+
+std::optional<CBC_Value> CBC_VM::global(Symbol_Id name) const {
+  std::optional<uint32_t> slot = this->program.pool.find_slot(name);
+  if (!slot || !this->defined[*slot])
+    return std::nullopt;
+  return this->globals[*slot];
+}
+
+void CBC_VM::define(Symbol_Id name, CBC_Value value) {
+  if (std::optional<uint32_t> slot = this->program.pool.find_slot(name)) {
+    this->globals[*slot] = value;
+    this->defined[*slot] = true;
+  }
+}
+
+int CBC_VM::error(size_t pc, std::string message) {
+  std::cerr << "Runtime error at instruction " << pc << " ("
+            << this->program.code[pc].op;
+  if (uint32_t line = this->program.line(pc))
+    std::cerr << ", line " << line;
+  std::cerr << "): " << message << std::endl;
+  return -1;
+}
+
+// Checks everything the dispatch loop takes on trust, so that it doesn't have
+// to bounds check pool indices or jump targets while running. Registers are
+// one byte and can't be out of range
+bool CBC_VM::verify() {
+  const CBC_Span<CBC_Code> &code = this->program.code;
+  size_t n = code.size();
+  CBC_Opcode last = n == 0 ? CBC_Opcode::MOVE : code.back().op;
+  if (last != CBC_Opcode::QUIT && last != CBC_Opcode::JUMP) {
+    std::cerr << "CBC program doesn't end in QUIT or JUMP" << std::endl;
+    return false;
+  }
+
+  for (size_t pc = 0; pc < n; pc++) {
+    const CBC_Code &c = code[pc];
+    auto in = [&](size_t size) { return c.k >= 0 && (size_t)c.k < size; };
+
+    // A superinstruction runs the ones after it in place, so it checks its
+    // own operands the same as the first of them and needs the rest to exist
+    bool ok = true;
+    if (const CBC_Super *super = cbc_super(c.op))
+      ok = pc + super->length <= n;
+
+    switch (cbc_base(c.op)) {
+    case CBC_Opcode::STORE_CONST:
+    case CBC_Opcode::STORE_VAR:
+    case CBC_Opcode::CALL:
+    case CBC_Opcode::LOAD_GLOBAL:
+      ok = ok && in(this->program.pool.slots.size());
+      break;
+    case CBC_Opcode::LOAD_CONST:
+      ok = ok && in(this->program.pool.constants.size());
+      break;
+    case CBC_Opcode::JUMP:
+    case CBC_Opcode::JUMP_IF_FALSE:
+      ok = ok && in(n);
+      break;
+    case CBC_Opcode::SPILL:
+    case CBC_Opcode::RELOAD:
+      ok = ok && in(this->spills.size());
+      break;
+    default:
+      ok = ok && static_cast<size_t>(c.op) < N_CBC_OPCODES;
+      break;
+    }
+
+    if (!ok) {
+      std::cerr << "Malformed CBC instruction at " << pc << ": ";
+      this->program.decode(pc).print(this->program.pool);
+      return false;
+    }
+  }
+  return true;
+}
+
+int CBC_VM::run() {
+  if (!this->verify())
+    return -1;
+#ifdef CBC_COMPUTED_GOTO
+  return this->execute<true, false>();
+#else
+  return this->execute<false, false>();
+#endif
+}
+
+int CBC_VM::run_switch() {
+  if (!this->verify())
+    return -1;
+  return this->execute<false, false>();
+}
+
+int CBC_VM::run_profiled(CBC_Profile &profile) {
+  if (!this->verify())
+    return -1;
+  this->profile = &profile;
+  return this->execute<false, true>();
+}
+
+// The body of every instruction is written once, as a `STEP_` macro that
+// leaves `ip` on whatever runs next. With `Threaded` each handler ends by
+// jumping straight to the handler of the next through `labels`, so every
+// handler gets its own indirect branch for the predictor to learn. Without it
+// they all go back through the one switch at `dispatch`, which is also where
+// `Profiled` counts what runs
+template <bool Threaded, bool Profiled> int CBC_VM::execute() {
+  const CBC_Code *code = this->program.code.data();
+  const CBC_Code *ip = code;
+  const CBC_Value *constants = this->program.pool.constants.data();
+  CBC_Value *r = this->registers.data();
+  CBC_Value *globals = this->globals.data();
+  CBC_Value *spills = this->spills.data();
+  CBC_Heap &heap = this->heap;
+
+#ifdef CBC_COMPUTED_GOTO
+  // Same order as `CBC_Opcode`
+  static const void *labels[N_CBC_OPCODES] = {
+      &&op_QUIT,     &&op_STORE_CONST, &&op_STORE_VAR,     &&op_LOAD_CONST,
+      &&op_CALL,     &&op_MOVE,        &&op_LOAD_GLOBAL,   &&op_ADD,
+      &&op_SUBTRACT, &&op_MULTIPLY,    &&op_DIVIDE,        &&op_MODULUS,
+      &&op_LESS,     &&op_LESS_EQUAL,  &&op_EQUAL,         &&op_NOT_EQUAL,
+      &&op_JUMP,     &&op_JUMP_IF_FALSE, &&op_SPILL,       &&op_RELOAD,
+#define CBC_SUPER2(name, first, second) &&op_##name,
+#define CBC_SUPER3(name, first, second, third) &&op_##name,
+#include "cbc_super.def"
+#undef CBC_SUPER2
+#undef CBC_SUPER3
+  };
+#define DISPATCH()                                                             \
+  do {                                                                         \
+    if constexpr (Threaded)                                                    \
+      goto *labels[static_cast<size_t>(ip->op)];                               \
+    else                                                                       \
+      goto dispatch;                                                           \
+  } while (0)
+#else
+#define DISPATCH() goto dispatch
+#endif
+
+#define CASE(op)                                                               \
+  case CBC_Opcode::op:                                                         \
+  op_##op:
+
+#define FAIL(message) return this->error(ip - code, message)
+
+// Two small integers or two doubles take the short way, without looking
+// anything up on the heap or converting. Integers stay integers, and anything
+// mixed with a float becomes a float
+#define ARITHMETIC(int_expr, float_expr)                                       \
+  {                                                                            \
+    const CBC_Value &a = r[ip->b];                                             \
+    const CBC_Value &b = r[ip->c];                                             \
+    if (CBC_Value::both_small(a, b)) {                                         \
+      long long int x = a.as_small(), y = b.as_small();                        \
+      r[ip->a] = heap.integer(int_expr);                                       \
+    } else if (a.is_float() && b.is_float()) {                                 \
+      double x = a.as_float_bits(), y = b.as_float_bits();                     \
+      r[ip->a] = CBC_Value::floating(float_expr);                              \
+    } else if (a.is_integer() && b.is_integer()) {                             \
+      long long int x = a.as_integer(), y = b.as_integer();                    \
+      r[ip->a] = heap.integer(int_expr);                                       \
+    } else if (a.is_number() && b.is_number()) {                               \
+      double x = a.as_float(), y = b.as_float();                               \
+      r[ip->a] = CBC_Value::floating(float_expr);                              \
+    } else {                                                                   \
+      FAIL("operands must be numbers");                                        \
+    }                                                                          \
+    ip++;                                                                      \
+  }
+
+// Two small integers can't overflow when compared as they are
+#define COMPARISON(cmp)                                                        \
+  {                                                                            \
+    const CBC_Value &a = r[ip->b];                                             \
+    const CBC_Value &b = r[ip->c];                                             \
+    if (CBC_Value::both_small(a, b))                                           \
+      r[ip->a] = CBC_Value::boolean(a.as_small() cmp b.as_small());            \
+    else if (a.is_integer() && b.is_integer())                                 \
+      r[ip->a] = CBC_Value::boolean(a.as_integer() cmp b.as_integer());        \
+    else if (a.is_number() && b.is_number())                                   \
+      r[ip->a] = CBC_Value::boolean(a.as_float() cmp b.as_float());            \
+    else                                                                       \
+      FAIL("operands must be numbers");                                        \
+    ip++;                                                                      \
+  }
+
+#define STEP_QUIT return ip->k;
+
+#define STEP_STORE_CONST                                                       \
+  {                                                                            \
+    globals[ip->k] = r[ip->a];                                                 \
+    this->defined[ip->k] = true;                                               \
+    ip++;                                                                      \
+  }
+
+#define STEP_STORE_VAR STEP_STORE_CONST
+
+#define STEP_LOAD_CONST                                                        \
+  {                                                                            \
+    r[ip->a] = constants[ip->k];                                               \
+    ip++;                                                                      \
+  }
+
+#define STEP_CALL FAIL("function calls are not supported yet");
+
+#define STEP_MOVE                                                              \
+  {                                                                            \
+    r[ip->a] = r[ip->b];                                                       \
+    ip++;                                                                      \
+  }
+
+#define STEP_LOAD_GLOBAL                                                       \
+  {                                                                            \
+    if (!this->defined[ip->k])                                                 \
+      FAIL("'" + std::string(this->program.pool.slots[ip->k].name()) +        \
+           "' is not defined");                                                \
+    r[ip->a] = globals[ip->k];                                                 \
+    ip++;                                                                      \
+  }
+
+#define STEP_ADD ARITHMETIC(wrap_add(x, y), x + y)
+#define STEP_SUBTRACT ARITHMETIC(wrap_sub(x, y), x - y)
+#define STEP_MULTIPLY ARITHMETIC(wrap_mul(x, y), x * y)
+
+// The one quotient that doesn't fit, LLONG_MIN / -1, wraps
+#define STEP_DIVIDE                                                            \
+  {                                                                            \
+    const CBC_Value &a = r[ip->b];                                             \
+    const CBC_Value &b = r[ip->c];                                             \
+    if (a.is_float() && b.is_float()) {                                        \
+      r[ip->a] = CBC_Value::floating(a.as_float_bits() / b.as_float_bits());   \
+    } else if (a.is_integer() && b.is_integer()) {                             \
+      long long int x = a.as_integer(), y = b.as_integer();                    \
+      if (y == 0)                                                              \
+        FAIL("division by zero");                                              \
+      r[ip->a] = heap.integer(y == -1 ? wrap_sub(0, x) : x / y);               \
+    } else if (a.is_number() && b.is_number()) {                               \
+      r[ip->a] = CBC_Value::floating(a.as_float() / b.as_float());             \
+    } else {                                                                   \
+      FAIL("operands must be numbers");                                        \
+    }                                                                          \
+    ip++;                                                                      \
+  }
+
+#define STEP_MODULUS                                                           \
+  {                                                                            \
+    const CBC_Value &a = r[ip->b];                                             \
+    const CBC_Value &b = r[ip->c];                                             \
+    if (a.is_integer() && b.is_integer()) {                                    \
+      long long int x = a.as_integer(), y = b.as_integer();                    \
+      if (y == 0)                                                              \
+        FAIL("division by zero");                                              \
+      r[ip->a] = heap.integer(y == -1 ? 0 : x % y);                            \
+    } else if (a.is_number() && b.is_number()) {                               \
+      r[ip->a] = CBC_Value::floating(std::fmod(a.as_float(), b.as_float()));   \
+    } else {                                                                   \
+      FAIL("operands must be numbers");                                        \
+    }                                                                          \
+    ip++;                                                                      \
+  }
+
+#define STEP_LESS COMPARISON(<)
+#define STEP_LESS_EQUAL COMPARISON(<=)
+
+#define STEP_EQUAL                                                             \
+  {                                                                            \
+    r[ip->a] = CBC_Value::boolean(values_equal(r[ip->b], r[ip->c]));           \
+    ip++;                                                                      \
+  }
+
+#define STEP_NOT_EQUAL                                                         \
+  {                                                                            \
+    r[ip->a] = CBC_Value::boolean(!values_equal(r[ip->b], r[ip->c]));          \
+    ip++;                                                                      \
+  }
+
+#define STEP_JUMP ip = code + ip->k;
+
+#define STEP_JUMP_IF_FALSE                                                     \
+  {                                                                            \
+    if (!r[ip->a].truthy())                                                    \
+      ip = code + ip->k;                                                       \
+    else                                                                       \
+      ip++;                                                                    \
+  }
+
+#define STEP_SPILL                                                             \
+  {                                                                            \
+    spills[ip->k] = r[ip->a];                                                  \
+    ip++;                                                                      \
+  }
+
+#define STEP_RELOAD                                                            \
+  {                                                                            \
+    r[ip->a] = spills[ip->k];                                                  \
+    ip++;                                                                      \
+  }
+
+#define HANDLER(op)                                                            \
+  CASE(op) {                                                                   \
+    STEP_##op                                                                  \
+    DISPATCH();                                                                \
+  }
+
+  // The first instruction always goes through the switch
+  goto dispatch;
+
+dispatch:
+  if constexpr (Profiled)
+    this->profile->record(ip - code, ip->op);
+
+  switch (ip->op) {
+    HANDLER(QUIT)
+    HANDLER(STORE_CONST)
+    HANDLER(STORE_VAR)
+    HANDLER(LOAD_CONST)
+    HANDLER(CALL)
+    HANDLER(MOVE)
+    HANDLER(LOAD_GLOBAL)
+    HANDLER(ADD)
+    HANDLER(SUBTRACT)
+    HANDLER(MULTIPLY)
+    HANDLER(DIVIDE)
+    HANDLER(MODULUS)
+    HANDLER(LESS)
+    HANDLER(LESS_EQUAL)
+    HANDLER(EQUAL)
+    HANDLER(NOT_EQUAL)
+    HANDLER(JUMP)
+    HANDLER(JUMP_IF_FALSE)
+    HANDLER(SPILL)
+    HANDLER(RELOAD)
+
+    // Every part but the last falls through to the next instruction, so
+    // running their steps back to back walks `ip` along the run
+#define CBC_SUPER2(name, first, second)                                        \
+  CASE(name) {                                                                 \
+    STEP_##first STEP_##second DISPATCH();                                     \
+  }
+#define CBC_SUPER3(name, first, second, third)                                 \
+  CASE(name) {                                                                 \
+    STEP_##first STEP_##second STEP_##third DISPATCH();                        \
+  }
+#include "cbc_super.def"
+#undef CBC_SUPER2
+#undef CBC_SUPER3
+  }
+
+#undef HANDLER
+#undef STEP_RELOAD
+#undef STEP_SPILL
+#undef STEP_JUMP_IF_FALSE
+#undef STEP_JUMP
+#undef STEP_NOT_EQUAL
+#undef STEP_EQUAL
+#undef STEP_LESS_EQUAL
+#undef STEP_LESS
+#undef STEP_MODULUS
+#undef STEP_DIVIDE
+#undef STEP_MULTIPLY
+#undef STEP_SUBTRACT
+#undef STEP_ADD
+#undef STEP_LOAD_GLOBAL
+#undef STEP_MOVE
+#undef STEP_CALL
+#undef STEP_LOAD_CONST
+#undef STEP_STORE_VAR
+#undef STEP_STORE_CONST
+#undef STEP_QUIT
+#undef COMPARISON
+#undef ARITHMETIC
+#undef FAIL
+#undef CASE
+#undef DISPATCH
+
+  return this->error(ip - code, "unknown opcode");
+}
+
+// ---------------------------------------------------------------------
+// BENCHMARK
+// ---------------------------------------------------------------------
+
+struct Bench_Program {
+  const char *name;
+  std::vector<CBC_Instruction> program;
+  CBC_Pool pool;
+  double executed; // instructions one run executes
+  long long int expected;
+  int result_register;
+};
+
+// `for (i = 0; i < n; i += 1) {}`, 4 instructions per iteration
+static Bench_Program counting_loop(long long int n) {
+  CBC_Pool pool;
+  std::vector<CBC_Instruction> p;
+  p.push_back(CBC_Instruction(CBC_Opcode::LOAD_CONST, 0, pool.integer(0)));
+  p.push_back(CBC_Instruction(CBC_Opcode::LOAD_CONST, 1, pool.integer(n)));
+  p.push_back(CBC_Instruction(CBC_Opcode::LOAD_CONST, 2, pool.integer(1)));
+  p.push_back(CBC_Instruction(CBC_Opcode::LESS, 3, 0, 1));
+  p.push_back(CBC_Instruction(CBC_Opcode::JUMP_IF_FALSE, 3, 7LL));
+  p.push_back(CBC_Instruction(CBC_Opcode::ADD, 0, 0, 2));
+  p.push_back(CBC_Instruction(CBC_Opcode::JUMP, 0, 3LL));
+  p.push_back(CBC_Instruction(CBC_Opcode::QUIT, 0));
+  return Bench_Program{"count", p, std::move(pool), 4.0 * n + 6, n, 0};
+}
+
+// `for (i = 0; i < n; i += 1) sum += i * i % 7`, 7 instructions per iteration
+static Bench_Program arithmetic_loop(long long int n) {
+  CBC_Pool pool;
+  std::vector<CBC_Instruction> p;
+  p.push_back(CBC_Instruction(CBC_Opcode::LOAD_CONST, 0, pool.integer(0)));
+  p.push_back(CBC_Instruction(CBC_Opcode::LOAD_CONST, 1, pool.integer(n)));
+  p.push_back(CBC_Instruction(CBC_Opcode::LOAD_CONST, 2, pool.integer(1)));
+  p.push_back(CBC_Instruction(CBC_Opcode::LOAD_CONST, 3, pool.integer(7)));
+  p.push_back(CBC_Instruction(CBC_Opcode::LOAD_CONST, 4, pool.integer(0)));
+  p.push_back(CBC_Instruction(CBC_Opcode::LESS, 5, 0, 1));
+  p.push_back(CBC_Instruction(CBC_Opcode::JUMP_IF_FALSE, 5, 12LL));
+  p.push_back(CBC_Instruction(CBC_Opcode::MULTIPLY, 6, 0, 0));
+  p.push_back(CBC_Instruction(CBC_Opcode::MODULUS, 6, 6, 3));
+  p.push_back(CBC_Instruction(CBC_Opcode::ADD, 4, 4, 6));
+  p.push_back(CBC_Instruction(CBC_Opcode::ADD, 0, 0, 2));
+  p.push_back(CBC_Instruction(CBC_Opcode::JUMP, 0, 5LL));
+  p.push_back(CBC_Instruction(CBC_Opcode::QUIT, 0));
+
+  long long int sum = 0;
+  for (long long int i = 0; i < n; i++)
+    sum += i * i % 7;
+  return Bench_Program{"arith", p, std::move(pool), 7.0 * n + 8, sum, 4};
+}
+
+void cbc_benchmark(const char *profile_path) {
+  const long long int n = 5000000;
+  for (Bench_Program (*make)(long long int) :
+       {counting_loop, arithmetic_loop}) {
+    // Fused is the threaded loop again over the same code with every run of
+    // instructions that has a superinstruction replaced by it
+    for (const char *mode : {"threaded", "switch  ", "fused   "}) {
+      Bench_Program bench = make(n);
+      bool fused = mode[0] == 'f';
+      if (fused)
+        cbc_fuse(bench.program);
+      CBC_Program program =
+          *CBC_Program::assemble(bench.program, std::move(bench.pool));
+
+      CBC_VM vm = CBC_VM(program);
+      auto start = std::chrono::steady_clock::now();
+      int status = mode[0] == 's' ? vm.run_switch() : vm.run();
+      std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+
+      const CBC_Value &result = vm.reg(bench.result_register);
+      bool ok = status == 0 && result.is_integer() &&
+                result.as_integer() == bench.expected;
+
+      std::cout << "[bench] " << bench.name << " " << mode << " "
+                << bench.executed / d.count() / 1e6 << " M instr/s ("
+                << d.count() * 1000 << " ms)" << (ok ? "" : " WRONG RESULT")
+                << std::endl;
+    }
+
+    // A shorter run is plenty to see which sequences the loop spends its
+    // time in
+    if (profile_path) {
+      Bench_Program bench = make(n / 100);
+      CBC_Program program =
+          *CBC_Program::assemble(bench.program, std::move(bench.pool));
+      CBC_Profile profile;
+      CBC_VM(program).run_profiled(profile);
+      profile.save(profile_path);
+    }
+  }
+}
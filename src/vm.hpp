@@ -0,0 +1,87 @@
+#ifndef VM_H
+#define VM_H
+
+#include "cbc.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// How often each opcode ran straight after another, and after two others,
+// for picking which runs to turn into superinstructions. Only instructions
+// that fall through to the next one count, since a run has to sit back to
+// back in the code to be fused
+class CBC_Profile {
+  std::vector<uint64_t> pairs; // indexed by first * N_CBC_OPCODES + second
+  std::unordered_map<uint32_t, uint64_t> triples;
+  size_t last_pc = SIZE_MAX;
+  CBC_Opcode previous[2] = {CBC_Opcode::QUIT, CBC_Opcode::QUIT};
+  int run = 0; // how many of `previous` fell through to the current one
+
+public:
+  CBC_Profile();
+
+  void record(size_t pc, CBC_Opcode op);
+
+  // Appends one `<count> <OPCODE> <OPCODE> [<OPCODE>]` line per run to
+  // `path`, so several programs can be profiled into the same file
+  bool save(const char *path) const;
+};
+
+// Register-based interpreter for a compiled CBC program. Every register starts
+// out as nil. Globals live in one array indexed by their pool slot and are
+// undefined until something is stored to them
+class CBC_VM {
+  const CBC_Program &program;
+  std::array<CBC_Value, CBC_REGISTERS> registers;
+  std::vector<CBC_Value> globals;
+  std::vector<bool> defined;
+  std::vector<CBC_Value> spills;
+  CBC_Heap heap; // integers too wide to store inline made while running
+  CBC_Profile *profile = nullptr;
+
+public:
+  CBC_VM(const CBC_Program &program);
+
+  // Runs the program until `QUIT` and returns its exit code. Runtime errors
+  // are printed to stderr and return -1
+  int run();
+
+  // Same as `run()` but always uses the portable switch dispatch
+  int run_switch();
+
+  // Same as `run_switch()` but counts every run of opcodes into `profile`
+  int run_profiled(CBC_Profile &profile);
+
+  const CBC_Value &reg(size_t r) const;
+  void print_globals() const;
+
+  // A global by name, if the program has one by that name and has stored to
+  // it. This is how one module reads what another one left behind
+  std::optional<CBC_Value> global(Symbol_Id name) const;
+
+  // Sets a global before the program runs. Names the program never refers
+  // to are ignored, since it can't read them anyway
+  void define(Symbol_Id name, CBC_Value value);
+
+  // Checks the program is safe to run, printing the first problem to stderr.
+  // Every `run()` does this first, but code from a file is checked as it's
+  // loaded too
+  bool verify();
+
+private:
+  template <bool Threaded, bool Profiled> int execute();
+  int error(size_t pc, std::string message);
+};
+
+// Runs synthetic loops through both dispatch loops, and through the threaded
+// one again with superinstructions, and prints their throughput in
+// instructions per second. With `profile_path` the loops are also profiled
+// into that file
+void cbc_benchmark(const char *profile_path = nullptr);
+
+#endif
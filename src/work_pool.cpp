@@ -0,0 +1,98 @@
+#include "work_pool.hpp"
+#include <utility>
+
+// Which pool and worker the current thread is, so that tasks submitting more
+// tasks keep them on their own queue
+static thread_local const Work_Pool *current_pool = nullptr;
+static thread_local size_t current_worker = 0;
+
+Work_Pool::Work_Pool(size_t threads) {
+  if (threads == 0)
+    threads = std::thread::hardware_concurrency();
+  if (threads == 0)
+    threads = 1;
+
+  for (size_t i = 0; i < threads; i++)
+    this->queues.push_back(std::make_unique<Queue>());
+  for (size_t i = 0; i < threads; i++)
+    this->workers.emplace_back(&Work_Pool::work, this, i);
+}
+
+Work_Pool::~Work_Pool() {
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->stopping = true;
+  }
+  this->wake.notify_all();
+  for (std::thread &worker : this->workers)
+    worker.join();
+}
+
+size_t Work_Pool::size() const { return this->workers.size(); }
+
+void Work_Pool::submit(Task task) {
+  size_t target = current_pool == this
+                      ? current_worker
+                      : this->next++ % this->queues.size();
+
+  this->unfinished++;
+  {
+    Queue &queue = *this->queues[target];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.tasks.push_back(std::move(task));
+    this->queued++;
+  }
+
+  // Taking the lock means a worker that just found nothing to do is either
+  // still about to look at `queued` or already waiting to be woken
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->wake.notify_one();
+}
+
+void Work_Pool::wait() {
+  std::unique_lock<std::mutex> lock(this->mutex);
+  this->done.wait(lock, [&] { return this->unfinished == 0; });
+}
+
+// The newest task of its own queue, or else the oldest of someone else's
+bool Work_Pool::take(size_t self, Task &task) {
+  size_t n = this->queues.size();
+  for (size_t i = 0; i < n; i++) {
+    Queue &queue = *this->queues[(self + i) % n];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty())
+      continue;
+    if (i == 0) {
+      task = std::move(queue.tasks.back());
+      queue.tasks.pop_back();
+    } else {
+      task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+    }
+    this->queued--;
+    return true;
+  }
+  return false;
+}
+
+void Work_Pool::work(size_t self) {
+  current_pool = this;
+  current_worker = self;
+
+  for (;;) {
+    Task task;
+    if (this->take(self, task)) {
+      task();
+      if (--this->unfinished == 0) {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->done.notify_all();
+      }
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->wake.wait(lock, [&] { return this->stopping || this->queued > 0; });
+    if (this->stopping && this->queued == 0)
+      return;
+  }
+}
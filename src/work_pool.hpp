@@ -0,0 +1,60 @@
+#ifndef WORK_POOL_H
+#define WORK_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads running tasks from per-worker queues.
+//
+// A worker takes its newest task first and, once its own queue is empty,
+// steals the oldest task of another worker. Tasks submitted from outside the
+// pool are dealt out round-robin, tasks submitted by a task go to the queue of
+// the worker running it, so related work tends to stay on one thread until
+// someone else runs dry
+class Work_Pool {
+public:
+  using Task = std::function<void()>;
+
+  // With `threads` 0, one per hardware thread
+  Work_Pool(size_t threads = 0);
+  Work_Pool(const Work_Pool &) = delete;
+  Work_Pool &operator=(const Work_Pool &) = delete;
+  ~Work_Pool();
+
+  void submit(Task task);
+
+  // Blocks until every task submitted so far, and everything they submitted,
+  // has finished
+  void wait();
+
+  size_t size() const;
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  std::vector<std::unique_ptr<Queue>> queues; // one per worker
+  std::vector<std::thread> workers;
+  std::atomic<size_t> next = 0;       // round-robin for outside submits
+  std::atomic<size_t> queued = 0;     // tasks sitting in a queue
+  std::atomic<size_t> unfinished = 0; // tasks submitted and not yet done
+
+  std::mutex mutex; // only for sleeping and waking
+  std::condition_variable wake;
+  std::condition_variable done;
+  bool stopping = false;
+
+  void work(size_t self);
+  bool take(size_t self, Task &task);
+};
+
+#endif